@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <boost/accumulators/framework/accumulator_base.hpp>
+#include <boost/accumulators/framework/depends_on.hpp>
+#include <boost/accumulators/framework/extractor.hpp>
+#include <boost/accumulators/framework/parameters/sample.hpp>
+#include <boost/accumulators/statistics/parameters/quantile_probability.hpp>
+#include <boost/accumulators/statistics/rolling_window.hpp>
+#include <boost/parameter/keyword.hpp>
+
+
+// Estimators with bounded memory for the Stats accumulators:
+//   ewma            Exponentially weighted moving average, the weight of a sample halves every 'half_life' samples
+//   rolling_median  Median of the rolling window, robust to bursts
+//   kll_quantile    Any quantile of all the samples, from a KLL sketch of about 'sketch_size' * 3 samples
+namespace boost {
+namespace accumulators {
+
+
+BOOST_PARAMETER_NESTED_KEYWORD(tag, ewma_half_life, half_life)
+BOOST_PARAMETER_NESTED_KEYWORD(tag, kll_sketch_size, sketch_size)
+
+
+namespace impl {
+
+template<typename Sample>
+struct ewma_accumulator : accumulator_base
+{
+	typedef double result_type;
+
+	template<typename Args>
+	ewma_accumulator(Args const & args) : alpha(1 - std::exp2(-1.0 / args[ewma_half_life | 4.0])) {}
+
+	template<typename Args>
+	void operator ()(Args const & args)
+	{
+		const double x = args[sample];
+		this->value = this->first ? x : this->value + this->alpha * (x - this->value);
+		this->first = false;
+	}
+
+	result_type result(dont_care) const
+	{
+		return this->value;
+	}
+
+	private:
+	double alpha;
+	double value = 0;
+	bool first = true;
+};
+
+
+template<typename Sample>
+struct rolling_median_accumulator : accumulator_base
+{
+	typedef double result_type;
+
+	rolling_median_accumulator(dont_care) {}
+
+	template<typename Args>
+	result_type result(Args const & args) const
+	{
+		// The window has room for one sample more, which is not part of it when it is full
+		const auto window = rolling_window_plus1(args);
+		auto v = std::vector<double>(window.begin() + is_rolling_window_plus1_full(args), window.end());
+		if (v.empty())
+			return std::numeric_limits<double>::quiet_NaN();
+
+		const size_t mid = v.size() / 2;
+		std::nth_element(v.begin(), v.begin() + mid, v.end());
+		if (v.size() % 2)
+			return v[mid];
+		return (v[mid] + *std::max_element(v.begin(), v.begin() + mid)) / 2;
+	}
+};
+
+
+// KLL sketch (Karnin, Lang and Liberty, 2016). Level h holds samples that stand for 2^h samples each. When a level is
+// full it is sorted and every other sample, starting at the first or the second, is promoted to the next level. The
+// top level holds 'sketch_size' samples and the lower ones 2/3 of the one above, with a minimum of 2.
+template<typename Sample>
+struct kll_accumulator : accumulator_base
+{
+	typedef double result_type;
+
+	template<typename Args>
+	kll_accumulator(Args const & args) : k(std::max<size_t>(args[kll_sketch_size | 200], 2)), levels(1) {}
+
+	template<typename Args>
+	void operator ()(Args const & args)
+	{
+		this->levels[0].push_back(args[sample]);
+		this->compress();
+	}
+
+	template<typename Args>
+	result_type result(Args const & args) const
+	{
+		auto weighted = std::vector<std::pair<double, uint64_t>>();
+		uint64_t total = 0;
+		for (size_t h = 0; h < this->levels.size(); h++)
+			for (const auto &x : this->levels[h])
+			{
+				weighted.push_back({x, (uint64_t) 1 << h});
+				total += (uint64_t) 1 << h;
+			}
+		if (weighted.empty())
+			return std::numeric_limits<double>::quiet_NaN();
+
+		std::sort(weighted.begin(), weighted.end());
+		const double rank = args[quantile_probability] * total;
+		uint64_t cumulative = 0;
+		for (const auto &w : weighted)
+		{
+			cumulative += w.second;
+			if (cumulative >= rank)
+				return w.first;
+		}
+		return weighted.back().first;
+	}
+
+	private:
+	size_t k;
+	std::vector<std::vector<double>> levels;
+	uint64_t coin = 0x9e3779b97f4a7c15;
+
+	size_t capacity(size_t h) const
+	{
+		const size_t depth = this->levels.size() - 1 - h;
+		return std::max<size_t>(std::ceil(this->k * std::pow(2.0 / 3.0, depth)), 2);
+	}
+
+	void compress()
+	{
+		for (size_t h = 0; h < this->levels.size(); h++)
+		{
+			if (this->levels[h].size() < this->capacity(h))
+				continue;
+			if (h + 1 == this->levels.size())
+				this->levels.emplace_back();
+
+			// Flip a coin (xorshift) to choose which half survives
+			this->coin ^= this->coin << 13;
+			this->coin ^= this->coin >> 7;
+			this->coin ^= this->coin << 17;
+
+			auto &level = this->levels[h];
+			std::sort(level.begin(), level.end());
+			for (size_t i = this->coin & 1; i < level.size(); i += 2)
+				this->levels[h + 1].push_back(level[i]);
+			level.clear();
+		}
+	}
+};
+
+} // namespace impl
+
+
+namespace tag {
+
+struct ewma : depends_on<>, ewma_half_life
+{
+	typedef accumulators::impl::ewma_accumulator<mpl::_1> impl;
+};
+
+struct rolling_median : depends_on<rolling_window_plus1>
+{
+	typedef accumulators::impl::rolling_median_accumulator<mpl::_1> impl;
+};
+
+struct kll_quantile : depends_on<>, kll_sketch_size
+{
+	typedef accumulators::impl::kll_accumulator<mpl::_1> impl;
+};
+
+} // namespace tag
+
+
+namespace extract {
+
+extractor<tag::ewma> const ewma = {};
+extractor<tag::rolling_median> const rolling_median = {};
+extractor<tag::kll_quantile> const kll_quantile = {};
+
+} // namespace extract
+
+using extract::ewma;
+using extract::rolling_median;
+using extract::kll_quantile;
+
+}} // namespace boost::accumulators
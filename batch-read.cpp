@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "batch-read.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+#define RING_PTR(base, offset) ((unsigned *) ((char *) (base) + (offset)))
+
+
+BatchReader::BatchReader(unsigned num_entries)
+{
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	ring_fd = syscall(__NR_io_uring_setup, num_entries, &p);
+	if (ring_fd < 0)
+	{
+		LOGINF("io_uring is not available ({}), the file descriptors will be read one by one"_format(strerror(errno)));
+		return;
+	}
+
+	entries = p.sq_entries;
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	const bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap)
+		sq_size = cq_size = std::max(sq_size, cq_size);
+
+	sq_ptr = mmap(0, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	cq_ptr = single_mmap ? sq_ptr : mmap(0, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+	sqes = (struct io_uring_sqe *) mmap(0, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (sq_ptr == MAP_FAILED || cq_ptr == MAP_FAILED || sqes == MAP_FAILED)
+	{
+		LOGWAR("Could not map the io_uring rings ({}), the file descriptors will be read one by one"_format(strerror(errno)));
+		ring_close();
+		return;
+	}
+
+	sq_tail  = RING_PTR(sq_ptr, p.sq_off.tail);
+	sq_mask  = RING_PTR(sq_ptr, p.sq_off.ring_mask);
+	sq_array = RING_PTR(sq_ptr, p.sq_off.array);
+	cq_head  = RING_PTR(cq_ptr, p.cq_off.head);
+	cq_tail  = RING_PTR(cq_ptr, p.cq_off.tail);
+	cq_mask  = RING_PTR(cq_ptr, p.cq_off.ring_mask);
+	cqes     = (struct io_uring_cqe *) ((char *) cq_ptr + p.cq_off.cqes);
+	LOGINF("Using io_uring with {} entries for batched reads"_format(entries));
+}
+
+
+void BatchReader::ring_close()
+{
+	if (sqes && sqes != MAP_FAILED)
+		munmap(sqes, entries * sizeof(struct io_uring_sqe));
+	if (cq_ptr && cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+		munmap(cq_ptr, cq_size);
+	if (sq_ptr && sq_ptr != MAP_FAILED)
+		munmap(sq_ptr, sq_size);
+	if (ring_fd >= 0)
+		close(ring_fd);
+	sqes = nullptr;
+	cq_ptr = sq_ptr = nullptr;
+	ring_fd = -1;
+}
+
+
+void BatchReader::read_plain(std::vector<Request> &requests, size_t begin)
+{
+	for (size_t i = begin; i < requests.size(); i++)
+	{
+		auto &r = requests[i];
+		r.result = ::read(r.fd, r.buf, r.size);
+		if (r.result < 0)
+			r.result = -errno;
+	}
+}
+
+
+void BatchReader::read(std::vector<Request> &requests)
+{
+	for (size_t begin = 0; begin < requests.size(); begin += entries)
+	{
+		if (!uring())
+		{
+			read_plain(requests, begin);
+			return;
+		}
+
+		// Queue the reads, we are the only producer so the tail can be read without synchronization
+		const size_t count = std::min((size_t) entries, requests.size() - begin);
+		unsigned tail = *sq_tail;
+		for (size_t i = 0; i < count; i++, tail++)
+		{
+			const auto &r = requests[begin + i];
+			const unsigned index = tail & *sq_mask;
+			struct io_uring_sqe *sqe = &sqes[index];
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = r.fd;
+			sqe->addr = (uint64_t) r.buf;
+			sqe->len = r.size;
+			sqe->user_data = begin + i;
+			sq_array[index] = index;
+		}
+		__atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+		// Submit them and wait for all of them to complete
+		const int ret = syscall(__NR_io_uring_enter, ring_fd, count, count, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret != (int) count)
+			throw_with_trace(std::runtime_error("io_uring submitted {} of {} reads: {}"_format(ret, count, ret < 0 ? strerror(errno) : "")));
+
+		bool unsupported = false;
+		unsigned head = *cq_head;
+		for (size_t reaped = 0; reaped < count;)
+		{
+			if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+			{
+				if (syscall(__NR_io_uring_enter, ring_fd, 0, count - reaped, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+					throw_with_trace(std::runtime_error("Waiting for io_uring reads failed: {}"_format(strerror(errno))));
+				continue;
+			}
+			const struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+			requests[cqe->user_data].result = cqe->res;
+			unsupported = unsupported || cqe->res == -EINVAL;
+			head++;
+			reaped++;
+		}
+		__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+		// Kernels before 5.6 do not have IORING_OP_READ
+		if (unsupported)
+		{
+			LOGWAR("The kernel cannot read with io_uring, the file descriptors will be read one by one");
+			ring_close();
+			read_plain(requests, begin);
+			return;
+		}
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <sys/types.h>
+
+
+// Reads several file descriptors with a single system call using io_uring. When io_uring is not available, or the
+// kernel cannot do plain reads with it (before 5.6), it falls back to a read() per descriptor.
+class BatchReader
+{
+	public:
+
+	struct Request
+	{
+		int fd;
+		void *buf;
+		size_t size;
+		ssize_t result;  // Bytes read, or -errno
+	};
+
+	private:
+
+	int ring_fd = -1;
+	unsigned entries = 0;
+	void *sq_ptr = nullptr;
+	void *cq_ptr = nullptr;
+	size_t sq_size = 0;
+	size_t cq_size = 0;
+	struct io_uring_sqe *sqes = nullptr;
+
+	unsigned *sq_tail = nullptr;
+	unsigned *sq_mask = nullptr;
+	unsigned *sq_array = nullptr;
+	unsigned *cq_head = nullptr;
+	unsigned *cq_tail = nullptr;
+	unsigned *cq_mask = nullptr;
+	struct io_uring_cqe *cqes = nullptr;
+
+	void ring_close();
+	void read_plain(std::vector<Request> &requests, size_t begin);
+
+	public:
+
+	BatchReader(unsigned entries = 256);
+
+	BatchReader(const BatchReader&) = delete;
+	BatchReader& operator=(const BatchReader&) = delete;
+	~BatchReader() { ring_close(); }
+
+	bool uring() const { return ring_fd >= 0; }
+	void read(std::vector<Request> &requests);
+};
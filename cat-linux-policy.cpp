@@ -43,21 +43,23 @@ clusters_t ClusteringBase::apply(const std::vector<Task> &tasklist)
 
 clusters_t Cluster_SF::apply(const std::vector<Task> &tasklist)
 {
-	// (Pos, Stalls) tuple
-	typedef std::pair<pid_t, uint64_t> pair_t;
+	// (Pos, Slowdown) tuple, where the slowdown is the estimated one if its model is enabled, or else the stalls
+	typedef std::pair<pid_t, double> pair_t;
 	auto v = std::vector<pair_t>();
 
 	for (uint32_t t = 0; t < tasklist.size(); t++)
 	{
-		uint64_t stalls;
+		double stalls;
 		const Task &task = tasklist[t];
 		try
 		{
-			stalls = acc::sum(task.stats.events.at("cycle_activity.stalls_ldm_pending"));
+			stalls = task.stats.events.count("slowdown") ?
+					task.stats.get_total("slowdown") :
+					acc::sum(task.stats.event("mem_stalls"));
 		}
 		catch (const std::exception &e)
 		{
-			std::string msg = "This policy requires the event 'cycle_activity.stalls_ldm_pending'. The events monitorized are:";
+			std::string msg = "This policy requires the event 'mem_stalls'. The events monitorized are:";
 			for (const auto &kv : task.stats.events)
 				msg += "\n" + kv.first;
 			throw_with_trace(std::runtime_error(msg));
@@ -65,7 +67,7 @@ clusters_t Cluster_SF::apply(const std::vector<Task> &tasklist)
 		v.push_back(std::make_pair(t, stalls));
 	}
 
-	// Sort in descending order by stalls
+	// Sort in descending order by slowdown
 	std::sort(begin(v), end(v),
 			[](const pair_t &t1, const pair_t &t2)
 			{
@@ -84,7 +86,7 @@ clusters_t Cluster_SF::apply(const std::vector<Task> &tasklist)
 		{
 			auto task_id = v[t].first;
 			auto task_stalls = v[t].second;
-			clusters[s].addPoint(std::make_shared<Point>(task_id, std::vector<double>{(double) task_stalls}));
+			clusters[s].addPoint(std::make_shared<Point>(task_id, std::vector<double>{task_stalls}));
 			size--;
 			t++;
 		}
@@ -109,7 +111,7 @@ clusters_t Cluster_KMeans::apply(const std::vector<Task> &tasklist)
 		double metric;
 		try
 		{
-			metric = acc::rolling_mean(task.stats.events.at(event));
+			metric = task.stats.estimate(event, estimator);
 		}
 		catch (const std::exception &e)
 		{
@@ -44,11 +44,12 @@ class Cluster_KMeans: public ClusteringBase
 	int max_clusters;
 	EvalClusters eval_clusters;
 	std::string event;
+	Estimator estimator;  // How the value of the event is estimated from its last intervals
 	bool sort_ascending;
 
-	Cluster_KMeans(int num_clusters, int max_clusters, EvalClusters eval_clusters, std::string event, bool sort_ascending) :
+	Cluster_KMeans(int num_clusters, int max_clusters, EvalClusters eval_clusters, std::string event, Estimator estimator, bool sort_ascending) :
 			num_clusters(num_clusters), max_clusters(max_clusters),
-			eval_clusters(eval_clusters), event(event),
+			eval_clusters(eval_clusters), event(event), estimator(estimator),
 			sort_ascending(sort_ascending) {}
 	virtual ~Cluster_KMeans() = default;
 
@@ -66,9 +67,8 @@ class DistributingBase
 
 	DistributingBase()
 	{
-		auto info = cat_read_info();
-		min_ways = info["L3"].min_cbm_bits;
-		max_ways = __builtin_popcount(info["L3"].cbm_mask);
+		min_ways = topology().min_cbm_bits(3);
+		max_ways = topology().cache_ways(3);
 	}
 
 	DistributingBase(int min_ways, int max_ways) : min_ways(min_ways), max_ways(max_ways) {}
@@ -177,8 +177,8 @@ class ClusterAndDistribute: public Base
 
 	virtual void apply(uint64_t current_interval, const std::vector<Task> &tasklist)
 	{
-		// Apply the policy only when the amount of intervals specified has passed
-		if (current_interval % every != 0)
+		// Apply the policy only when the amount of intervals specified has passed, or a task has changed its phase
+		if (!due(current_interval, tasklist, every))
 			return;
 		auto clusters = clustering->apply(tasklist);
 		auto ways = distributing->apply(tasklist, clusters);
@@ -6,6 +6,7 @@
 #include "cat-linux.hpp"
 #include "common.hpp"
 #include "throw-with-trace.hpp"
+#include "topology.hpp"
 
 
 #define ROOT "/sys/fs/resctrl"
@@ -19,16 +20,28 @@ using std::vector;
 using fmt::literals::operator""_format;
 
 
-std::map<std::string, CATInfo> cat_read_info()
+// Control groups are the directories in the resctrl root, but for the info and monitoring ones
+static bool is_clos_dir(const fs::path &p)
+{
+	const string name = p.filename().string();
+	return fs::is_directory(p) && name != "info" && name != "mon_groups" && name != "mon_data";
+}
+
+
+std::map<std::string, CATInfo> cat_read_info(const std::string &info_dir)
 {
 	std::map<string, CATInfo> info;
-	for(auto &p: fs::directory_iterator(INFO_DIR))
+	for(auto &p: fs::directory_iterator(info_dir))
 	{
 		string cache = fs::basename(p);
 		uint64_t cbm_mask;
 		uint32_t min_cbm_bits;
 		uint32_t num_closids;
 
+		// Skip monitoring (L3_MON) and memory bandwidth (MB) resources
+		if (!fs::exists(p.path() / "cbm_mask"))
+			continue;
+
 		try
 		{
 			std::ifstream f;
@@ -41,7 +54,7 @@ std::map<std::string, CATInfo> cat_read_info()
 		}
 		catch(const std::system_error &e)
 		{
-			throw_with_trace(std::runtime_error("Cannot read CAT info '{}': {}"_format(INFO_DIR, strerror(errno))));
+			throw_with_trace(std::runtime_error("Cannot read CAT info '{}': {}"_format(info_dir, strerror(errno))));
 		}
 
 		info[cache] = CATInfo(cache, cbm_mask, min_cbm_bits, num_closids);
@@ -122,7 +135,7 @@ fs::path CATLinux::get_clos_dir(uint32_t cpu) const
 		return fs::path(ROOT);
 
 	for(auto &p: fs::directory_iterator(ROOT))
-		if (fs::is_directory(p) && fs::basename(p) != "info")
+		if (is_clos_dir(p))
 			if (get_cpus(p) & cpu_mask)
 				return p;
 	throw_with_trace(std::runtime_error("CPU {} is not in any CLOS, does it exist?"));
@@ -133,7 +146,7 @@ std::vector<fs::path> CATLinux::get_clos_dirs() const
 {
 	auto result = std::vector<fs::path>();
 	for(auto &p: fs::directory_iterator(ROOT))
-		if (fs::is_directory(p) && fs::basename(p) != "info")
+		if (is_clos_dir(p))
 			result.push_back(p);
 	return result;
 }
@@ -204,7 +217,7 @@ void CATLinux::delete_all_clos()
 {
 	auto to_remove = vector<fs::path>();
 	for(const auto &p: fs::directory_iterator(ROOT))
-		if (fs::is_directory(p) && fs::basename(p) != "info")
+		if (is_clos_dir(p))
 			to_remove.push_back(p);
 	for(const auto &p: to_remove)
 		delete_clos(p);
@@ -230,8 +243,7 @@ fs::path CATLinux::intel_to_linux(uint32_t clos) const
 void CATLinux::init()
 {
 	initialized = true;
-	auto infomap = cat_read_info();
-	info = infomap["L3"];
+	info = topology().cat_info(3);
 	reset();
 	create_all_clos();
 }
@@ -89,5 +89,5 @@ class CATLinux : public CAT
 };
 
 
-std::map<std::string, CATInfo> cat_read_info();
+std::map<std::string, CATInfo> cat_read_info(const std::string &info_dir = "/sys/fs/resctrl/info");
 
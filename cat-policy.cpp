@@ -58,68 +58,74 @@ void Slowfirst::check_masks(const std::vector<uint64_t> &masks) const
 // Each one fulfills fn(0) == min_num_ways and fn(an) == max_num_ways and grows linearli, quadratically and exponentially, respectively.
 SfCOA::Model::Model(const std::string &name) : name(name)
 {
+	// The log, linlog and camel models were fitted for a cache of 20 ways, so we scale their output to the actual number of ways
+	const auto rescale = [](double y, uint32_t max_ways) -> double
+	{
+		return min_num_ways + (y - min_num_ways) * (max_ways - min_num_ways) / (20.0 - min_num_ways);
+	};
+
 	models =
 	{
-		{ "none", [](double x) -> double
+		{ "none", [](double x, uint32_t) -> double
 			{
 				assert(x >= 0 && x <= 1);
 				throw_with_trace(std::runtime_error("The 'none' model is not suposed to be called"));
 			}
 		},
-		{ "linear", [](double x) -> double
+		{ "linear", [](double x, uint32_t max_ways) -> double
 			{
 				assert(x >= 0 && x <= 1);
-				const double a = max_num_ways - min_num_ways;
+				const double a = max_ways - min_num_ways;
 				x *= a; // Scale X for the interval [0, a]
 				return x + min_num_ways;
 			}
 		},
-		{ "quadratic", [](double x) -> double
+		{ "quadratic", [](double x, uint32_t max_ways) -> double
 			{
 				assert(x >= 0 && x <= 1);
-				const double a = std::sqrt(max_num_ways - min_num_ways);
+				const double a = std::sqrt(max_ways - min_num_ways);
 				x *= a; // Scale X for the interval [0, a]
 				return std::pow(x, 2) + min_num_ways;
 			}
 		},
-		{ "exponential", [](double x) -> double
+		{ "exponential", [](double x, uint32_t max_ways) -> double
 			{
 				assert(x >= 0 && x <= 1);
-				const double a = std::log(max_num_ways - min_num_ways + 1);
+				const double a = std::log(max_ways - min_num_ways + 1);
 				x *= a; // Scale X for the interval [0, a]
 				return std::exp(x) + min_num_ways - 1;
 			}
 		},
-		{ "expquad", [](double x) -> double
+		{ "expquad", [](double x, uint32_t max_ways) -> double
 			{
 				assert(x >= 0 && x <= 1);
-				const double a = std::sqrt(std::log(max_num_ways - min_num_ways + 1));
+				const double a = std::sqrt(std::log(max_ways - min_num_ways + 1));
 				x *= a; // Scale X for the interval [0, a]
 				return std::exp(pow(x, 2)) + min_num_ways - 1;
 			}
 		},
-		{ "log", [](double x) -> double
+		{ "log", [rescale](double x, uint32_t max_ways) -> double
 			{
 				assert(x >= 0 && x <= 1);
 				const double a = 14.849;
 				x *= a; // Scale X for the interval [0, a]
-				return 15 * std::log(x + 1) + min_num_ways;
+				return rescale(15 * std::log(x + 1) + min_num_ways, max_ways);
 			}
 		},
-		{ "linlog", [](double x) -> double
+		{ "linlog", [rescale](double x, uint32_t max_ways) -> double
 			{
 				assert(x >= 0 && x <= 1);
 				const double a = 15.222;
 				x *= a; // Scale X for the interval [0, a]
-				return x * std::log(x) + 2;
+				return rescale(x * std::log(x) + 2, max_ways);
 			}
 		},
-		{ "camel", [](double x) -> double
+		{ "camel", [rescale](double x, uint32_t max_ways) -> double
 			{
 				assert(x >= 0 && x <= 1);
 				const double a = 21.522;
 				x *= a; // Scale X for the interval [0, a]
-				return (0.9 * x - 25) * std::exp(0.1 * x) + 0.005 * std::pow(x + 40, 2) + x + 24;
+				return rescale((0.9 * x - 25) * std::exp(0.1 * x) + 0.005 * std::pow(x + 40, 2) + x + 24, max_ways);
 			}
 		},
 	};
@@ -133,12 +139,13 @@ SfCOA::Model::Model(const std::string &name) : name(name)
 
 void SlowfirstClusteredOptimallyAdjusted::apply(uint64_t current_interval, const std::vector<Task> &tasklist)
 {
-	// Apply the policy only when the amount of intervals specified has passed
-	if (current_interval % every != 0)
+	// Apply the policy only when the amount of intervals specified has passed, or a task has changed its phase
+	if (!due(current_interval, tasklist, every))
 		return;
 
 	auto data = points_t();
 	acc::accumulator_set<double, acc::stats<acc::tag::mean, acc::tag::variance, acc::tag::max>> accum;
+	acc::accumulator_set<double, acc::stats<acc::tag::mean, acc::tag::variance>> accum_metric;  // Of the points, for the outliers
 
 	LOGDEB(fmt::format("function: {}, interval: {}", __PRETTY_FUNCTION__, current_interval));
 
@@ -150,16 +157,16 @@ void SlowfirstClusteredOptimallyAdjusted::apply(uint64_t current_interval, const
 		uint64_t l3_misses;
 		uint64_t stalls;
 		uint64_t accum_stalls;
-		const std::string he = "MEM_LOAD_UOPS_RETIRED.L3_HIT";
-		const std::string me = "MEM_LOAD_UOPS_RETIRED.L3_MISS";
-		const std::string se = "CYCLE_ACTIVITY.STALLS_TOTAL";
+		const std::string he = "llc_hits";
+		const std::string me = "llc_misses";
+		const std::string se = "stalls_total";
 		const Stats &stats = task.stats;
 		try
 		{
-			l3_hits = acc::rolling_mean(stats.events.at(he));
-			l3_misses = acc::rolling_mean(stats.events.at(me));
-			stalls = acc::rolling_mean(stats.events.at(se));
-			accum_stalls = acc::sum(stats.events.at(se));
+			l3_hits = acc::rolling_mean(stats.event(he));
+			l3_misses = acc::rolling_mean(stats.event(me));
+			stalls = acc::rolling_mean(stats.event(se));
+			accum_stalls = acc::sum(stats.event(se));
 		}
 		catch (const std::exception &e)
 		{
@@ -170,14 +177,16 @@ void SlowfirstClusteredOptimallyAdjusted::apply(uint64_t current_interval, const
 		}
 
 		double hr = (double) l3_hits / (double) (l3_hits + l3_misses);
-		double metric = accum_stalls;
+		// The estimated slowdown is better than the stalls, if its model is enabled in the config
+		double metric = stats.events.count("slowdown") ? stats.get_total("slowdown") : accum_stalls;
 
 		double completed = task.max_instr ?
 				(double) stats.get_current("instructions") / (double) task.max_instr : task.completed;
 
 		accum(stalls);
+		accum_metric(metric);
 
-		data.push_back(std::make_shared<Point>(task.id, std::vector<double>(metric)));
+		data.push_back(std::make_shared<Point>(task.id, std::vector<double>{metric}));
 		LOGDEB(fmt::format("{{id: {}, name: {}, completed: {:.2f}, metric: {}, stalls: {:n}, hr: {}}}", task.id, task.name, completed, metric, stalls, hr));
 	}
 
@@ -274,13 +283,17 @@ void SlowfirstClusteredOptimallyAdjusted::apply(uint64_t current_interval, const
 	for (const auto &cluster : clusters)
 		LOGDEB(cluster.to_string());
 
+	// Look up the size of the cache once, it is used for every cluster
+	const uint32_t max_ways = max_num_ways();
+	const uint64_t full_mask = complete_mask();
+
 	LOGDEB("Selected model: {}"_format(model.name));
 	if (model.name != "none")
 	{
 		for (size_t i = 0; i < clusters.size(); i++)
 		{
 			const double x = clusters[i].getCentroid()[0] / clusters.front().getCentroid()[0];
-			const double y = model(x);
+			const double y = model(x, max_ways);
 			LOGDEB("Cluster {} : x = {} y = {} -> {} ways"_format(i, x, y, std::round(y)));
 		}
 	}
@@ -293,7 +306,8 @@ void SlowfirstClusteredOptimallyAdjusted::apply(uint64_t current_interval, const
 	// Compute new masks
 	if (model.name != "none")
 	{
-		const double th = acc::mean(accum) + 2 * std::sqrt(acc::variance(accum));
+		// In the units of the points, the slowdown or the stalls
+		const double th = acc::mean(accum_metric) + 2 * std::sqrt(acc::variance(accum_metric));
 		const point_ptr_t p = *std::max_element(clusters[1].getPoints().begin(), clusters[1].getPoints().end(), [](const point_ptr_t a, const point_ptr_t b){ return a->values[0] < b->values[0]; });
 
 		size_t c;
@@ -307,14 +321,16 @@ void SlowfirstClusteredOptimallyAdjusted::apply(uint64_t current_interval, const
 			}
 
 			const double x = std::min(clusters[c].getCentroid()[0] / quotient, 1.0);
-			const uint32_t ways = std::round(model(x));
+			// Clamp before rounding, the models can go out of range and a negative value cannot be cast
+			const double y = std::min(std::max(model(x, max_ways), (double) min_num_ways), (double) max_ways);
+			const uint32_t ways = std::round(y);
 			if (alternate_sides && (c % 2) == 1)
-				masks[c] = (complete_mask << (max_num_ways - ways)) & complete_mask; // The mask starts from the left
+				masks[c] = (full_mask << (max_ways - ways)) & full_mask; // The mask starts from the left
 			else
-				masks[c] = (complete_mask >> (max_num_ways - ways)); // The mask starts from the right
+				masks[c] = (full_mask >> (max_ways - ways)); // The mask starts from the right
 		}
 		for (;  c < masks.size(); c++)
-			masks[c] = complete_mask;
+			masks[c] = full_mask;
 		set_masks(masks);
 	}
 
@@ -6,16 +6,21 @@
 #include <vector>
 
 #include "cat.hpp"
+#include "interference.hpp"
 #include "kmeans.hpp"
+#include "phase.hpp"
 #include "task.hpp"
+#include "topology.hpp"
 
 namespace cat
 {
 
 
 const uint32_t min_num_ways = 2;
-const uint32_t max_num_ways = 20;
-const uint32_t complete_mask = ~(-1U << max_num_ways);
+
+// The number of ways and the complete mask depend on the L3 of the machine
+inline uint32_t max_num_ways()  { return topology().cache_ways(3); }
+inline uint64_t complete_mask() { return topology().cbm_mask(3); }
 
 
 namespace policy
@@ -29,11 +34,28 @@ class Base
 
 	std::shared_ptr<CAT> cat;
 
+	// Detects the phase changes of the tasks, for the periodic policies
+	std::shared_ptr<PhaseTrigger> phases;
+
+	// Estimates of how much the tasks interfere with each other, for the policies that place or group them
+	std::shared_ptr<const InterferenceGraph> interference;
+
+	// Whether a periodic policy has to run. Without phase detection, every 'every' intervals. With it, only when some
+	// task changes its phase, or when the safety timer of the phase detection expires.
+	bool due(uint64_t current_interval, const std::vector<Task> &tasklist, uint64_t every)
+	{
+		if (phases)
+			return phases->update(current_interval, tasklist);
+		return current_interval % every == 0;
+	}
+
 	public:
 
 	Base() = default;
 
 	void set_cat(std::shared_ptr<CAT> cat)     { this->cat = cat; }
+	void set_phases(std::shared_ptr<PhaseTrigger> phases) { this->phases = phases; }
+	void set_interference(std::shared_ptr<const InterferenceGraph> interference) { this->interference = interference; }
 	std::shared_ptr<CAT> get_cat()             { return cat; }
 	const std::shared_ptr<CAT> get_cat() const { return cat; }
 
@@ -124,8 +146,8 @@ class SlowfirstClusteredOptimallyAdjusted: public SlowfirstClustered
 
 	class Model
 	{
-		std::unordered_map <std::string, std::function<double(double)>> models;
-		std::function<double(double)> model;
+		std::unordered_map <std::string, std::function<double(double, uint32_t)>> models;
+		std::function<double(double, uint32_t)> model;
 
 		public:
 
@@ -133,7 +155,8 @@ class SlowfirstClusteredOptimallyAdjusted: public SlowfirstClustered
 
 		Model(const std::string &name);
 
-		double operator() (double x) const { return model(x); }
+		// Ways for a cluster with a relative slowdown x, in a cache of max_ways ways
+		double operator() (double x, uint32_t max_ways) const { return model(x, max_ways); }
 	};
 
 	const Model model;
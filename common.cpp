@@ -1,4 +1,6 @@
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/filesystem.hpp>
 #include <glib.h>
 
@@ -153,3 +155,45 @@ void set_cpu_affinity(std::vector<uint32_t> cpus, pid_t pid)
 	if (sched_setaffinity(pid, sizeof(mask), &mask) < 0)
 		throw_with_trace(std::runtime_error("Could not set CPU affinity: " + std::string(strerror(errno))));
 }
+
+
+std::vector<uint32_t> get_cpu_affinity(pid_t pid)
+{
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	if (sched_getaffinity(pid, sizeof(mask), &mask) < 0)
+		throw_with_trace(std::runtime_error("Could not get the CPU affinity of the task {}: {}"_format(pid, strerror(errno))));
+
+	auto cpus = std::vector<uint32_t>();
+	for (uint32_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &mask))
+			cpus.push_back(cpu);
+	return cpus;
+}
+
+
+// Parses a list of CPUs in the format used by the kernel, e.g. "0-3,8,10-11"
+std::vector<uint32_t> parse_cpu_list(const std::string &list)
+{
+	auto result = std::vector<uint32_t>();
+	auto ranges = std::vector<std::string>();
+	boost::split(ranges, boost::trim_copy(list), [](char c){ return c == ','; });
+	for (const auto &range : ranges)
+	{
+		if (range.empty())
+			continue;
+		try
+		{
+			const auto dash = range.find('-');
+			const uint32_t first = std::stoul(range.substr(0, dash));
+			const uint32_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+			for (uint32_t cpu = first; cpu <= last; cpu++)
+				result.push_back(cpu);
+		}
+		catch (const std::logic_error &e)
+		{
+			throw_with_trace(std::runtime_error("Invalid CPU list '{}'"_format(list)));
+		}
+	}
+	return result;
+}
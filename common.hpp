@@ -17,7 +17,9 @@ void dir_copy(const std::string &source, const std::string &dest);
 std::string random_string(size_t length);
 void drop_privileges();
 void set_cpu_affinity(std::vector<uint32_t> cpus, pid_t pid=0);
+std::vector<uint32_t> get_cpu_affinity(pid_t pid=0);
 void assert_dir_exists(const boost::filesystem::path &dir);
+std::vector<uint32_t> parse_cpu_list(const std::string &list);
 
 
 // Measure the time the passed callable object consumes
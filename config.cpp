@@ -1,13 +1,17 @@
 #include <iostream>
 #include <map>
+#include <sstream>
 
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/algorithm/string/split.hpp>
 #include <yaml-cpp/yaml.h>
 #include <fmt/format.h>
 
 #include "cat-linux-policy.hpp"
 #include "config.hpp"
 #include "log.hpp"
+#include "topology.hpp"
 
 
 using std::vector;
@@ -16,8 +20,13 @@ using fmt::literals::operator""_format;
 
 
 static std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &config);
+static std::shared_ptr<PhaseTrigger> config_read_phase(const YAML::Node &config);
+static std::shared_ptr<InterferenceGraph> config_read_interference(const YAML::Node &config);
 static vector<Cos> config_read_cos(const YAML::Node &config);
 static vector<Task> config_read_tasks(const YAML::Node &config);
+static double config_read_ref_ipc(const YAML::Node &node, const string &name);
+static vector<DerivedMetric> config_read_derived_metrics(const YAML::Node &config);
+static EstimatorParams config_read_estimator_params(const YAML::Node &node, EstimatorParams params);
 static YAML::Node merge(YAML::Node user, YAML::Node def);
 static void config_check_fields(const YAML::Node &node, const std::vector<string> &required, std::vector<string> allowed);
 
@@ -60,7 +69,7 @@ std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &conf
 	if (kind == "sfcoa")
 	{
 		vector<string> required = {"kind", "every", "model"};
-		vector<string> allowed  = {"num_clusters", "alternate_sides", "min_stall_ratio", "detect_outliers", "eval_clusters", "cluster_sizes", "min_max"};
+		vector<string> allowed  = {"num_clusters", "alternate_sides", "min_stall_ratio", "detect_outliers", "eval_clusters", "cluster_sizes", "min_max", "phase"};
 		vector<std::pair<string, string>> incompatible = {
 				{"num_clusters", "eval_clusters"},
 				{"num_clusters", "cluster_sizes"},
@@ -98,7 +107,7 @@ std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &conf
 	else if (kind == "cad")
 	{
 		vector<string> required = {"kind", "clustering", "distribution"};
-		vector<string> allowed  = {"every"};
+		vector<string> allowed  = {"every", "phase"};
 
 		config_check_fields(policy, required, allowed);
 
@@ -112,15 +121,18 @@ std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &conf
 
 		if (clustering == "kmeans")
 		{
-			config_check_fields(policy["clustering"], {"kind", "num_clusters", "event"}, {"max_clusters", "eval_clusters", "sort_clusters"});
+			config_check_fields(policy["clustering"], {"kind", "num_clusters", "event"}, {"max_clusters", "eval_clusters", "sort_clusters", "estimator"});
 			int num_clusters = policy["clustering"]["num_clusters"].as<int>();
 			int max_clusters = policy["clustering"]["max_clusters"] ?
 					policy["clustering"]["max_clusters"].as<int>() :
-					cat_read_info()["L3"].num_closids;
+					topology().num_closids(3);
 			EvalClusters eval_clusters = str_to_evalclusters(policy["eval_clusters"] ?
 					policy["eval_clusters"].as<string>() :
 					"dunn");
 			auto event = policy["clustering"]["event"].as<string>();
+			Estimator estimator = str_to_estimator(policy["clustering"]["estimator"] ?
+					policy["clustering"]["estimator"].as<string>() :
+					"rolling_mean");
 			auto sort = policy["clustering"]["sort_clusters"].as<string>();
 			bool sort_ascending = false;
 			if (sort == "ascending")
@@ -128,7 +140,7 @@ std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &conf
 			else if (sort != "descending")
 				throw_with_trace(std::runtime_error("The value of 'sort_clusters' can only be 'ascending' or 'decending'"));
 
-			clustering_ptr = std::make_shared<cat::policy::Cluster_KMeans>(num_clusters, max_clusters, eval_clusters, event, sort_ascending);
+			clustering_ptr = std::make_shared<cat::policy::Cluster_KMeans>(num_clusters, max_clusters, eval_clusters, event, estimator, sort_ascending);
 		}
 		else if (clustering == "sf")
 		{
@@ -166,7 +178,7 @@ std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &conf
 					2;
 			auto max_ways = policy["distribution"]["max_ways"] ?
 					policy["distribution"]["max_ways"].as<int>() :
-					20;
+					(int) topology().cache_ways(3);
 			distribution_ptr = std::make_shared<cat::policy::Distribute_RelFunc>(min_ways, max_ways, invert_metric);
 		}
 		else if (distribution == "static")
@@ -188,6 +200,44 @@ std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &conf
 }
 
 
+// With a phase field, the periodic policies run when a task changes its phase instead of every 'every' intervals, and
+// when the safety timer expires, 10 times 'every' by default
+static
+std::shared_ptr<PhaseTrigger> config_read_phase(const YAML::Node &config)
+{
+	YAML::Node phase = config["cat_policy"]["phase"];
+
+	config_check_fields(phase, {"event"}, {"delta", "threshold", "timer"});
+	string event = phase["event"].as<string>();
+	double delta = phase["delta"] ? phase["delta"].as<double>() : 0.05;
+	double threshold = phase["threshold"] ? phase["threshold"].as<double>() : 1;
+	uint64_t every = config["cat_policy"]["every"] ? config["cat_policy"]["every"].as<uint64_t>() : 1;
+	uint64_t timer = phase["timer"] ? phase["timer"].as<uint64_t>() : 10 * every;
+	if (timer == 0)
+		throw_with_trace(std::runtime_error("The timer of the phase detection must be at least one interval"));
+
+	LOGINF("Detecting the phases of the tasks with the event {}, with a timer of {} intervals"_format(event, timer));
+	return std::make_shared<PhaseTrigger>(event, timer, delta, threshold);
+}
+
+
+// The pressure can be a metric or a list of them
+static
+std::shared_ptr<InterferenceGraph> config_read_interference(const YAML::Node &config)
+{
+	YAML::Node node = config["interference"];
+
+	config_check_fields(node, {}, {"pressure", "victim", "half_life"});
+	auto pressure = vector<string>{"llc_misses"};
+	if (node["pressure"])
+		pressure = node["pressure"].IsSequence() ? node["pressure"].as<vector<string>>() : vector<string>{node["pressure"].as<string>()};
+	string victim = node["victim"] ? node["victim"].as<string>() : "ipc";
+	double half_life = node["half_life"] ? node["half_life"].as<double>() : 16;
+
+	return std::make_shared<InterferenceGraph>(pressure, victim, half_life);
+}
+
+
 static
 vector<Cos> config_read_cos(const YAML::Node &config)
 {
@@ -225,6 +275,44 @@ vector<Cos> config_read_cos(const YAML::Node &config)
 }
 
 
+// The reference IPC is either a number or the total output of a run of the task alone, with its IPC
+static
+double config_read_ref_ipc(const YAML::Node &node, const string &name)
+{
+	try
+	{
+		return node.as<double>();
+	}
+	catch (const YAML::BadConversion &e) {}
+
+	const string path = node.as<string>();
+	std::stringstream ss;
+	ss << open_ifstream(path).rdbuf();
+
+	string line;
+	auto header = vector<string>();
+	std::getline(ss, line);
+	boost::split(header, line, [](char c) { return c == ','; });
+	const auto app = std::find(header.begin(), header.end(), "app");
+	const auto ipc = std::find(header.begin(), header.end(), "ipc");
+	if (app == header.end() || ipc == header.end())
+		throw_with_trace(std::runtime_error("The file '{}' has no app and ipc columns"_format(path)));
+
+	// The apps are written as <id>_<name>, the last row of the task is used
+	double result = 0;
+	while (std::getline(ss, line))
+	{
+		auto fields = vector<string>();
+		boost::split(fields, line, [](char c) { return c == ','; });
+		if (fields.size() == header.size() && boost::ends_with(fields[app - header.begin()], "_" + name))
+			result = std::stod(fields[ipc - header.begin()]);
+	}
+	if (result <= 0)
+		throw_with_trace(std::runtime_error("There is no IPC for the task {} in '{}'"_format(name, path)));
+	return result;
+}
+
+
 static
 vector<Task> config_read_tasks(const YAML::Node &config)
 {
@@ -263,6 +351,9 @@ vector<Task> config_read_tasks(const YAML::Node &config)
 				cpus = {node.as<decltype (cpus)::value_type>()};
 			else
 				cpus = node.as<decltype(cpus)>();
+			for (const auto &cpu : cpus)
+				if (!topology().has_cpu(cpu))
+					throw_with_trace(std::runtime_error("The CPU {} of the task {} does not exist or is offline"_format(cpu, name)));
 		}
 
 		// Initial CLOS
@@ -296,12 +387,50 @@ vector<Task> config_read_tasks(const YAML::Node &config)
 
 		bool batch = tasks[i]["batch"] ? tasks[i]["batch"].as<bool>() : false;
 
-		result.push_back(Task(name, cmd, initial_clos, cpus, output, input, error, skel, max_instr, batch));
+		// IPC of the task running alone, for the throughput and fairness metrics
+		double ref_ipc = tasks[i]["ref_ipc"] ? config_read_ref_ipc(tasks[i]["ref_ipc"], name) : 0;
+
+		result.push_back(Task(name, cmd, initial_clos, cpus, output, input, error, skel, max_instr, batch, ref_ipc));
 	}
 	return result;
 }
 
 
+static
+vector<DerivedMetric> config_read_derived_metrics(const YAML::Node &config)
+{
+	YAML::Node section = config["derived_metrics"];
+	auto result = vector<DerivedMetric>();
+
+	if (!section.IsMap())
+		throw_with_trace(std::runtime_error("In the config file, the derived_metrics section must map names to expressions"));
+
+	// The expressions are compiled here, so syntax errors are reported before launching anything
+	for (const auto &m : section)
+		result.push_back({m.first.as<string>(), Expr(m.second.as<string>())});
+
+	return result;
+}
+
+
+// Reads the fields present in the node, the others keep the values in 'params'
+static
+EstimatorParams config_read_estimator_params(const YAML::Node &node, EstimatorParams params)
+{
+	if (node["window"])
+		params.window = node["window"].as<size_t>();
+	if (node["half_life"])
+		params.half_life = node["half_life"].as<double>();
+	if (node["sketch_size"])
+		params.sketch_size = node["sketch_size"].as<size_t>();
+
+	if (params.window == 0 || params.half_life <= 0 || params.sketch_size < 2)
+		throw_with_trace(std::runtime_error("The estimators need a positive window and half life, and a sketch size of at least 2"));
+
+	return params;
+}
+
+
 static
 YAML::Node merge(YAML::Node user, YAML::Node def)
 {
@@ -322,7 +451,7 @@ YAML::Node merge(YAML::Node user, YAML::Node def)
 }
 
 
-void config_read(const string &path, const string &overlay, vector<Task> &tasklist, vector<Cos> &coslist, std::shared_ptr<cat::policy::Base> &catpol)
+void config_read(const string &path, const string &overlay, vector<Task> &tasklist, vector<Cos> &coslist, std::shared_ptr<cat::policy::Base> &catpol, StatsConfig &stats, std::shared_ptr<InterferenceGraph> &interference)
 {
 	// The message outputed by YAML is not clear enough, so we test first
 	std::ifstream f(path);
@@ -343,12 +472,65 @@ void config_read(const string &path, const string &overlay, vector<Task> &taskli
 
 	// Read CAT policy
 	if (config["cat_policy"])
+	{
 		catpol = config_read_cat_policy(config);
+		if (config["cat_policy"]["phase"])
+			catpol->set_phases(config_read_phase(config));
+	}
 
 	// Read tasks into objects
 	if (config["tasks"])
 		tasklist = config_read_tasks(config);
 
+	// Read derived metrics
+	if (config["derived_metrics"])
+		stats.metrics = config_read_derived_metrics(config);
+
+	// Read how many intervals are kept in the history of each task
+	if (config["history"])
+	{
+		const auto &node = config["history"];
+		config_check_fields(node, {}, {"length", "archive"});
+		if (node["length"])
+			stats.history = node["length"].as<size_t>();
+		if (node["archive"])
+			stats.history_archive = node["archive"].as<size_t>();
+		if (stats.history == 0)
+			throw_with_trace(std::runtime_error("The history must keep at least one interval"));
+	}
+
+	// Read the parameters of the estimators, for all the events and for some of them
+	if (config["estimators"])
+	{
+		const auto &node = config["estimators"];
+		config_check_fields(node, {}, {"window", "half_life", "sketch_size", "events", "normalize"});
+		stats.estimators = config_read_estimator_params(node, stats.estimators);
+		if (node["normalize"])
+			stats.normalize = node["normalize"].as<string>();
+		if (node["events"])
+		{
+			for (const auto &e : node["events"])
+			{
+				config_check_fields(e.second, {}, {"window", "half_life", "sketch_size"});
+				stats.events[e.first.as<string>()] = config_read_estimator_params(e.second, stats.estimators);
+			}
+		}
+	}
+
+	// Read the parameters of the slowdown model, which the policies use instead of the stalls only when enabled
+	if (config["slowdown"])
+	{
+		const auto &node = config["slowdown"];
+		config_check_fields(node, {"enabled"}, {"stalls"});
+		stats.slowdown = node["enabled"].as<bool>();
+		if (node["stalls"])
+			stats.slowdown_stalls = node["stalls"].as<string>();
+	}
+
+	// Read the metrics the interference between the tasks is estimated from
+	if (config["interference"])
+		interference = config_read_interference(config);
+
 	// Check that all COS (but 0) have cpus or tasks assigned
 	for (size_t i = 1; i < coslist.size(); i++)
 	{
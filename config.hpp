@@ -5,6 +5,8 @@
 #include <vector>
 
 #include "cat-policy.hpp"
+#include "interference.hpp"
+#include "stats.hpp"
 #include "task.hpp"
 
 
@@ -17,4 +19,4 @@ struct Cos
 };
 
 
-void config_read(const std::string &path, const std::string &overlay, std::vector<Task> &tasklist, std::vector<Cos> &coslist, std::shared_ptr<cat::policy::Base> &catpol);
+void config_read(const std::string &path, const std::string &overlay, std::vector<Task> &tasklist, std::vector<Cos> &coslist, std::shared_ptr<cat::policy::Base> &catpol, StatsConfig &stats, std::shared_ptr<InterferenceGraph> &interference);
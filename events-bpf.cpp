@@ -0,0 +1,696 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <linux/bpf.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysinfo.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "events-bpf.hpp"
+#include "events-db.hpp"
+#include "events-direct.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace fs = boost::filesystem;
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+static int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int group_fd, unsigned long flags)
+{
+	return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+
+static int bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+
+static int bpf_map_create(uint32_t type, uint32_t key_size, uint32_t value_size, uint32_t max_entries, uint32_t flags = 0)
+{
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = type;
+	attr.key_size = key_size;
+	attr.value_size = value_size;
+	attr.max_entries = max_entries;
+	attr.map_flags = flags;
+	return bpf(BPF_MAP_CREATE, &attr);
+}
+
+
+static int bpf_map_op(int cmd, int fd, const void *key, const void *value, uint64_t flags = 0)
+{
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = fd;
+	attr.key = (uint64_t) key;
+	attr.value = (uint64_t) value;
+	attr.flags = flags;
+	return bpf(cmd, &attr);
+}
+
+
+// Minimal assembler for the programs of this engine, with forward jumps patched when their target is known
+class BPFAsm
+{
+	vector<struct bpf_insn> insns;
+
+	void emit(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm)
+	{
+		struct bpf_insn insn;
+		memset(&insn, 0, sizeof(insn));
+		insn.code = code;
+		insn.dst_reg = dst;
+		insn.src_reg = src;
+		insn.off = off;
+		insn.imm = imm;
+		insns.push_back(insn);
+	}
+
+	public:
+
+	void mov(uint8_t dst, uint8_t src)           { emit(BPF_ALU64 | BPF_MOV | BPF_X, dst, src, 0, 0); }
+	void mov_imm(uint8_t dst, int32_t imm)       { emit(BPF_ALU64 | BPF_MOV | BPF_K, dst, 0, 0, imm); }
+	void mov32_imm(uint8_t dst, int32_t imm)     { emit(BPF_ALU | BPF_MOV | BPF_K, dst, 0, 0, imm); }
+	void add_imm(uint8_t dst, int32_t imm)       { emit(BPF_ALU64 | BPF_ADD | BPF_K, dst, 0, 0, imm); }
+	void sub(uint8_t dst, uint8_t src)           { emit(BPF_ALU64 | BPF_SUB | BPF_X, dst, src, 0, 0); }
+	void rsh_imm(uint8_t dst, int32_t imm)       { emit(BPF_ALU64 | BPF_RSH | BPF_K, dst, 0, 0, imm); }
+	void ldx(uint8_t size, uint8_t dst, uint8_t src, int16_t off) { emit(BPF_LDX | BPF_MEM | size, dst, src, off, 0); }
+	void stx(uint8_t size, uint8_t dst, int16_t off, uint8_t src) { emit(BPF_STX | BPF_MEM | size, dst, src, off, 0); }
+	void st_imm(uint8_t size, uint8_t dst, int16_t off, int32_t imm) { emit(BPF_ST | BPF_MEM | size, dst, 0, off, imm); }
+	void atomic_add(uint8_t dst, int16_t off, uint8_t src) { emit(BPF_STX | BPF_ATOMIC | BPF_DW, dst, src, off, BPF_ADD); }
+	void call(int32_t func)                      { emit(BPF_JMP | BPF_CALL, 0, 0, 0, func); }
+	void exit()                                  { emit(BPF_JMP | BPF_EXIT, 0, 0, 0, 0); }
+
+	void ld_map(uint8_t dst, int fd)
+	{
+		emit(BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, fd);
+		emit(0, 0, 0, 0, 0);
+	}
+
+	// Conditional jump to a label, returns the instruction to patch
+	size_t jmp_imm(uint8_t op, uint8_t dst, int32_t imm)
+	{
+		emit(BPF_JMP | op | BPF_K, dst, 0, 0, imm);
+		return insns.size() - 1;
+	}
+
+	// Makes a jump land in the next instruction emitted
+	void label(size_t jump)             { insns[jump].off = insns.size() - jump - 1; }
+	void label(const vector<size_t> &jumps) { for (auto j : jumps) label(j); }
+
+	const vector<struct bpf_insn>& code() const { return insns; }
+};
+
+
+static int bpf_prog_load(const BPFAsm &prog, const string &name)
+{
+	static char license[] = "GPL";
+	const auto &insns = prog.code();
+
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_TRACEPOINT;
+	attr.insns = (uint64_t) insns.data();
+	attr.insn_cnt = insns.size();
+	attr.license = (uint64_t) license;
+	int fd = bpf(BPF_PROG_LOAD, &attr);
+	if (fd >= 0)
+		return fd;
+
+	// Load it again to get the log of the verifier
+	const int error = errno;
+	auto log = vector<char>(1 << 20, 0);
+	attr.log_buf = (uint64_t) log.data();
+	attr.log_size = log.size();
+	attr.log_level = 1;
+	bpf(BPF_PROG_LOAD, &attr);
+	throw_with_trace(std::runtime_error("Cannot load the BPF program for {}: {}\n{}"_format(name, strerror(error), log.data())));
+}
+
+
+BPFCounters::Tracepoint BPFCounters::read_tracepoint(const std::string &name) const
+{
+	Tracepoint tp;
+	std::stringstream ss;
+	ss << open_ifstream(fs::path(tracing) / name / "format").rdbuf();
+	string line;
+	while (std::getline(ss, line))
+	{
+		// ID: 372
+		// 	field:pid_t prev_pid;	offset:24;	size:4;	signed:1;
+		if (line.compare(0, 3, "ID:") == 0)
+		{
+			tp.id = std::stoul(line.substr(3));
+			continue;
+		}
+		if (line.compare(0, 10, "print fmt:") == 0)
+		{
+			tp.print_fmt = line.substr(10);
+			continue;
+		}
+		const size_t field = line.find("field:");
+		const size_t offset = line.find("offset:");
+		const size_t size = line.find("size:");
+		if (field == string::npos || offset == string::npos || size == string::npos)
+			continue;
+		string decl = line.substr(field, line.find(';', field) - field);
+		decl = decl.substr(decl.find_last_of(" \t") + 1);
+		decl = decl.substr(0, decl.find('['));
+		tp.fields[decl] = {std::stoul(line.substr(offset + 7)), std::stoul(line.substr(size + 5))};
+	}
+	if (tp.id == 0)
+		throw_with_trace(std::runtime_error("Cannot read the format of the tracepoint {}"_format(name)));
+	return tp;
+}
+
+
+// Evaluates the constant expressions of the print formats of the tracepoints, with the operators the kernel uses there
+class ConstExpr
+{
+	const string &s;
+	size_t pos;
+
+	void skip() { while (pos < s.size() && s[pos] == ' ') pos++; }
+	bool accept(const string &op)
+	{
+		skip();
+		// '|' is not '||' and '<<' is not '<'
+		if (s.compare(pos, op.size(), op) != 0 || (op == "|" && s.compare(pos, 2, "||") == 0))
+			return false;
+		pos += op.size();
+		return true;
+	}
+
+	uint64_t primary()
+	{
+		if (accept("("))
+		{
+			const uint64_t v = bitor_();
+			if (!accept(")"))
+				throw_with_trace(std::runtime_error("Missing ')' at {} in '{}'"_format(pos, s)));
+			return v;
+		}
+		skip();
+		size_t len = 0;
+		const uint64_t v = std::stoull(s.substr(pos), &len, 0);
+		pos += len;
+		return v;
+	}
+
+	uint64_t additive()
+	{
+		uint64_t v = primary();
+		while (true)
+		{
+			if (accept("+"))
+				v += primary();
+			else if (accept("-"))
+				v -= primary();
+			else
+				return v;
+		}
+	}
+
+	uint64_t shift()
+	{
+		uint64_t v = additive();
+		while (accept("<<"))
+			v <<= additive();
+		return v;
+	}
+
+	uint64_t bitor_()
+	{
+		uint64_t v = shift();
+		while (accept("|"))
+			v |= shift();
+		return v;
+	}
+
+	public:
+
+	ConstExpr(const string &s, size_t pos) : s(s), pos(pos) {}
+	uint64_t eval() { return bitor_(); }
+};
+
+
+// TASK_REPORT_MAX since Linux 4.14, 0x80 or 0x100 depending on the version. It is the flag the print format of the
+// tracepoint shows as a '+': ... REC->prev_state & <flag> ? "+" : "" ...
+uint64_t sched_switch_preempted_flag(const std::string &print_fmt)
+{
+	const size_t plus = print_fmt.find("? \"+\"");
+	const string field = "REC->prev_state &";
+	const size_t begin = plus == string::npos ? string::npos : print_fmt.rfind(field, plus);
+	if (begin == string::npos)
+		return 0;
+	try
+	{
+		return ConstExpr(print_fmt, begin + field.size()).eval();
+	}
+	catch (const std::exception &e)
+	{
+		return 0;
+	}
+}
+
+
+void BPFCounters::init()
+{
+	for (const auto &dir : {"/sys/kernel/tracing/events", "/sys/kernel/debug/tracing/events"})
+		if (fs::exists(fs::path(dir) / "sched" / "sched_switch"))
+			tracing = dir;
+	if (tracing.empty())
+		throw_with_trace(std::runtime_error("Cannot find the scheduler tracepoints, is tracefs mounted?"));
+
+	free_slots.clear();
+	for (uint32_t i = max_tasks; i > 0; i--)
+		free_slots.push_back(i - 1);
+}
+
+
+// Opens the per CPU events, creates the maps and attaches the programs
+void BPFCounters::load(const std::vector<std::string> &groups)
+{
+	const auto sw = read_tracepoint("sched/sched_switch");
+	const auto wk = read_tracepoint("sched/sched_wakeup");
+	for (const auto &field : {"prev_pid", "prev_state", "next_pid"})
+		if (sw.fields.count(field) == 0)
+			throw_with_trace(std::runtime_error("The tracepoint sched_switch has no field {}"_format(field)));
+	if (wk.fields.count("pid") == 0)
+		throw_with_trace(std::runtime_error("The tracepoint sched_wakeup has no field pid"));
+
+	// A preempted task is reported as runnable, 0, before Linux 4.14 and with a flag of its own since then
+	uint64_t preempted_flag = sched_switch_preempted_flag(sw.print_fmt);
+	if (preempted_flag == 0 || preempted_flag > INT32_MAX)
+	{
+		LOGWAR("Cannot find how sched_switch reports the preempted tasks, the run queue waits after a preemption may not be counted");
+		preempted_flag = 0;
+	}
+	else
+		LOGDEB("The preempted tasks have the state flag {:#x}"_format(preempted_flag));
+
+	// The events, without groups
+	auto descs = vector<PerfEventDesc>();
+	for (const auto &group : groups)
+	{
+		auto group_names = vector<string>();
+		for (auto event : event_list_split(group))
+		{
+			event.erase(std::remove(event.begin(), event.end(), '{'), event.end());
+			event.erase(std::remove(event.begin(), event.end(), '}'), event.end());
+			descs.push_back(perf_event_parse(event));
+			group_names.push_back(descs.back().name);
+		}
+		names.push_back(group_names);
+	}
+	names.push_back({"sched_switches", "rq_wait", "rq_waits"});
+	num_events = descs.size();
+
+	const int num_cpus = get_nprocs_conf();
+	for (const auto &desc : descs)
+	{
+		const int map = bpf_map_create(BPF_MAP_TYPE_PERF_EVENT_ARRAY, sizeof(uint32_t), sizeof(uint32_t), num_cpus);
+		if (map < 0)
+			throw_with_trace(std::runtime_error("Cannot create the perf event array for '{}': {}"_format(desc.name, strerror(errno))));
+		event_maps.push_back(map);
+
+		for (int cpu = 0; cpu < num_cpus; cpu++)
+		{
+			struct perf_event_attr attr = desc.attr;
+			const int fd = perf_event_open(&attr, -1, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+			if (fd < 0 && errno == ENODEV)
+				continue;  // Offline CPU
+			if (fd < 0)
+				throw_with_trace(std::runtime_error("Cannot open the event '{}' in CPU {}: {}"_format(desc.name, cpu, strerror(errno))));
+			event_fds.push_back(fd);
+			const uint32_t key = cpu;
+			if (bpf_map_op(BPF_MAP_UPDATE_ELEM, map, &key, &fd) < 0)
+				throw_with_trace(std::runtime_error("Cannot add the event '{}' of CPU {} to its map: {}"_format(desc.name, cpu, strerror(errno))));
+		}
+	}
+
+	const uint32_t value_size = slot_words() * sizeof(uint64_t);
+	pids_map = bpf_map_create(BPF_MAP_TYPE_HASH, sizeof(uint32_t), sizeof(uint32_t), max_tasks);
+	last_map = bpf_map_create(BPF_MAP_TYPE_PERCPU_ARRAY, sizeof(uint32_t), (3 * num_events + 1) * sizeof(uint64_t), 1);
+	wait_map = bpf_map_create(BPF_MAP_TYPE_HASH, sizeof(uint32_t), sizeof(uint64_t), max_tasks);
+	values_map = bpf_map_create(BPF_MAP_TYPE_ARRAY, sizeof(uint32_t), value_size, max_tasks, BPF_F_MMAPABLE);
+	if (values_map < 0 && errno == EINVAL)
+	{
+		LOGWAR("The kernel cannot map BPF arrays in memory, the counters will be read with a system call per task");
+		values_map = bpf_map_create(BPF_MAP_TYPE_ARRAY, sizeof(uint32_t), value_size, max_tasks);
+	}
+	if (pids_map < 0 || last_map < 0 || wait_map < 0 || values_map < 0)
+		throw_with_trace(std::runtime_error("Cannot create the BPF maps: {}"_format(strerror(errno))));
+
+	values_len = value_size * max_tasks;
+	values_len = (values_len + getpagesize() - 1) / getpagesize() * getpagesize();
+	void *addr = mmap(NULL, values_len, PROT_READ | PROT_WRITE, MAP_SHARED, values_map, 0);
+	values = addr == MAP_FAILED ? nullptr : (uint64_t *) addr;
+
+	// Registers: r6 context, r7 last reading of the CPU, r8 values of the task switched out (or 0), r9 scratch.
+	// Stack: -8 and -16 keys, -40 the value read by bpf_perf_event_read_value, -48 a timestamp.
+	const int16_t last_primed = 8 * 3 * num_events;
+	const int16_t switches = 8 * 3 * num_events;
+	const int16_t rq_wait = switches + 8;
+	const int16_t rq_waits = switches + 16;
+	const uint8_t state_size = sw.fields.at("prev_state").second == 8 ? BPF_DW : BPF_W;
+
+	BPFAsm p;
+	auto exits = vector<size_t>();
+	p.mov(BPF_REG_6, BPF_REG_1);
+
+	p.st_imm(BPF_W, BPF_REG_10, -8, 0);
+	p.ld_map(BPF_REG_1, last_map);
+	p.mov(BPF_REG_2, BPF_REG_10);
+	p.add_imm(BPF_REG_2, -8);
+	p.call(BPF_FUNC_map_lookup_elem);
+	exits.push_back(p.jmp_imm(BPF_JEQ, BPF_REG_0, 0));
+	p.mov(BPF_REG_7, BPF_REG_0);
+
+	// The task being switched out is still the current one, account to its whole thread group
+	p.call(BPF_FUNC_get_current_pid_tgid);
+	p.rsh_imm(BPF_REG_0, 32);
+	p.stx(BPF_W, BPF_REG_10, -8, BPF_REG_0);
+	p.mov_imm(BPF_REG_8, 0);
+	p.ld_map(BPF_REG_1, pids_map);
+	p.mov(BPF_REG_2, BPF_REG_10);
+	p.add_imm(BPF_REG_2, -8);
+	p.call(BPF_FUNC_map_lookup_elem);
+	const size_t untracked = p.jmp_imm(BPF_JEQ, BPF_REG_0, 0);
+	p.ldx(BPF_W, BPF_REG_1, BPF_REG_0, 0);
+	p.stx(BPF_W, BPF_REG_10, -16, BPF_REG_1);
+	p.ld_map(BPF_REG_1, values_map);
+	p.mov(BPF_REG_2, BPF_REG_10);
+	p.add_imm(BPF_REG_2, -16);
+	p.call(BPF_FUNC_map_lookup_elem);
+	p.mov(BPF_REG_8, BPF_REG_0);
+	p.label(untracked);
+
+	// Nothing to account until the CPU has a previous reading
+	p.ldx(BPF_DW, BPF_REG_1, BPF_REG_7, last_primed);
+	const size_t primed = p.jmp_imm(BPF_JNE, BPF_REG_1, 0);
+	p.mov_imm(BPF_REG_8, 0);
+	p.mov_imm(BPF_REG_1, 1);
+	p.stx(BPF_DW, BPF_REG_7, last_primed, BPF_REG_1);
+	p.label(primed);
+
+	// Value, time enabled and time running of each event
+	for (size_t k = 0; k < num_events; k++)
+	{
+		p.ld_map(BPF_REG_1, event_maps[k]);
+		p.mov32_imm(BPF_REG_2, -1);  // BPF_F_CURRENT_CPU
+		p.mov(BPF_REG_3, BPF_REG_10);
+		p.add_imm(BPF_REG_3, -40);
+		p.mov_imm(BPF_REG_4, 24);
+		p.call(BPF_FUNC_perf_event_read_value);
+		const size_t failed = p.jmp_imm(BPF_JNE, BPF_REG_0, 0);
+		for (int j = 0; j < 3; j++)
+		{
+			const int16_t off = 8 * (3 * k + j);
+			p.ldx(BPF_DW, BPF_REG_1, BPF_REG_10, -40 + 8 * j);
+			p.ldx(BPF_DW, BPF_REG_2, BPF_REG_7, off);
+			p.stx(BPF_DW, BPF_REG_7, off, BPF_REG_1);
+			const size_t skip = p.jmp_imm(BPF_JEQ, BPF_REG_8, 0);
+			p.sub(BPF_REG_1, BPF_REG_2);
+			p.atomic_add(BPF_REG_8, off, BPF_REG_1);
+			p.label(skip);
+		}
+		p.label(failed);
+	}
+
+	const size_t not_switched = p.jmp_imm(BPF_JEQ, BPF_REG_8, 0);
+	p.mov_imm(BPF_REG_1, 1);
+	p.atomic_add(BPF_REG_8, switches, BPF_REG_1);
+	p.label(not_switched);
+
+	// A tracked thread preempted while runnable starts waiting in the run queue
+	p.ldx(BPF_W, BPF_REG_1, BPF_REG_6, sw.fields.at("prev_pid").first);
+	p.stx(BPF_W, BPF_REG_10, -8, BPF_REG_1);
+	p.ld_map(BPF_REG_1, pids_map);
+	p.mov(BPF_REG_2, BPF_REG_10);
+	p.add_imm(BPF_REG_2, -8);
+	p.call(BPF_FUNC_map_lookup_elem);
+	auto check_next = vector<size_t>{p.jmp_imm(BPF_JEQ, BPF_REG_0, 0)};
+	p.ldx(state_size, BPF_REG_1, BPF_REG_6, sw.fields.at("prev_state").first);
+	const size_t preempted = p.jmp_imm(BPF_JSET, BPF_REG_1, preempted_flag);
+	check_next.push_back(p.jmp_imm(BPF_JNE, BPF_REG_1, 0));
+	p.label(preempted);
+	p.call(BPF_FUNC_ktime_get_ns);
+	p.stx(BPF_DW, BPF_REG_10, -48, BPF_REG_0);
+	p.ld_map(BPF_REG_1, wait_map);
+	p.mov(BPF_REG_2, BPF_REG_10);
+	p.add_imm(BPF_REG_2, -8);
+	p.mov(BPF_REG_3, BPF_REG_10);
+	p.add_imm(BPF_REG_3, -48);
+	p.mov_imm(BPF_REG_4, BPF_ANY);
+	p.call(BPF_FUNC_map_update_elem);
+	p.label(check_next);
+
+	// The thread switched in stops waiting
+	p.ldx(BPF_W, BPF_REG_1, BPF_REG_6, sw.fields.at("next_pid").first);
+	p.stx(BPF_W, BPF_REG_10, -8, BPF_REG_1);
+	p.ld_map(BPF_REG_1, wait_map);
+	p.mov(BPF_REG_2, BPF_REG_10);
+	p.add_imm(BPF_REG_2, -8);
+	p.call(BPF_FUNC_map_lookup_elem);
+	exits.push_back(p.jmp_imm(BPF_JEQ, BPF_REG_0, 0));
+	p.ldx(BPF_DW, BPF_REG_9, BPF_REG_0, 0);
+	p.call(BPF_FUNC_ktime_get_ns);
+	p.sub(BPF_REG_0, BPF_REG_9);
+	p.mov(BPF_REG_9, BPF_REG_0);
+	p.ld_map(BPF_REG_1, wait_map);
+	p.mov(BPF_REG_2, BPF_REG_10);
+	p.add_imm(BPF_REG_2, -8);
+	p.call(BPF_FUNC_map_delete_elem);
+	p.ld_map(BPF_REG_1, pids_map);
+	p.mov(BPF_REG_2, BPF_REG_10);
+	p.add_imm(BPF_REG_2, -8);
+	p.call(BPF_FUNC_map_lookup_elem);
+	exits.push_back(p.jmp_imm(BPF_JEQ, BPF_REG_0, 0));
+	p.ldx(BPF_W, BPF_REG_1, BPF_REG_0, 0);
+	p.stx(BPF_W, BPF_REG_10, -16, BPF_REG_1);
+	p.ld_map(BPF_REG_1, values_map);
+	p.mov(BPF_REG_2, BPF_REG_10);
+	p.add_imm(BPF_REG_2, -16);
+	p.call(BPF_FUNC_map_lookup_elem);
+	exits.push_back(p.jmp_imm(BPF_JEQ, BPF_REG_0, 0));
+	p.atomic_add(BPF_REG_0, rq_wait, BPF_REG_9);
+	p.mov_imm(BPF_REG_1, 1);
+	p.atomic_add(BPF_REG_0, rq_waits, BPF_REG_1);
+
+	p.label(exits);
+	p.mov_imm(BPF_REG_0, 0);
+	p.exit();
+
+	// A tracked thread woken up starts waiting in the run queue
+	BPFAsm w;
+	auto w_exits = vector<size_t>();
+	w.mov(BPF_REG_6, BPF_REG_1);
+	w.ldx(BPF_W, BPF_REG_1, BPF_REG_6, wk.fields.at("pid").first);
+	w.stx(BPF_W, BPF_REG_10, -8, BPF_REG_1);
+	w.ld_map(BPF_REG_1, pids_map);
+	w.mov(BPF_REG_2, BPF_REG_10);
+	w.add_imm(BPF_REG_2, -8);
+	w.call(BPF_FUNC_map_lookup_elem);
+	w_exits.push_back(w.jmp_imm(BPF_JEQ, BPF_REG_0, 0));
+	w.call(BPF_FUNC_ktime_get_ns);
+	w.stx(BPF_DW, BPF_REG_10, -16, BPF_REG_0);
+	w.ld_map(BPF_REG_1, wait_map);
+	w.mov(BPF_REG_2, BPF_REG_10);
+	w.add_imm(BPF_REG_2, -8);
+	w.mov(BPF_REG_3, BPF_REG_10);
+	w.add_imm(BPF_REG_3, -16);
+	w.mov_imm(BPF_REG_4, BPF_ANY);
+	w.call(BPF_FUNC_map_update_elem);
+	w.label(w_exits);
+	w.mov_imm(BPF_REG_0, 0);
+	w.exit();
+
+	// Attach them to the tracepoints in every CPU
+	const vector<std::pair<uint32_t, int>> attach = {{sw.id, bpf_prog_load(p, "sched_switch")}, {wk.id, bpf_prog_load(w, "sched_wakeup")}};
+	for (const auto &a : attach)
+	{
+		progs.push_back(a.second);
+		for (int cpu = 0; cpu < num_cpus; cpu++)
+		{
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_TRACEPOINT;
+			attr.config = a.first;
+			attr.sample_period = 1;
+			const int fd = perf_event_open(&attr, -1, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+			if (fd < 0 && errno == ENODEV)
+				continue;
+			if (fd < 0)
+				throw_with_trace(std::runtime_error("Cannot open the tracepoint {} in CPU {}: {}"_format(a.first, cpu, strerror(errno))));
+			tracepoint_fds.push_back(fd);
+			if (ioctl(fd, PERF_EVENT_IOC_SET_BPF, a.second) < 0 || ioctl(fd, PERF_EVENT_IOC_ENABLE, 0) < 0)
+				throw_with_trace(std::runtime_error("Cannot attach the BPF program to the tracepoint {}: {}"_format(a.first, strerror(errno))));
+		}
+	}
+
+	LOGINF("BPF counters attached in {} CPUs, {} the values array"_format(num_cpus, values ? "mapping" : "not mapping"));
+}
+
+
+void BPFCounters::clean()
+{
+	for (auto fd : tracepoint_fds)
+		close(fd);
+	for (auto fd : progs)
+		close(fd);
+	for (auto fd : event_fds)
+		close(fd);
+	for (auto fd : event_maps)
+		close(fd);
+	if (values)
+		munmap(values, values_len);
+	for (auto fd : {pids_map, values_map, last_map, wait_map})
+		if (fd >= 0)
+			close(fd);
+
+	tracepoint_fds.clear();
+	progs.clear();
+	event_fds.clear();
+	event_maps.clear();
+	values = nullptr;
+	pids_map = values_map = last_map = wait_map = -1;
+	setup_groups.clear();
+	names.clear();
+	num_events = 0;
+	for (const auto &kv : slots)
+		free_slots.push_back(kv.second);
+	slots.clear();
+}
+
+
+void BPFCounters::clean(pid_t pid)
+{
+	const auto it = slots.find(pid);
+	if (it == slots.end())
+		return;
+	const uint32_t key = pid;
+	bpf_map_op(BPF_MAP_DELETE_ELEM, pids_map, &key, NULL);
+	bpf_map_op(BPF_MAP_DELETE_ELEM, wait_map, &key, NULL);
+	free_slots.push_back(it->second);
+	slots.erase(it);
+}
+
+
+std::vector<uint64_t> BPFCounters::read_slot(uint32_t slot)
+{
+	auto v = vector<uint64_t>(slot_words());
+	if (values)
+	{
+		const uint64_t *base = values + slot * slot_words();
+		for (size_t i = 0; i < v.size(); i++)
+			v[i] = __atomic_load_n(&base[i], __ATOMIC_RELAXED);
+	}
+	else if (bpf_map_op(BPF_MAP_LOOKUP_ELEM, values_map, &slot, v.data()) < 0)
+		throw_with_trace(std::runtime_error("Cannot read the slot {} of the BPF counters: {}"_format(slot, strerror(errno))));
+	return v;
+}
+
+
+void BPFCounters::write_slot(uint32_t slot, const std::vector<uint64_t> &v)
+{
+	if (values)
+		std::copy(v.begin(), v.end(), values + slot * slot_words());
+	else if (bpf_map_op(BPF_MAP_UPDATE_ELEM, values_map, &slot, v.data()) < 0)
+		throw_with_trace(std::runtime_error("Cannot write the slot {} of the BPF counters: {}"_format(slot, strerror(errno))));
+}
+
+
+void BPFCounters::setup_events(pid_t pid, const std::vector<std::string> &groups)
+{
+	if (tracing.empty())
+		throw_with_trace(std::runtime_error("The BPF counters have not been initialized"));
+
+	if (setup_groups.empty())
+	{
+		load(groups);
+		setup_groups = groups;
+	}
+	else if (setup_groups != groups)
+	{
+		throw_with_trace(std::runtime_error("All the tasks have to count the same events with BPF"));
+	}
+
+	if (free_slots.empty())
+		throw_with_trace(std::runtime_error("Cannot count the events of more than {} tasks with BPF"_format(max_tasks)));
+	const uint32_t slot = free_slots.back();
+	free_slots.pop_back();
+	slots[pid] = slot;
+
+	// Start from zero, then let the programs account to the task
+	write_slot(slot, vector<uint64_t>(slot_words(), 0));
+	const uint32_t key = pid;
+	if (bpf_map_op(BPF_MAP_UPDATE_ELEM, pids_map, &key, &slot) < 0)
+		throw_with_trace(std::runtime_error("Cannot track the task {} with BPF: {}"_format(pid, strerror(errno))));
+}
+
+
+std::vector<counters_t> BPFCounters::read_counters(pid_t pid)
+{
+	const auto v = read_slot(slots.at(pid));
+	auto result = vector<counters_t>();
+
+	size_t k = 0;
+	for (size_t g = 0; g + 1 < names.size(); g++)
+	{
+		auto counters = counters_t();
+		for (size_t i = 0; i < names[g].size(); i++, k++)
+		{
+			const uint64_t ena = v[3 * k + 1];
+			const uint64_t run = v[3 * k + 2];
+			counters.insert({(int) i, names[g][i], (double) v[3 * k], "", false, ena == run ? 1 : (double) run / ena, ena, run});
+		}
+		result.push_back(counters);
+	}
+
+	auto sched = counters_t();
+	const size_t base = 3 * num_events;
+	sched.insert({0, "sched_switches", (double) v[base], "", false, 1});
+	sched.insert({1, "rq_wait", (double) v[base + 1], "ns", false, 1});
+	sched.insert({2, "rq_waits", (double) v[base + 2], "", false, 1});
+	result.push_back(sched);
+	return result;
+}
+
+
+std::vector<std::vector<std::string>> BPFCounters::get_names(pid_t pid)
+{
+	if (slots.count(pid) == 0)
+		throw_with_trace(std::out_of_range("The task {} is not tracked with BPF"_format(pid)));
+	return names;
+}
+
+
+void BPFCounters::print_counters(pid_t pid)
+{
+	for (const auto &counters : read_counters(pid))
+	{
+		for (const auto &c : counters.get<by_id>())
+			std::cout << "{} {} {}"_format(c.value, c.unit, c.name) << std::endl;
+		std::cout << std::endl;
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "events.hpp"
+
+
+// Counter engine that attributes system wide per CPU counters to the tasks in the kernel. A BPF program attached to
+// the sched_switch tracepoint reads the counters of the CPU with bpf_perf_event_read_value and adds the difference
+// since the last switch to the task being switched out. It also counts the context switches of the tasks and the time
+// they wait in the run queue, from the moment they are woken up or preempted until they run again. The totals live
+// in a BPF array the manager maps in memory, so reading them does not need any system call, whatever the number of
+// tasks. The counts include all the threads of a task, but the run queue waits only those of its main thread.
+//
+// The events are counted on their own, without groups, the kernel multiplexes them if they do not fit in the PMU.
+// All the tasks count the same events. Besides the events, each task reports:
+//   sched_switches  Times it has been switched out
+//   rq_wait         Time waiting in the run queue, in ns
+//   rq_waits        Number of waits in the run queue
+// Flag of the state of a task preempted while runnable in the sched_switch tracepoint, from its print format, 0 if unknown
+uint64_t sched_switch_preempted_flag(const std::string &print_fmt);
+
+
+class BPFCounters : public CounterBackend
+{
+	struct Tracepoint
+	{
+		uint32_t id = 0;
+		std::map<std::string, std::pair<uint32_t, uint32_t>> fields;  // Name -> offset and size
+		std::string print_fmt;
+	};
+
+	std::string tracing;                      // Where the tracepoints are, in tracefs
+	uint32_t max_tasks;
+
+	std::vector<std::string> setup_groups;    // The events all the tasks count, as given
+	std::vector<std::vector<std::string>> names;
+	size_t num_events = 0;
+
+	std::vector<int> event_fds;               // Per CPU perf events
+	std::vector<int> event_maps;              // A perf event array per event, indexed by CPU
+	int pids_map = -1;                        // Task -> slot in the values array
+	int values_map = -1;                      // Counters of the tasks
+	int last_map = -1;                        // Last reading of each CPU
+	int wait_map = -1;                        // Thread -> time it started waiting in the run queue
+	std::vector<int> progs;
+	std::vector<int> tracepoint_fds;
+
+	uint64_t *values = nullptr;               // The values array mapped in memory, if the kernel can
+	size_t values_len = 0;
+
+	std::map<pid_t, uint32_t> slots;
+	std::vector<uint32_t> free_slots;
+
+	size_t slot_words() const { return 3 * num_events + 3; }
+	Tracepoint read_tracepoint(const std::string &name) const;
+	void load(const std::vector<std::string> &groups);
+	std::vector<uint64_t> read_slot(uint32_t slot);
+	void write_slot(uint32_t slot, const std::vector<uint64_t> &v);
+
+	public:
+
+	BPFCounters(uint32_t max_tasks = 256) : max_tasks(max_tasks) {}
+
+	BPFCounters(const BPFCounters&) = delete;
+	BPFCounters& operator=(const BPFCounters&) = delete;
+	~BPFCounters() { clean(); }
+
+
+	void init() override;
+	void clean() override;
+	void clean(pid_t pid) override;
+	void setup_events(pid_t pid, const std::vector<std::string> &groups) override;
+	std::vector<counters_t> read_counters(pid_t pid) override;
+	std::vector<std::vector<std::string>> get_names(pid_t pid) override;
+	void enable_counters(pid_t pid) override {};
+	void disable_counters(pid_t pid) override {};
+	void print_counters(pid_t pid) override;
+};
@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#include <cpuid.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <fmt/format.h>
+
+#include "events-db.hpp"
+#include "throw-with-trace.hpp"
+
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+struct EventDef
+{
+	string name;                          // Portable name
+	std::map<Microarch, string> terms;    // Raw encoding of the event in each microarchitecture
+	vector<string> aliases;               // Vendor names of the event
+};
+
+
+// Encodings taken from the Intel SDM, volume 3B, chapter 19
+static const vector<EventDef> event_db =
+{
+	{
+		"l1_hits",
+		{
+			{Microarch::haswell,   "event=0xd1,umask=0x01"},
+			{Microarch::broadwell, "event=0xd1,umask=0x01"},
+			{Microarch::skylake,   "event=0xd1,umask=0x01"},
+			{Microarch::icelake,   "event=0xd1,umask=0x01"},
+		},
+		{"MEM_LOAD_UOPS_RETIRED.L1_HIT", "MEM_LOAD_RETIRED.L1_HIT"},
+	},
+	{
+		"l1_misses",
+		{
+			{Microarch::haswell,   "event=0xd1,umask=0x08"},
+			{Microarch::broadwell, "event=0xd1,umask=0x08"},
+			{Microarch::skylake,   "event=0xd1,umask=0x08"},
+			{Microarch::icelake,   "event=0xd1,umask=0x08"},
+		},
+		{"MEM_LOAD_UOPS_RETIRED.L1_MISS", "MEM_LOAD_RETIRED.L1_MISS"},
+	},
+	{
+		"l2_hits",
+		{
+			{Microarch::haswell,   "event=0xd1,umask=0x02"},
+			{Microarch::broadwell, "event=0xd1,umask=0x02"},
+			{Microarch::skylake,   "event=0xd1,umask=0x02"},
+			{Microarch::icelake,   "event=0xd1,umask=0x02"},
+		},
+		{"MEM_LOAD_UOPS_RETIRED.L2_HIT", "MEM_LOAD_RETIRED.L2_HIT"},
+	},
+	{
+		"l2_misses",
+		{
+			{Microarch::haswell,   "event=0xd1,umask=0x10"},
+			{Microarch::broadwell, "event=0xd1,umask=0x10"},
+			{Microarch::skylake,   "event=0xd1,umask=0x10"},
+			{Microarch::icelake,   "event=0xd1,umask=0x10"},
+		},
+		{"MEM_LOAD_UOPS_RETIRED.L2_MISS", "MEM_LOAD_RETIRED.L2_MISS"},
+	},
+	{
+		"llc_hits",
+		{
+			{Microarch::haswell,   "event=0xd1,umask=0x04"},
+			{Microarch::broadwell, "event=0xd1,umask=0x04"},
+			{Microarch::skylake,   "event=0xd1,umask=0x04"},
+			{Microarch::icelake,   "event=0xd1,umask=0x04"},
+		},
+		{"MEM_LOAD_UOPS_RETIRED.L3_HIT", "MEM_LOAD_RETIRED.L3_HIT"},
+	},
+	{
+		"llc_misses",
+		{
+			{Microarch::haswell,   "event=0xd1,umask=0x20"},
+			{Microarch::broadwell, "event=0xd1,umask=0x20"},
+			{Microarch::skylake,   "event=0xd1,umask=0x20"},
+			{Microarch::icelake,   "event=0xd1,umask=0x20"},
+		},
+		{"MEM_LOAD_UOPS_RETIRED.L3_MISS", "MEM_LOAD_RETIRED.L3_MISS"},
+	},
+	{
+		"stalls_total",
+		{
+			{Microarch::haswell,   "event=0xa3,umask=0x04,cmask=4"},
+			{Microarch::broadwell, "event=0xa3,umask=0x04,cmask=4"},
+			{Microarch::skylake,   "event=0xa3,umask=0x04,cmask=4"},
+			{Microarch::icelake,   "event=0xa3,umask=0x04,cmask=4"},
+		},
+		{"CYCLE_ACTIVITY.STALLS_TOTAL"},
+	},
+	{
+		"l2_miss_stalls",
+		{
+			{Microarch::haswell,   "event=0xa3,umask=0x05,cmask=5"},
+			{Microarch::broadwell, "event=0xa3,umask=0x05,cmask=5"},
+			{Microarch::skylake,   "event=0xa3,umask=0x05,cmask=5"},
+			{Microarch::icelake,   "event=0xa3,umask=0x05,cmask=5"},
+		},
+		{"CYCLE_ACTIVITY.STALLS_L2_PENDING", "CYCLE_ACTIVITY.STALLS_L2_MISS"},
+	},
+	{
+		"llc_miss_stalls",
+		{
+			{Microarch::skylake,   "event=0xa3,umask=0x06,cmask=6"},
+			{Microarch::icelake,   "event=0xa3,umask=0x06,cmask=6"},
+		},
+		{"CYCLE_ACTIVITY.STALLS_L3_MISS"},
+	},
+	{
+		// Cycles stalled with pending memory loads. Haswell and Broadwell only count loads, Skylake and later count any memory operation.
+		"mem_stalls",
+		{
+			{Microarch::haswell,   "event=0xa3,umask=0x06,cmask=6"},
+			{Microarch::broadwell, "event=0xa3,umask=0x06,cmask=6"},
+			{Microarch::skylake,   "event=0xa3,umask=0x14,cmask=20"},
+			{Microarch::icelake,   "event=0xa3,umask=0x14,cmask=20"},
+		},
+		{"CYCLE_ACTIVITY.STALLS_LDM_PENDING", "CYCLE_ACTIVITY.STALLS_MEM_ANY"},
+	},
+
+	// Top-down analysis (Yasin, 2014). The pipeline issues 4 uops per cycle up to Skylake and 5 from Ice Lake on,
+	// which also counts the issue slots itself. The slots are computed from the core cycles before, counted as
+	// topdown_cycles so that the 4-wide formulas cannot be used by mistake on a 5-wide core. The frontend latency
+	// counts the cycles with no uop delivered at all.
+	{
+		"topdown_slots",
+		{
+			{Microarch::icelake,   "event=0xa4,umask=0x01"},
+		},
+		{"TOPDOWN.SLOTS_P"},
+	},
+	{
+		"topdown_cycles",
+		{
+			{Microarch::haswell,   "event=0x3c,umask=0x00"},
+			{Microarch::broadwell, "event=0x3c,umask=0x00"},
+			{Microarch::skylake,   "event=0x3c,umask=0x00"},
+		},
+		{},
+	},
+	{
+		"uops_not_delivered",
+		{
+			{Microarch::haswell,   "event=0x9c,umask=0x01"},
+			{Microarch::broadwell, "event=0x9c,umask=0x01"},
+			{Microarch::skylake,   "event=0x9c,umask=0x01"},
+			{Microarch::icelake,   "event=0x9c,umask=0x01"},
+		},
+		{"IDQ_UOPS_NOT_DELIVERED.CORE"},
+	},
+	{
+		"fe_latency_cycles",
+		{
+			{Microarch::haswell,   "event=0x9c,umask=0x01,cmask=4"},
+			{Microarch::broadwell, "event=0x9c,umask=0x01,cmask=4"},
+			{Microarch::skylake,   "event=0x9c,umask=0x01,cmask=4"},
+			{Microarch::icelake,   "event=0x9c,umask=0x01,cmask=5"},
+		},
+		{"IDQ_UOPS_NOT_DELIVERED.CYCLES_0_UOPS_DELIV.CORE"},
+	},
+	{
+		"uops_issued",
+		{
+			{Microarch::haswell,   "event=0x0e,umask=0x01"},
+			{Microarch::broadwell, "event=0x0e,umask=0x01"},
+			{Microarch::skylake,   "event=0x0e,umask=0x01"},
+			{Microarch::icelake,   "event=0x0e,umask=0x01"},
+		},
+		{"UOPS_ISSUED.ANY"},
+	},
+	{
+		"uops_retired_slots",
+		{
+			{Microarch::haswell,   "event=0xc2,umask=0x02"},
+			{Microarch::broadwell, "event=0xc2,umask=0x02"},
+			{Microarch::skylake,   "event=0xc2,umask=0x02"},
+			{Microarch::icelake,   "event=0xc2,umask=0x02"},
+		},
+		{"UOPS_RETIRED.RETIRE_SLOTS", "UOPS_RETIRED.SLOTS"},
+	},
+	{
+		"recovery_cycles",
+		{
+			{Microarch::haswell,   "event=0x0d,umask=0x03,cmask=1"},
+			{Microarch::broadwell, "event=0x0d,umask=0x03,cmask=1"},
+			{Microarch::skylake,   "event=0x0d,umask=0x01"},
+			{Microarch::icelake,   "event=0x0d,umask=0x01"},
+		},
+		{"INT_MISC.RECOVERY_CYCLES"},
+	},
+};
+
+
+// Events of the top-down metrics, the first ones only where they are available: either the slots or the cycles
+static const vector<string> topdown_optional = {"topdown_slots", "topdown_cycles"};
+static const vector<string> topdown_events = {"uops_not_delivered", "fe_latency_cycles", "uops_issued",
+		"uops_retired_slots", "recovery_cycles", "stalls_total", "mem_stalls"};
+
+
+static const EventDef* event_db_find(const string &name)
+{
+	for (const auto &def : event_db)
+		if (def.name == name)
+			return &def;
+	return nullptr;
+}
+
+
+Microarch microarch_detect()
+{
+	unsigned int eax, ebx, ecx, edx;
+	char vendor[13] = {};
+
+	if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+		return Microarch::unknown;
+	memcpy(vendor + 0, &ebx, 4);
+	memcpy(vendor + 4, &edx, 4);
+	memcpy(vendor + 8, &ecx, 4);
+	if (string(vendor) != "GenuineIntel")
+		return Microarch::unknown;
+
+	__get_cpuid(1, &eax, &ebx, &ecx, &edx);
+	const uint32_t family = (eax >> 8) & 0xf;
+	const uint32_t model = ((eax >> 4) & 0xf) | (((eax >> 16) & 0xf) << 4);
+	if (family != 6)
+		return Microarch::unknown;
+
+	switch (model)
+	{
+		case 0x3c: case 0x3f: case 0x45: case 0x46:
+			return Microarch::haswell;
+		case 0x3d: case 0x47: case 0x4f: case 0x56:
+			return Microarch::broadwell;
+		case 0x4e: case 0x5e: case 0x55: case 0x8e: case 0x9e: case 0xa5: case 0xa6:
+			return Microarch::skylake;
+		case 0x6a: case 0x6c: case 0x7d: case 0x7e: case 0x8c: case 0x8d:
+			return Microarch::icelake;
+		default:
+			return Microarch::unknown;
+	}
+}
+
+
+std::string microarch_to_string(Microarch uarch)
+{
+	switch (uarch)
+	{
+		case Microarch::haswell:   return "haswell";
+		case Microarch::broadwell: return "broadwell";
+		case Microarch::skylake:   return "skylake";
+		case Microarch::icelake:   return "icelake";
+		default:                   return "unknown";
+	}
+}
+
+
+std::vector<std::string> event_list_split(const std::string &events)
+{
+	auto result = vector<string>();
+	string current;
+	bool in_terms = false;
+	int depth = 0;
+
+	for (char c : events)
+	{
+		if (c == '/')
+			in_terms = !in_terms;
+		else if (c == '{' && !in_terms)
+			depth++;
+		else if (c == '}' && !in_terms)
+			depth--;
+
+		if (c == ',' && !in_terms)
+		{
+			result.push_back(current);
+			current.clear();
+			continue;
+		}
+		current += c;
+	}
+	if (in_terms || depth != 0)
+		throw_with_trace(std::runtime_error("Unbalanced event list '{}'"_format(events)));
+	result.push_back(current);
+	return result;
+}
+
+
+std::string event_db_resolve(const std::string &events, Microarch uarch)
+{
+	string result;
+	for (const auto &token : event_list_split(events))
+	{
+		// Keep the group braces and the modifiers of the event, e.g. "{llc_hits:u"
+		const size_t begin = token.find_first_not_of('{');
+		const size_t end = std::min(token.find_first_of(":}", begin), token.size());
+		const string name = token.substr(begin, end - begin);
+		const string modifiers = end < token.size() && token[end] == ':' ?
+				token.substr(end + 1, token.find('}', end) - end - 1) : "";
+		const string closing = token.substr(std::min(token.find('}', begin), token.size()));
+
+		const EventDef *def = event_db_find(name);
+		string event = token;
+		if (def)
+		{
+			if (!def->terms.count(uarch))
+				throw_with_trace(std::runtime_error("The event '{}' is not available for the {} microarchitecture"_format(
+						name, microarch_to_string(uarch))));
+			event = "{}cpu/{},name={}/{}{}"_format(token.substr(0, begin), def->terms.at(uarch), name, modifiers, closing);
+		}
+		result += result.empty() ? event : "," + event;
+	}
+	return result;
+}
+
+
+std::vector<std::string> event_db_names()
+{
+	auto result = vector<string>();
+	for (const auto &def : event_db)
+		result.push_back(def.name);
+	return result;
+}
+
+
+std::string event_db_canonical(const std::string &name)
+{
+	const string lower = boost::to_lower_copy(name);
+	for (const auto &def : event_db)
+	{
+		if (def.name == lower)
+			return def.name;
+		for (const auto &alias : def.aliases)
+			if (boost::to_lower_copy(alias) == lower)
+				return def.name;
+	}
+	return name;
+}
+
+
+std::string event_db_name(const std::string &event)
+{
+	const size_t begin = std::min(event.find_first_not_of('{'), event.size());
+
+	// Raw events are known by their name term, if they have one
+	const size_t slash = event.find('/', begin);
+	if (slash != string::npos)
+	{
+		const size_t terms_end = std::min(event.find('/', slash + 1), event.size());
+		const string terms = event.substr(slash + 1, terms_end - slash - 1);
+		for (size_t pos = 0; pos <= terms.size();)
+		{
+			const size_t comma = std::min(terms.find(',', pos), terms.size());
+			if (terms.compare(pos, 5, "name=") == 0)
+				return event_db_canonical(terms.substr(pos + 5, comma - pos - 5));
+			pos = comma + 1;
+		}
+		return event.substr(begin, std::min(event.find('}', terms_end), event.size()) - begin);
+	}
+
+	const size_t end = std::min(event.find_first_of(":}", begin), event.size());
+	return event_db_canonical(event.substr(begin, end - begin));
+}
+
+
+std::vector<std::string> event_db_topdown(Microarch uarch)
+{
+	auto result = vector<string>();
+	if (uarch == Microarch::unknown)
+		return result;
+	for (const auto &name : topdown_optional)
+		if (event_db_find(name)->terms.count(uarch))
+			result.push_back(name);
+	result.insert(result.end(), topdown_events.begin(), topdown_events.end());
+	return result;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+// Microarchitectures with known raw event encodings
+enum class Microarch
+{
+	unknown,
+	haswell,
+	broadwell,
+	skylake,
+	icelake,
+};
+
+
+// Identifies the microarchitecture of the CPU we are running on using CPUID
+Microarch microarch_detect();
+std::string microarch_to_string(Microarch uarch);
+
+// Splits a comma separated list of perf events, taking into account that
+// the terms of an event (e.g. "cpu/event=0xd1,umask=0x04/") also contain commas
+std::vector<std::string> event_list_split(const std::string &events);
+
+// Replaces the portable event names (e.g. llc_misses) found in a comma separated list of events
+// with the raw encoding for the given microarchitecture. The rest of the events are left as they are.
+std::string event_db_resolve(const std::string &events, Microarch uarch);
+
+// Portable names of the events in the database
+std::vector<std::string> event_db_names();
+
+// Returns the portable name for an event if it is a known vendor name (e.g. MEM_LOAD_UOPS_RETIRED.L3_MISS
+// is llc_misses). Comparison is case insensitive. Unknown names are returned unchanged.
+std::string event_db_canonical(const std::string &name);
+
+// Portable name of an event of a list, without the group braces and the modifiers, e.g. llc_misses for
+// "{llc_misses:u", "MEM_LOAD_UOPS_RETIRED.L3_MISS" or "cpu/event=0xd1,umask=0x20,name=llc_misses/"
+std::string event_db_name(const std::string &event);
+
+// Events needed by the top-down (TMA) metrics in the given microarchitecture, none if it is unknown
+std::vector<std::string> event_db_topdown(Microarch uarch);
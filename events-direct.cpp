@@ -0,0 +1,451 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "events-db.hpp"
+#include "events-direct.hpp"
+#include "events-sched.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace fs = boost::filesystem;
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+static int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int group_fd, unsigned long flags)
+{
+	return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+
+static string read_line(const fs::path &path)
+{
+	auto ifs = open_ifstream(path);
+	string line;
+	std::getline(ifs, line);
+	boost::algorithm::trim(line);
+	return line;
+}
+
+
+static void apply_modifiers(struct perf_event_attr &attr, const string &modifiers, const string &event)
+{
+	// As in perf, the privilege levels given are counted and the rest excluded, e.g. 'uk' counts user and kernel
+	bool user = false, kernel = false, hv = false;
+	for (char m : modifiers)
+	{
+		if (m == 'u')
+			user = true;
+		else if (m == 'k')
+			kernel = true;
+		else if (m == 'h')
+			hv = true;
+		else if (m == 'p' && attr.precise_ip < 3)
+			attr.precise_ip++;
+		else if (m != ':')
+			throw_with_trace(std::runtime_error("Unsupported modifier '{}' in the event '{}'"_format(m, event)));
+	}
+	if (user || kernel || hv)
+	{
+		attr.exclude_user = !user;
+		attr.exclude_kernel = !kernel;
+		attr.exclude_hv = !hv;
+	}
+}
+
+
+// Generic events, the same in every CPU
+static bool parse_generic(const string &name, struct perf_event_attr &attr)
+{
+	static const std::map<string, std::pair<uint32_t, uint64_t>> generic =
+	{
+		{"cycles",                  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES}},
+		{"cpu-cycles",              {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES}},
+		{"instructions",            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS}},
+		{"ref-cycles",              {PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES}},
+		{"cache-references",        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES}},
+		{"cache-misses",            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}},
+		{"branches",                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS}},
+		{"branch-instructions",     {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS}},
+		{"branch-misses",           {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}},
+		{"bus-cycles",              {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BUS_CYCLES}},
+		{"stalled-cycles-frontend", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND}},
+		{"stalled-cycles-backend",  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND}},
+		{"task-clock",              {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK}},
+		{"cpu-clock",               {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK}},
+		{"page-faults",             {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}},
+		{"faults",                  {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}},
+		{"minor-faults",            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN}},
+		{"major-faults",            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ}},
+		{"context-switches",        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES}},
+		{"cs",                      {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES}},
+		{"cpu-migrations",          {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS}},
+		{"migrations",              {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS}},
+		{"alignment-faults",        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_ALIGNMENT_FAULTS}},
+		{"emulation-faults",        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_EMULATION_FAULTS}},
+	};
+
+	const auto it = generic.find(name);
+	if (it == generic.end())
+		return false;
+	attr.type = it->second.first;
+	attr.config = it->second.second;
+	return true;
+}
+
+
+// Stores a value in the bits of the attribute given by a sysfs format, e.g. "config:0-7" or "config:0-7,32-35"
+static void format_apply(struct perf_event_attr &attr, const string &format, uint64_t value, const string &event)
+{
+	const size_t colon = format.find(':');
+	const string field = format.substr(0, colon);
+	__u64 *dest;
+	if (field == "config")
+		dest = &attr.config;
+	else if (field == "config1")
+		dest = &attr.config1;
+	else if (field == "config2")
+		dest = &attr.config2;
+	else
+		throw_with_trace(std::runtime_error("Unsupported format '{}' for the event '{}'"_format(format, event)));
+
+	std::stringstream ranges(colon == string::npos ? "" : format.substr(colon + 1));
+	string range;
+	while (std::getline(ranges, range, ','))
+	{
+		const size_t dash = range.find('-');
+		const uint32_t lo = std::stoul(range.substr(0, dash));
+		const uint32_t hi = dash == string::npos ? lo : std::stoul(range.substr(dash + 1));
+		for (uint32_t bit = lo; bit <= hi && bit < 64; bit++, value >>= 1)
+			if (value & 1)
+				*dest |= 1ULL << bit;
+	}
+	if (value)
+		throw_with_trace(std::runtime_error("Value too big for the format '{}' in the event '{}'"_format(format, event)));
+}
+
+
+static void pmu_apply_terms(const fs::path &pmu, const string &terms, PerfEventDesc &desc, const string &event, bool aliases)
+{
+	std::stringstream ss(terms);
+	string term;
+	while (std::getline(ss, term, ','))
+	{
+		boost::algorithm::trim(term);
+		if (term.empty())
+			continue;
+
+		const size_t eq = term.find('=');
+		const string key = term.substr(0, eq);
+		const string value = eq == string::npos ? "1" : term.substr(eq + 1);
+		if (key == "name")
+		{
+			desc.name = value;
+			continue;
+		}
+
+		// Aliases exported by the PMU, with their own terms and maybe a scale and a unit
+		const fs::path alias = pmu / "events" / key;
+		if (aliases && eq == string::npos && fs::exists(alias))
+		{
+			pmu_apply_terms(pmu, read_line(alias), desc, event, false);
+			if (fs::exists(alias.string() + ".scale"))
+				desc.scale = std::stod(read_line(alias.string() + ".scale"));
+			if (fs::exists(alias.string() + ".unit"))
+				desc.unit = read_line(alias.string() + ".unit");
+			continue;
+		}
+
+		uint64_t v;
+		try
+		{
+			v = std::stoull(value, nullptr, 0);
+		}
+		catch (const std::logic_error &e)
+		{
+			throw_with_trace(std::runtime_error("Invalid value in the term '{}' of the event '{}'"_format(term, event)));
+		}
+
+		const fs::path format = pmu / "format" / key;
+		if (fs::exists(format))
+			format_apply(desc.attr, read_line(format), v, event);
+		else if (key == "config" || key == "config1" || key == "config2")
+			format_apply(desc.attr, key + ":0-63", v, event);
+		else
+			throw_with_trace(std::runtime_error("Unsupported term '{}' in the event '{}'"_format(term, event)));
+	}
+}
+
+
+PerfEventDesc perf_event_parse(const std::string &event, const std::string &pmus)
+{
+	PerfEventDesc desc;
+	memset(&desc.attr, 0, sizeof(desc.attr));
+	desc.name = event;
+
+	const size_t begin = event.find('/');
+	if (begin == string::npos)
+	{
+		const size_t colon = event.find(':');
+		if (!parse_generic(event.substr(0, colon), desc.attr))
+			throw_with_trace(std::runtime_error("Unknown event '{}'"_format(event)));
+		if (colon != string::npos)
+			apply_modifiers(desc.attr, event.substr(colon + 1), event);
+		if (desc.attr.type == PERF_TYPE_SOFTWARE && desc.attr.config <= PERF_COUNT_SW_TASK_CLOCK)
+			desc.unit = "ns";
+	}
+	else
+	{
+		const size_t end = event.rfind('/');
+		if (begin == end)
+			throw_with_trace(std::runtime_error("Malformed event '{}'"_format(event)));
+
+		const fs::path pmu = fs::path(pmus) / event.substr(0, begin);
+		if (!fs::exists(pmu / "type"))
+			throw_with_trace(std::runtime_error("Unknown PMU in the event '{}'"_format(event)));
+		desc.attr.type = std::stoul(read_line(pmu / "type"));
+		pmu_apply_terms(pmu, event.substr(begin + 1, end - begin - 1), desc, event, true);
+		apply_modifiers(desc.attr, event.substr(end + 1), event);
+	}
+
+	desc.attr.size = sizeof(desc.attr);
+	return desc;
+}
+
+
+const PerfDirect::EventSet& PerfDirect::parse(const std::string &events)
+{
+	static const uint32_t num_counters = pmu_num_gp_counters();
+
+	auto it = templates.find(events);
+	if (it != templates.end())
+		return it->second;
+
+	EventSet set;
+	size_t leader = 0;
+	bool in_group = false;
+
+	// Pack the events in groups that fit in the PMU, the kernel will rotate them if needed
+	for (auto token : event_list_split(events_schedule(events, num_counters)))
+	{
+		const bool open_group = token.front() == '{';
+		const bool close_group = token.back() == '}';
+		if (open_group)
+			token.erase(0, 1);
+		if (close_group)
+			token.pop_back();
+
+		if (!in_group || open_group)
+			leader = set.size();
+		else
+			set[leader].size++;
+		in_group = (in_group || open_group) && !close_group;
+		set.push_back({perf_event_parse(token, pmus), leader});
+	}
+
+	return templates.emplace(events, set).first->second;
+}
+
+
+void PerfDirect::init()
+{
+	reader.reset(new BatchReader());
+}
+
+
+void PerfDirect::clean()
+{
+	auto pids = vector<pid_t>();
+	for (const auto &item : pid_events)
+		pids.push_back(item.first);
+	for (const auto &pid : pids)
+		clean(pid);
+}
+
+
+void PerfDirect::clean(pid_t pid)
+{
+	const auto it = pid_events.find(pid);
+	if (it == pid_events.end())
+		return;
+	for (int fd : it->second.fds)
+		close(fd);
+	pid_events.erase(it);
+}
+
+
+void PerfDirect::setup_events(pid_t pid, const std::vector<std::string> &groups)
+{
+	assert(pid >= 1);
+
+	auto &task = pid_events[pid];
+	for (const auto &events : groups)
+	{
+		const EventSet &set = parse(events);
+		const size_t offset = task.fds.size();
+		for (size_t i = 0; i < set.size(); i++)
+		{
+			const auto &event = set[i];
+			const bool leader = event.leader == i;
+			if (leader)
+			{
+				task.groups.push_back({task.sets.size(), i, -1, task.values.size(), 3 + event.size});
+				task.values.resize(task.values.size() + 3 + event.size);
+			}
+			struct perf_event_attr attr = event.desc.attr;
+			attr.disabled = leader;
+			attr.inherit = 1;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+			const int group_fd = leader ? -1 : task.fds[offset + event.leader];
+			const int fd = perf_event_open(&attr, pid, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+			if (fd < 0)
+				throw_with_trace(std::runtime_error("Cannot open the event '{}' for the task {}: {}"_format(event.desc.name, pid, strerror(errno))));
+			task.fds.push_back(fd);
+			if (leader)
+				task.groups.back().fd = fd;
+		}
+		task.sets.push_back(&set);
+	}
+	enable_counters(pid);
+}
+
+
+void PerfDirect::group_ioctl(pid_t pid, unsigned long request)
+{
+	const auto &task = pid_events.at(pid);
+	for (const auto &group : task.groups)
+		if (ioctl(group.fd, request, PERF_IOC_FLAG_GROUP) < 0)
+			throw_with_trace(std::runtime_error("ioctl failed for the group of the event '{}': {}"_format(
+					(*task.sets[group.set])[group.first].desc.name, strerror(errno))));
+}
+
+
+void PerfDirect::enable_counters(pid_t pid)
+{
+	group_ioctl(pid, PERF_EVENT_IOC_ENABLE);
+}
+
+
+void PerfDirect::disable_counters(pid_t pid)
+{
+	group_ioctl(pid, PERF_EVENT_IOC_DISABLE);
+}
+
+
+void PerfDirect::prefetch_counters(const std::vector<pid_t> &pids)
+{
+	auto requests = vector<BatchReader::Request>();
+	for (const auto &pid : pids)
+	{
+		auto &task = pid_events.at(pid);
+		for (const auto &group : task.groups)
+			requests.push_back({group.fd, &task.values[group.pos], group.size * sizeof(uint64_t), 0});
+	}
+
+	assert(reader);
+	reader->read(requests);
+
+	size_t r = 0;
+	for (const auto &pid : pids)
+	{
+		auto &task = pid_events.at(pid);
+		for (const auto &group : task.groups)
+		{
+			if (requests[r].result < 0)
+				throw_with_trace(std::runtime_error("Cannot read the group of the event '{}': {}"_format(
+						(*task.sets[group.set])[group.first].desc.name, strerror(-requests[r].result))));
+			if ((size_t) requests[r].result != requests[r].size)
+				throw_with_trace(std::runtime_error("Read {} bytes for the group of the event '{}', expected {}"_format(
+						requests[r].result, (*task.sets[group.set])[group.first].desc.name, requests[r].size)));
+			r++;
+		}
+		task.prefetched = true;
+	}
+}
+
+
+// A read per group, unless they have been prefetched. The values are not scaled, the enabled and running times are
+// returned so Stats can do it.
+std::vector<counters_t> PerfDirect::read_counters(pid_t pid)
+{
+	auto &task = pid_events.at(pid);
+	auto result = vector<counters_t>(task.sets.size());
+
+	for (const auto &group : task.groups)
+	{
+		const auto &set = *task.sets[group.set];
+		uint64_t *values = &task.values[group.pos];
+		if (!task.prefetched)
+		{
+			// A short read would leave the values of the previous interval in the rest of the buffer
+			const ssize_t bytes = read(group.fd, values, group.size * sizeof(uint64_t));
+			if (bytes < 0)
+				throw_with_trace(std::runtime_error("Cannot read the group of the event '{}': {}"_format(set[group.first].desc.name, strerror(errno))));
+			if ((size_t) bytes != group.size * sizeof(uint64_t))
+				throw_with_trace(std::runtime_error("Read {} bytes for the group of the event '{}', expected {}"_format(
+						bytes, set[group.first].desc.name, group.size * sizeof(uint64_t))));
+		}
+
+		const uint64_t nr = values[0];
+		const uint64_t time_enabled = values[1];
+		const uint64_t time_running = values[2];
+		if (nr != group.size - 3)
+			throw_with_trace(std::runtime_error("Read {} values for the group of the event '{}', expected {}"_format(nr, set[group.first].desc.name, group.size - 3)));
+
+		const double enabled = time_enabled == time_running ? 1 : (double) time_running / time_enabled;
+		for (size_t j = 0; j < nr; j++)
+		{
+			const size_t i = group.first + j;
+			const auto &desc = set[i].desc;
+			result[group.set].insert({(int) i, desc.name, values[3 + j] * desc.scale, desc.unit, false, enabled, time_enabled, time_running});
+		}
+	}
+	task.prefetched = false;
+	return result;
+}
+
+
+std::vector<std::vector<std::string>> PerfDirect::get_names(pid_t pid)
+{
+	auto result = vector<vector<string>>();
+	for (const auto set : pid_events.at(pid).sets)
+	{
+		auto names = vector<string>();
+		for (const auto &event : *set)
+			names.push_back(event.desc.name);
+		result.push_back(names);
+	}
+	return result;
+}
+
+
+void PerfDirect::print_counters(pid_t pid)
+{
+	for (const auto &counters : read_counters(pid))
+	{
+		for (const auto &c : counters.get<by_id>())
+		{
+			std::cout << "{} {} {}"_format(c.value, c.unit, c.name);
+			if (c.time_running != c.time_enabled)
+				std::cout << " ({:.2f}%)"_format(100.0 * c.time_running / c.time_enabled);
+			std::cout << std::endl;
+		}
+		std::cout << std::endl;
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+
+#include "batch-read.hpp"
+#include "events.hpp"
+
+
+// An event parsed into the attributes perf_event_open needs
+struct PerfEventDesc
+{
+	std::string name;
+	std::string unit;
+	double scale = 1;
+	struct perf_event_attr attr;
+};
+
+
+// Parses an event in perf syntax: a generic hardware or software event (instructions, task-clock...) or an event of
+// a PMU with its terms (cpu/event=0xd1,umask=0x04,name=llc_hits/, uncore_imc_0/cas_count_read/). The terms are
+// encoded with the format and event aliases the PMU exports in sysfs, under the 'pmus' directory. Both kinds accept
+// the u, k and p (precise, can be repeated) modifiers.
+PerfEventDesc perf_event_parse(const std::string &event, const std::string &pmus = "/sys/bus/event_source/devices");
+
+
+// Minimal counter engine on top of perf_event_open. The event lists are parsed once into attribute templates, which
+// are reused for every task, and each task keeps a flat array of descriptors. Events between braces are opened as a
+// group and read at once with PERF_FORMAT_GROUP, the rest are groups on their own, like perf does. The groups of all
+// the tasks can be read with a single system call with prefetch_counters, using io_uring if available.
+class PerfDirect : public CounterBackend
+{
+	struct EventTemplate
+	{
+		PerfEventDesc desc;
+		size_t leader;       // Index of the group leader in the event set, itself for the leaders
+		size_t size = 1;     // Number of events in the group, only meaningful for the leaders
+	};
+	typedef std::vector<EventTemplate> EventSet;
+
+	struct Group
+	{
+		size_t set;          // Index of the event set in the task
+		size_t first;        // Index of the leader in the event set
+		int fd;              // Descriptor of the leader
+		size_t pos;          // Where the group is read in the values of the task
+		size_t size;         // Number of values read: nr, time enabled, time running and the events
+	};
+
+	struct TaskEvents
+	{
+		std::vector<const EventSet *> sets;
+		std::vector<int> fds;          // The events of all the sets, in order
+		std::vector<Group> groups;
+		std::vector<uint64_t> values;  // The last read of all the groups
+		bool prefetched = false;       // The values come from prefetch_counters and have not been used yet
+	};
+
+	std::string pmus;
+	std::map<std::string, EventSet> templates;  // Parsed event lists, by the list itself
+	std::map<pid_t, TaskEvents> pid_events;
+	std::unique_ptr<BatchReader> reader;
+
+	const EventSet& parse(const std::string &events);
+	void group_ioctl(pid_t pid, unsigned long request);
+
+	public:
+
+	PerfDirect(const std::string &pmus = "/sys/bus/event_source/devices") : pmus(pmus) {}
+
+	// Allow move members
+	PerfDirect(PerfDirect&&) = default;
+	PerfDirect& operator=(PerfDirect&&) = default;
+
+	// Delete copy members
+	PerfDirect(const PerfDirect&) = delete;
+	PerfDirect& operator=(const PerfDirect&) = delete;
+
+	~PerfDirect() { clean(); }
+
+
+	void init() override;
+	void clean() override;
+	void clean(pid_t pid) override;
+	void setup_events(pid_t pid, const std::vector<std::string> &groups) override;
+	void prefetch_counters(const std::vector<pid_t> &pids) override;
+	std::vector<counters_t> read_counters(pid_t pid) override;
+	std::vector<std::vector<std::string>> get_names(pid_t pid) override;
+	void enable_counters(pid_t pid) override;
+	void disable_counters(pid_t pid) override;
+	void print_counters(pid_t pid) override;
+};
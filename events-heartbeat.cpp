@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cmath>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "events-heartbeat.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+std::string HeartbeatMon::path(pid_t pid) const
+{
+	return "{}/heartbeat.{}"_format(dir, pid);
+}
+
+
+// Maps the ring of the task if it has already been created and is ready
+bool HeartbeatMon::map(pid_t pid, TaskRing &task) const
+{
+	const int fd = open(path(pid).c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	void *p = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(heartbeat_ring))
+		p = mmap(nullptr, sizeof(heartbeat_ring), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return false;
+
+	const auto ring = (const heartbeat_ring *) p;
+	if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != HEARTBEAT_MAGIC)
+	{
+		munmap(p, sizeof(heartbeat_ring));
+		return false;
+	}
+	if (ring->version != HEARTBEAT_VERSION || ring->slots != HEARTBEAT_SLOTS)
+	{
+		munmap(p, sizeof(heartbeat_ring));
+		throw_with_trace(std::runtime_error("The heartbeat ring '{}' has version {} and {} slots, expected version {} and {} slots"_format(
+				path(pid), ring->version, ring->slots, HEARTBEAT_VERSION, HEARTBEAT_SLOTS)));
+	}
+
+	LOGINF("Reading the heartbeats of the task {} from '{}'"_format(pid, path(pid)));
+	task.ring = ring;
+	task.next = 0;
+	return true;
+}
+
+
+void HeartbeatMon::setup(pid_t pid)
+{
+	tasks[pid] = TaskRing();
+}
+
+
+void HeartbeatMon::clean(pid_t pid)
+{
+	const auto it = tasks.find(pid);
+	if (it == tasks.end())
+		return;
+	if (it->second.ring)
+	{
+		munmap((void *) it->second.ring, sizeof(heartbeat_ring));
+		unlink(path(pid).c_str());
+	}
+	tasks.erase(it);
+}
+
+
+void HeartbeatMon::clean()
+{
+	while (!tasks.empty())
+		clean(tasks.begin()->first);
+}
+
+
+counters_t HeartbeatMon::read_counters(pid_t pid)
+{
+	auto &task = tasks[pid];
+
+	auto latencies = vector<uint64_t>();
+	if (task.ring || map(pid, task))
+	{
+		const heartbeat_ring *ring = task.ring;
+		const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+		// The records older than a full ring have been overwritten
+		if (head - task.next > HEARTBEAT_SLOTS)
+		{
+			task.lost += head - HEARTBEAT_SLOTS - task.next;
+			task.next = head - HEARTBEAT_SLOTS;
+		}
+
+		for (; task.next < head; task.next++)
+		{
+			const heartbeat_record &r = ring->records[task.next & (HEARTBEAT_SLOTS - 1)];
+			const uint64_t seq = __atomic_load_n(&r.seq, __ATOMIC_ACQUIRE);
+
+			// Claimed but not written yet, it is read in the next interval
+			if (seq < task.next + 1)
+				break;
+
+			const uint64_t items = __atomic_load_n(&r.items, __ATOMIC_RELAXED);
+			const uint64_t latency = __atomic_load_n(&r.latency_ns, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+			// Overwritten by a newer record, before or while copying it
+			if (seq != task.next + 1 || __atomic_load_n(&r.seq, __ATOMIC_RELAXED) != seq)
+			{
+				task.lost++;
+				continue;
+			}
+
+			task.beats++;
+			task.items += items;
+			latencies.push_back(latency);
+		}
+
+		if (task.lost && !task.warned)
+		{
+			LOGWAR("The task {} writes heartbeats faster than they are read, some of them are lost"_format(pid));
+			task.warned = true;
+		}
+	}
+
+	double mean = 0, p99 = 0;
+	if (!latencies.empty())
+	{
+		for (const auto &l : latencies)
+			mean += l;
+		mean /= latencies.size();
+
+		const size_t rank = std::ceil(0.99 * latencies.size()) - 1;
+		std::nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+		p99 = latencies[rank];
+	}
+
+	auto result = counters_t();
+	result.insert({0, "hb_beats", (double) task.beats, "", false, 1});
+	result.insert({1, "hb_items", (double) task.items, "", false, 1});
+	result.insert({2, "hb_latency", mean, "ns", true, 1});
+	result.insert({3, "hb_latency_p99", p99, "ns", true, 1});
+	return result;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "events.hpp"
+#include "heartbeat.h"
+
+
+// Progress reported by the tasks themselves with heartbeats (see heartbeat.h), read from their rings each interval:
+//   hb_beats        Heartbeats, cumulative
+//   hb_items        Units of work completed, e.g. requests, cumulative. Per second with the wall_time.
+//   hb_latency      Mean latency of the heartbeats of the interval, in ns, as a snapshot
+//   hb_latency_p99  99th percentile of the latency of the heartbeats of the interval, in ns, as a snapshot
+// The latencies are 0 in the intervals without heartbeats. A task may create its ring at any time, it is looked for
+// until it is found.
+class HeartbeatMon
+{
+	struct TaskRing
+	{
+		const heartbeat_ring *ring = nullptr;
+		uint64_t next = 0;    // Index of the next record to read
+		uint64_t beats = 0;
+		uint64_t items = 0;
+		uint64_t lost = 0;
+		bool warned = false;
+	};
+
+	std::string dir;
+	std::map<pid_t, TaskRing> tasks;
+
+	std::string path(pid_t pid) const;
+	bool map(pid_t pid, TaskRing &task) const;
+
+	public:
+
+	HeartbeatMon(const std::string &dir = HEARTBEAT_DIR) : dir(dir) {}
+
+	HeartbeatMon(const HeartbeatMon&) = delete;
+	HeartbeatMon& operator=(const HeartbeatMon&) = delete;
+	~HeartbeatMon() { clean(); }
+
+	void setup(pid_t pid);
+
+	// Unmaps the ring of the task and removes it, as no one is going to read it again
+	void clean(pid_t pid);
+	void clean();
+
+	counters_t read_counters(pid_t pid);
+	std::vector<std::string> get_names() const { return {"hb_beats", "hb_items", "hb_latency", "hb_latency_p99"}; }
+};
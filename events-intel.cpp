@@ -1,4 +1,22 @@
+#include <algorithm>
+#include <iostream>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "events-db.hpp"
 #include "events-intel.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+// Events counted by the fixed counters, PCM always collects them
+static const vector<string> fixed_events = {"instructions", "cycles", "ref-cycles"};
 
 
 void pcm_build_event(const char *event_str, EventSelectRegister &reg, CoreEvent &event)
@@ -19,6 +37,24 @@ void pcm_build_event(const char *event_str, EventSelectRegister &reg, CoreEvent
 	strncpy(name, event_str, EVENT_SIZE - 1);
 	event.name[0] = '\0';
 
+	// Modifiers after the terms, e.g. "cpu/event=0xd1,umask=0x20,name=llc_misses/u", only the privilege levels
+	char *last = strrchr(name, '/');
+	if (last && last != strchr(name, '/') && last[1] != '\0')
+	{
+		reg.fields.usr = 0;
+		reg.fields.os = 0;
+		for (const char *mod = last + 1; *mod; mod++)
+		{
+			if (*mod == 'u')
+				reg.fields.usr = 1;
+			else if (*mod == 'k')
+				reg.fields.os = 1;
+			else
+				throw_with_trace(std::runtime_error(std::string("Modifier '") + *mod + "' of the event '" + event_str + "' is not supported"));
+		}
+		last[1] = '\0';
+	}
+
 	for (j = 1, str1 = name; ; j++, str1 = NULL)
 	{
 		token = strtok_r(str1, "/", &saveptr1);
@@ -109,3 +145,174 @@ void pcm_cleanup()
 {
 	PCM::getInstance()->cleanup();
 }
+
+
+void PCMCounters::check_status(PCM::ErrorCode status)
+{
+	switch (status)
+	{
+		case PCM::Success:
+			break;
+
+		case PCM::MSRAccessDenied:
+			throw_with_trace(std::runtime_error("Access to PMU denied: No MSR or PCI CFG space access"));
+
+		case PCM::PMUBusy:
+			throw_with_trace(std::runtime_error("Access to PMU denied: The Performance Monitoring Unit is occupied by another application"));
+
+		default:
+			throw_with_trace(std::runtime_error("Access to PMU denied: unknown error)"));
+	}
+}
+
+
+void PCMCounters::program(const vector<string> &events)
+{
+	CoreEvent           custom[MAX_EVENTS];
+	EventSelectRegister regs[MAX_EVENTS];
+
+	PCM::ExtendedCustomCoreEventDescription conf;
+
+	const size_t max_events = std::min<size_t>(m->getMaxCustomCoreEvents(), MAX_EVENTS);
+	if (events.size() > max_events)
+		throw_with_trace(std::runtime_error("PCM cannot multiplex, at most {} events besides instructions, cycles and ref-cycles are allowed"_format(max_events)));
+
+	// Build events
+	memset(custom, 0, sizeof(custom));
+	memset(regs, 0, sizeof(regs));
+	custom_index.clear();
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		pcm_build_event(events[i].c_str(), regs[i], custom[i]);
+		custom_index[custom[i].name] = i;
+	}
+
+	// Prepare conf
+	conf.fixedCfg = NULL; // default
+	conf.nGPCounters = events.size();
+	conf.gpCounterCfg = regs;
+	conf.OffcoreResponseMsrValue[0] = custom[0].msr_value;
+	conf.OffcoreResponseMsrValue[1] = custom[1].msr_value;
+
+	// Program PCM unit
+	check_status(m->program(PCM::EXT_CUSTOM_CORE_EVENTS, &conf));
+	programmed = events;
+}
+
+
+void PCMCounters::init()
+{
+	m = PCM::getInstance();
+}
+
+
+void PCMCounters::clean()
+{
+	tasks.clear();
+	if (m)
+		m->cleanup();
+}
+
+
+void PCMCounters::clean(pid_t pid)
+{
+	tasks.erase(pid);
+}
+
+
+void PCMCounters::setup_events(pid_t pid, const vector<string> &groups)
+{
+	assert(m);
+
+	// The core of the task, it has to be pinned to a single one
+	const auto cpus = get_cpu_affinity(pid);
+	if (cpus.size() != 1)
+		LOGWAR("Task {} is allowed to run in {} cpus, PCM only counts the events of the first"_format(pid, cpus.size()));
+	const uint32_t core = cpus.front();
+	if (!m->isCoreOnline(core))
+		throw_with_trace(std::runtime_error("Core {} is not online"_format(core)));
+
+	// Groups have no meaning here, but we keep them to report the counters in the same way as perf
+	TaskDesc desc;
+	auto custom = vector<string>();
+	for (const auto &group : groups)
+	{
+		auto names = vector<string>();
+		for (auto event : event_list_split(group))
+		{
+			event.erase(std::remove(event.begin(), event.end(), '{'), event.end());
+			event.erase(std::remove(event.begin(), event.end(), '}'), event.end());
+			if (std::find(fixed_events.begin(), fixed_events.end(), event) != fixed_events.end())
+			{
+				names.push_back(event);
+				continue;
+			}
+			CoreEvent ce;
+			EventSelectRegister reg;
+			pcm_build_event(event.c_str(), reg, ce);
+			names.push_back(ce.name);
+			custom.push_back(event);
+		}
+		desc.groups.push_back(names);
+	}
+
+	// All the cores count the same events. The PMUs are programmed once, in the default mode if there are only fixed
+	// events, so that the fixed counters are running.
+	if (!is_programmed)
+	{
+		if (custom.empty())
+			check_status(m->program(PCM::DEFAULT_EVENTS, NULL));
+		else
+			program(custom);
+		is_programmed = true;
+	}
+	else if (custom != programmed)
+		throw_with_trace(std::runtime_error("All the tasks have to monitor the same events with PCM"));
+
+	desc.core = core;
+	desc.base = m->getCoreCounterState(core);
+	tasks[pid] = desc;
+}
+
+
+vector<counters_t> PCMCounters::read_counters(pid_t pid)
+{
+	const auto &desc = tasks.at(pid);
+	const auto curr = m->getCoreCounterState(desc.core);
+	auto result = vector<counters_t>();
+
+	for (const auto &group : desc.groups)
+	{
+		auto counters = counters_t();
+		for (size_t i = 0; i < group.size(); i++)
+		{
+			const auto &name = group[i];
+			double value;
+			if (name == "instructions")
+				value = getInstructionsRetired(desc.base, curr);
+			else if (name == "cycles")
+				value = getCycles(desc.base, curr);
+			else if (name == "ref-cycles")
+				value = getRefCycles(desc.base, curr);
+			else
+				value = getNumberOfCustomEvents(custom_index.at(name), desc.base, curr);
+			counters.insert({(int) i, name, value, "", false, 1});
+		}
+		result.push_back(counters);
+	}
+	return result;
+}
+
+
+vector<vector<string>> PCMCounters::get_names(pid_t pid)
+{
+	return tasks.at(pid).groups;
+}
+
+
+void PCMCounters::print_counters(pid_t pid)
+{
+	for (const auto &counters : read_counters(pid))
+		for (const auto &c : counters.get<by_id>())
+			std::cout << c.value << " " << c.name << std::endl;
+}
@@ -1,15 +1,139 @@
+#include <cassert>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
+#include <sstream>
 
-#include <fmt/format.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include <boost/algorithm/string/predicate.hpp>
+#include <fmt/format.h>
+#include <perfmon/pfmlib_perf_event.h>
 
+#include "events-db.hpp"
 #include "events-libpfm.hpp"
+#include "events-sched.hpp"
 #include "throw-with-trace.hpp"
 
 
+using std::string;
+using std::vector;
 using fmt::literals::operator""_format;
 
 
+static int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int group_fd, unsigned long flags)
+{
+	return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+
+// Encodes events like cpu/event=0xa3,umask=0x14,cmask=20,name=mem_stalls/u using the Intel PerfEvtSel layout
+static string encode_raw_event(const string &event, struct perf_event_attr &attr)
+{
+	const size_t begin = event.find('/');
+	const size_t end = event.rfind('/');
+	if (begin == end)
+		throw_with_trace(std::runtime_error("Malformed raw event '{}'"_format(event)));
+
+	string name = event;
+	attr.type = PERF_TYPE_RAW;
+	attr.config = 0;
+
+	std::stringstream terms(event.substr(begin + 1, end - begin - 1));
+	string term;
+	while (std::getline(terms, term, ','))
+	{
+		const size_t eq = term.find('=');
+		const string key = term.substr(0, eq);
+		const string value = eq == string::npos ? "1" : term.substr(eq + 1);
+		if (key == "name")
+		{
+			name = value;
+			continue;
+		}
+
+		uint64_t v;
+		try
+		{
+			v = std::stoull(value, nullptr, 0);
+		}
+		catch (const std::logic_error &e)
+		{
+			throw_with_trace(std::runtime_error("Invalid value in the term '{}' of the event '{}'"_format(term, event)));
+		}
+
+		if (key == "event")
+			attr.config |= v & 0xff;
+		else if (key == "umask")
+			attr.config |= (v & 0xff) << 8;
+		else if (key == "edge")
+			attr.config |= (v & 0x1) << 18;
+		else if (key == "any")
+			attr.config |= (v & 0x1) << 21;
+		else if (key == "inv")
+			attr.config |= (v & 0x1) << 23;
+		else if (key == "cmask")
+			attr.config |= (v & 0xff) << 24;
+		else if (key == "config")
+			attr.config = v;
+		else if (key == "config1")
+			attr.config1 = v;
+		else
+			throw_with_trace(std::runtime_error("Unsupported term '{}' in the event '{}'"_format(term, event)));
+	}
+
+	// As in perf, the privilege levels given are counted and the rest excluded, e.g. 'uk' counts user and kernel
+	bool user = false, kernel = false, hv = false;
+	for (char m : event.substr(end + 1))
+	{
+		if (m == 'u')
+			user = true;
+		else if (m == 'k')
+			kernel = true;
+		else if (m == 'h')
+			hv = true;
+		else if (m != ':')
+			throw_with_trace(std::runtime_error("Unsupported modifier '{}' in the event '{}'"_format(m, event)));
+	}
+	if (user || kernel || hv)
+	{
+		attr.exclude_user = !user;
+		attr.exclude_kernel = !kernel;
+		attr.exclude_hv = !hv;
+	}
+
+	return name;
+}
+
+
+std::string pfm_encode_event(const std::string &event, struct perf_event_attr &attr)
+{
+	memset(&attr, 0, sizeof(attr));
+
+	string name;
+	if (boost::starts_with(event, "cpu/"))
+	{
+		name = encode_raw_event(event, attr);
+	}
+	else
+	{
+		pfm_perf_encode_arg_t arg;
+		memset(&arg, 0, sizeof(arg));
+		arg.attr = &attr;
+		arg.size = sizeof(arg);
+		int ret = pfm_get_os_event_encoding(event.c_str(), PFM_PLM0 | PFM_PLM3, PFM_OS_PERF_EVENT_EXT, &arg);
+		if (ret != PFM_SUCCESS)
+			throw_with_trace(std::runtime_error("Cannot encode the event '{}': {}"_format(event, pfm_strerror(ret))));
+		name = event;
+	}
+
+	attr.size = sizeof(attr);
+	return name;
+}
+
+
 void PFM::init()
 {
 	if (pfm_initialize() != PFM_SUCCESS)
@@ -22,104 +146,147 @@ void PFM::clean()
 {
 	if (initialized)
 	{
-		for (auto &item : pid_events)
-			perf_free_fds(item.second.fds, item.second.num_fds);
+		auto pids = vector<pid_t>();
+		for (const auto &item : pid_events)
+			pids.push_back(item.first);
+		for (const auto &pid : pids)
+			clean(pid);
 		pfm_terminate();
 		initialized = false;
 	}
 }
 
 
+void PFM::clean(pid_t pid)
+{
+	const auto it = pid_events.find(pid);
+	if (it == pid_events.end())
+		return;
+	for (const auto &group : it->second)
+		for (const auto &event : group)
+			close(event.fd);
+	pid_events.erase(it);
+}
+
+
 void PFM::setup_events(pid_t pid, const std::vector<std::string> &groups)
 {
-	perf_event_desc_t *fds = NULL;
-	int num_fds = 0;
+	static const uint32_t num_counters = pmu_num_gp_counters();
 
-	for (const auto &grp : groups)
-	{
-		std::cout << grp << std::endl;
-		int ret = perf_setup_list_events(grp.c_str(), &fds, &num_fds);
-		if (ret || !num_fds)
-			throw_with_trace(std::runtime_error("Could not setup events"));
-	}
+	assert(pid >= 1);
+	if (!initialized)
+		throw_with_trace(std::runtime_error("libpfm has not been initialized"));
 
-	for (int i = 0; i < num_fds; i++)
+	auto &task_events = pid_events[pid];
+	for (const auto &events : groups)
 	{
-		bool is_group_leader;
-		int group_fd;
+		auto group = vector<Event>();
+		int leader_fd = -1;
+		bool in_group = false;
 
-		is_group_leader = perf_is_group_leader(fds, i);
-		if (is_group_leader)
-			group_fd = -1;
-		else
-			group_fd = fds[fds[i].group_leader].fd;
+		// Pack the events in groups that fit in the PMU, the kernel will rotate them if needed
+		for (auto token : event_list_split(events_schedule(events, num_counters)))
+		{
+			const bool open_group = token.front() == '{';
+			const bool close_group = token.back() == '}';
+			if (open_group)
+				token.erase(0, 1);
+			if (close_group)
+				token.pop_back();
+
+			struct perf_event_attr attr;
+			Event event;
+			event.name = pfm_encode_event(token, attr);
 
-		fds[i].hw.read_format = PERF_FORMAT_SCALE;
+			in_group = in_group || open_group;
+			const bool leader = !in_group || open_group;
+			attr.disabled = leader;
+			attr.inherit = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
 
-		// Inherit across forks
-		fds[i].hw.inherit = 1;
+			event.fd = perf_event_open(&attr, pid, -1, leader ? -1 : leader_fd, 0);
+			if (event.fd < 0)
+				throw_with_trace(std::runtime_error("Cannot open the event '{}' for the task {}: {}"_format(token, pid, strerror(errno))));
+			if (leader)
+				leader_fd = event.fd;
+			group.push_back(event);
 
-		fds[i].fd = perf_event_open(&fds[i].hw, pid, -1, group_fd, 0);
-		if (fds[i].fd == -1)
-			throw_with_trace(std::runtime_error("cannot attach event {} {}"_format(i, fds[i].name)));
+			if (close_group)
+				in_group = false;
+		}
+		task_events.push_back(group);
 	}
+	enable_counters(pid);
+}
+
+
+void PFM::enable_counters(pid_t pid)
+{
+	for (const auto &group : pid_events.at(pid))
+		for (const auto &event : group)
+			if (ioctl(event.fd, PERF_EVENT_IOC_ENABLE, 0) < 0)
+				throw_with_trace(std::runtime_error("Cannot enable the event '{}': {}"_format(event.name, strerror(errno))));
+}
 
-	pid_events[pid] = EventDesc(fds, num_fds);
+
+void PFM::disable_counters(pid_t pid)
+{
+	for (const auto &group : pid_events.at(pid))
+		for (const auto &event : group)
+			if (ioctl(event.fd, PERF_EVENT_IOC_DISABLE, 0) < 0)
+				throw_with_trace(std::runtime_error("Cannot disable the event '{}': {}"_format(event.name, strerror(errno))));
 }
 
 
-void PFM::read_groups(pid_t pid)
+// The values are not scaled, the enabled and running times are returned so Stats can do it
+std::vector<counters_t> PFM::read_counters(pid_t pid)
 {
-	auto fds = pid_events[pid].fds;
-	auto num_fds = pid_events[pid].num_fds;
-	for (int evt = 0; evt < num_fds; evt++)
+	auto result = vector<counters_t>();
+	for (const auto &group : pid_events.at(pid))
 	{
-		uint64_t values[3];
-		ssize_t ret = read(fds[evt].fd, values, sizeof(values));
-		if (ret != (ssize_t) sizeof(values))
+		auto counters = counters_t();
+		for (size_t i = 0; i < group.size(); i++)
 		{
-			if (ret == -1)
-				throw_with_trace(std::runtime_error("Cannot read event {}"_format(fds[evt].name)));
-
-			/* likely pinned and could not be loaded */
-			throw_with_trace(std::runtime_error("Could not read event {}, tried to read {} bytes, but got {}"_format(
-					evt, sizeof(values), ret)));
+			const auto &event = group[i];
+			uint64_t values[3];
+			ssize_t ret = read(event.fd, values, sizeof(values));
+			if (ret != (ssize_t) sizeof(values))
+				throw_with_trace(std::runtime_error("Cannot read the event '{}', tried to read {} bytes, but got {}: {}"_format(
+						event.name, sizeof(values), ret, strerror(errno))));
+			const double enabled = values[1] == values[2] ? 1 : (double) values[2] / values[1];
+			counters.insert({(int) i, event.name, (double) values[0], "", false, enabled, values[1], values[2]});
 		}
-
-		fds[evt].values[0] = values[0];
-		fds[evt].values[1] = values[1];
-		fds[evt].values[2] = values[2];
+		result.push_back(counters);
 	}
+	return result;
 }
 
 
-void PFM::print_counts(pid_t pid)
+std::vector<std::vector<std::string>> PFM::get_names(pid_t pid)
 {
-	read_groups(pid);
+	auto result = vector<vector<string>>();
+	for (const auto &group : pid_events.at(pid))
+	{
+		auto names = vector<string>();
+		for (const auto &event : group)
+			names.push_back(event.name);
+		result.push_back(names);
+	}
+	return result;
+}
 
-	auto fds = pid_events[pid].fds;
-	auto num_fds = pid_events[pid].num_fds;
 
-	for(int i = 0; i < num_fds; i++)
+void PFM::print_counters(pid_t pid)
+{
+	for (const auto &counters : read_counters(pid))
 	{
-		uint64_t val   = perf_scale(fds[i].values);
-		uint64_t delta = perf_scale_delta(fds[i].values, fds[i].prev_values);
-		double ratio = perf_scale_ratio(fds[i].values);
-
-		/* separate groups */
-		if (perf_is_group_leader(fds, i))
-			putchar('\n');
-
-		std::cout << "{} {} {} ({}% scaling, ena={}, run={})\n"_format(
-			val,
-			delta,
-			fds[i].name,
-			(1.0-ratio)*100.0,
-			fds[i].values[1],
-			fds[i].values[2]);
-
-		fds[i].prev_values[0] = fds[i].values[0];
-		fds[i].prev_values[1] = fds[i].values[1];
-		fds[i].prev_values[2] = fds[i].values[2];
+		for (const auto &c : counters.get<by_id>())
+		{
+			std::cout << "{} {}"_format(c.value, c.name);
+			if (c.time_running != c.time_enabled)
+				std::cout << " ({:.2f}%)"_format(100.0 * c.time_running / c.time_enabled);
+			std::cout << std::endl;
+		}
+		std::cout << std::endl;
 	}
 }
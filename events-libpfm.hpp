@@ -2,25 +2,27 @@
 
 
 #include <map>
+#include <string>
 #include <vector>
-extern "C"
-{
-#include "perf_util.h"
-}
+
+#include <linux/perf_event.h>
+
+#include "events.hpp"
 
 
-class PFM
+// Counter engine built on libpfm4 and raw perf_event_open calls. Events are encoded with libpfm, except for the perf
+// style raw events (cpu/event=0xd1,umask=0x04,name=llc_hits/) produced by the event database, which are encoded here.
+// Events between braces are opened as a perf group, the rest on their own, like perf does.
+class PFM : public CounterBackend
 {
-	struct EventDesc
+	struct Event
 	{
-		perf_event_desc_t *fds;
-		int num_fds;
-		EventDesc() = default;
-		EventDesc(perf_event_desc_t *fds, int num_fds) :
-				fds(fds), num_fds(num_fds) {};
+		std::string name;
+		int fd = -1;
 	};
 
-	std::map<pid_t, EventDesc> pid_events;
+	// For each task, the events of each of the groups passed to setup_events
+	std::map<pid_t, std::vector<std::vector<Event>>> pid_events;
 	bool initialized = false;
 
 	public:
@@ -38,9 +40,18 @@ class PFM
 	~PFM() { clean(); }
 
 
-	void init();
-	void clean();
-	void setup_events(pid_t pid, const std::vector<std::string> &groups);
-	void read_groups(pid_t pid);
-	void print_counts(pid_t pid);
+	void init() override;
+	void clean() override;
+	void clean(pid_t pid) override;
+	void setup_events(pid_t pid, const std::vector<std::string> &groups) override;
+	std::vector<counters_t> read_counters(pid_t pid) override;
+	std::vector<std::vector<std::string>> get_names(pid_t pid) override;
+	void enable_counters(pid_t pid) override;
+	void disable_counters(pid_t pid) override;
+	void print_counters(pid_t pid) override;
 };
+
+
+// Fills the perf_event_attr of an event and returns its name. Raw events in perf syntax are encoded directly, the
+// rest by libpfm, which has to be initialized.
+std::string pfm_encode_event(const std::string &event, struct perf_event_attr &attr);
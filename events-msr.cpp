@@ -0,0 +1,154 @@
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "events-msr.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+#define MSR_TSC               0x10
+#define MSR_PLATFORM_INFO     0xce
+#define MSR_MPERF             0xe7
+#define MSR_APERF             0xe8
+#define MSR_CORE_C3_RESIDENCY 0x3fc
+#define MSR_CORE_C6_RESIDENCY 0x3fd
+#define MSR_CORE_C7_RESIDENCY 0x3fe
+
+
+int MSRMon::open_cpu(uint32_t cpu)
+{
+	const auto it = fds.find(cpu);
+	if (it != fds.end())
+		return it->second;
+
+	const string path = "/dev/cpu/{}/msr"_format(cpu);
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw_with_trace(std::runtime_error("Cannot open '{}', is the msr module loaded? {}"_format(path, strerror(errno))));
+	fds[cpu] = fd;
+	return fd;
+}
+
+
+bool MSRMon::read_msr(int fd, uint32_t msr, uint64_t &value) const
+{
+	return pread(fd, &value, sizeof(value), msr) == sizeof(value);
+}
+
+
+MSRMon::Sample MSRMon::read_sample(uint32_t cpu)
+{
+	const int fd = open_cpu(cpu);
+	Sample sample;
+	for (const auto &msr : msrs)
+	{
+		uint64_t value;
+		if (!read_msr(fd, msr.second, value))
+			throw_with_trace(std::runtime_error("Cannot read the MSR {:#x} ({}) of CPU {}: {}"_format(msr.second, msr.first, cpu, strerror(errno))));
+		sample.values.push_back(value);
+	}
+	return sample;
+}
+
+
+void MSRMon::init()
+{
+	const int fd = open_cpu(0);
+	uint64_t value;
+
+	// The maximum non turbo ratio, in units of 100 MHz
+	if (!read_msr(fd, MSR_PLATFORM_INFO, value))
+		throw_with_trace(std::runtime_error("Cannot read MSR_PLATFORM_INFO: {}"_format(strerror(errno))));
+	nominal_freq = ((value >> 8) & 0xff) * 100;
+
+	msrs = {{"tsc", MSR_TSC}, {"mperf", MSR_MPERF}, {"aperf", MSR_APERF}};
+	for (const auto &msr : msrs)
+		if (!read_msr(fd, msr.second, value))
+			throw_with_trace(std::runtime_error("Cannot read the MSR {:#x} ({}): {}"_format(msr.second, msr.first, strerror(errno))));
+
+	// Not all the processors have all the C-states, the MSR read fails for the missing ones
+	const vector<std::pair<string, uint32_t>> cstates = {{"c3", MSR_CORE_C3_RESIDENCY}, {"c6", MSR_CORE_C6_RESIDENCY}, {"c7", MSR_CORE_C7_RESIDENCY}};
+	for (const auto &msr : cstates)
+	{
+		if (read_msr(fd, msr.second, value))
+			msrs.push_back(msr);
+		else
+			LOGDEB("The core C-state {} residency is not available"_format(msr.first));
+	}
+
+	LOGINF("Nominal frequency: {} MHz"_format(nominal_freq));
+}
+
+
+void MSRMon::setup(pid_t pid)
+{
+	if (msrs.empty())
+		throw_with_trace(std::runtime_error("MSR monitoring has not been initialized"));
+	const auto cpus = get_cpu_affinity(pid);
+	if (cpus.size() != 1)
+		LOGWAR("Task {} is allowed to run in {} cpus, only the frequency and C-states of the first are read"_format(pid, cpus.size()));
+	const uint32_t cpu = cpus.front();
+	last[pid] = std::make_pair(cpu, read_sample(cpu));
+}
+
+
+void MSRMon::clean(pid_t pid)
+{
+	last.erase(pid);
+}
+
+
+void MSRMon::clean()
+{
+	for (const auto &kv : fds)
+		close(kv.second);
+	fds.clear();
+	last.clear();
+}
+
+
+counters_t MSRMon::read_counters(pid_t pid)
+{
+	auto &prev = last.at(pid);
+	const Sample curr = read_sample(prev.first);
+
+	auto delta = vector<double>();
+	for (size_t i = 0; i < msrs.size(); i++)
+		delta.push_back(curr.values[i] - prev.second.values[i]);
+	prev.second = curr;
+
+	// The order of the first MSRs is fixed in init
+	const double tsc = delta[0];
+	const double mperf = delta[1];
+	const double aperf = delta[2];
+	const double ratio = mperf ? aperf / mperf : 0;
+
+	auto result = counters_t();
+	int id = 0;
+	result.insert({id++, "eff_freq", ratio * nominal_freq, "MHz", true, 1});
+	result.insert({id++, "freq_ratio", ratio, "", true, 1});
+	result.insert({id++, "c0_res", tsc ? mperf / tsc : 0, "", true, 1});
+	for (size_t i = 3; i < msrs.size(); i++)
+		result.insert({id++, msrs[i].first + "_res", tsc ? delta[i] / tsc : 0, "", true, 1});
+	return result;
+}
+
+
+std::vector<std::string> MSRMon::get_names() const
+{
+	auto names = vector<string>{"eff_freq", "freq_ratio", "c0_res"};
+	for (size_t i = 3; i < msrs.size(); i++)
+		names.push_back(msrs[i].first + "_res");
+	return names;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "events.hpp"
+
+
+// Frequency and C-state residency of the core a task runs in, read from the MSRs (/dev/cpu/N/msr, needs the msr
+// module). The core is the first one the task is allowed to run in. They are core wide values, so they also account for anything else running in the core. All of them are
+// reported as snapshots of the last interval:
+//   eff_freq     Average frequency while not halted (MHz), from APERF/MPERF and the nominal frequency
+//   freq_ratio   APERF/MPERF, the average frequency while not halted over the nominal one, greater than 1 when the core
+//                has been running above the nominal frequency on average, not the fraction of the time in turbo
+//   c0_res       Fraction of the time in C0, MPERF/TSC
+//   cN_res       Fraction of the time in the core C-state N, for the C-states the CPU supports
+class MSRMon
+{
+	struct Sample
+	{
+		std::vector<uint64_t> values;  // Same order as 'msrs'
+	};
+
+	std::map<uint32_t, int> fds;       // CPU -> MSR device
+	std::map<pid_t, std::pair<uint32_t, Sample>> last;
+	std::vector<std::pair<std::string, uint32_t>> msrs;
+	double nominal_freq = 0;           // MHz
+
+	int open_cpu(uint32_t cpu);
+	bool read_msr(int fd, uint32_t msr, uint64_t &value) const;
+	Sample read_sample(uint32_t cpu);
+
+	public:
+
+	MSRMon() = default;
+
+	MSRMon(const MSRMon&) = delete;
+	MSRMon& operator=(const MSRMon&) = delete;
+	~MSRMon() { clean(); }
+
+	// Probes the supported MSRs, throws if they cannot be read
+	void init();
+
+	void setup(pid_t pid);
+	void clean(pid_t pid);
+	void clean();
+
+	counters_t read_counters(pid_t pid);
+	std::vector<std::string> get_names() const;
+};
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <unordered_map>
+
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "events-direct.hpp"
+#include "events-pebs.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace chr = std::chrono;
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+const std::vector<uint64_t> ReuseStats::bounds = {1, 4, 16, 64, 256, 1024, 4096};
+
+
+static int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int group_fd, unsigned long flags)
+{
+	return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+
+// Fenwick tree, used to count the lines whose last access lies between two samples
+class Fenwick
+{
+	vector<int64_t> tree;
+
+	public:
+
+	Fenwick(size_t n) : tree(n + 1, 0) {}
+
+	void add(size_t i, int64_t v)
+	{
+		for (i++; i < tree.size(); i += i & -i)
+			tree[i] += v;
+	}
+
+	// Sum of the elements [0, i)
+	int64_t sum(size_t i) const
+	{
+		int64_t s = 0;
+		for (; i > 0; i -= i & -i)
+			s += tree[i];
+		return s;
+	}
+};
+
+
+ReuseStats reuse_analyze(const std::vector<uint64_t> &addrs, uint32_t line_size)
+{
+	ReuseStats stats;
+	stats.samples = addrs.size();
+	stats.histogram.assign(ReuseStats::bounds.size() + 1, 0);
+
+	// Each line is marked in the position of its last access, so the lines accessed between two positions are the
+	// marks between them
+	auto last = std::unordered_map<uint64_t, size_t>();
+	auto times = std::unordered_map<uint64_t, uint64_t>();
+	Fenwick marks(addrs.size());
+	for (size_t t = 0; t < addrs.size(); t++)
+	{
+		const uint64_t line = addrs[t] / line_size;
+		const auto it = last.find(line);
+		if (it == last.end())
+		{
+			stats.cold++;
+		}
+		else
+		{
+			const uint64_t distance = marks.sum(t) - marks.sum(it->second + 1);
+			const auto bucket = std::upper_bound(ReuseStats::bounds.begin(), ReuseStats::bounds.end(), distance) - ReuseStats::bounds.begin();
+			stats.histogram[bucket]++;
+			marks.add(it->second, -1);
+		}
+		marks.add(t, 1);
+		last[line] = t;
+		times[line]++;
+	}
+
+	// Chao1 estimator of the number of lines, the ones seen only once or twice tell how many were missed
+	uint64_t f1 = 0, f2 = 0;
+	for (const auto &kv : times)
+	{
+		f1 += kv.second == 1;
+		f2 += kv.second == 2;
+	}
+	stats.lines = times.size();
+	stats.ws_lines = f2 ? stats.lines + (double) f1 * f1 / (2.0 * f2) : stats.lines + f1 * (f1 - 1) / 2.0;
+	return stats;
+}
+
+
+PEBSMon::PEBSMon(uint64_t period, uint32_t ldlat, size_t data_pages) :
+		period(period), ldlat(ldlat), data_pages(data_pages), page_size(sysconf(_SC_PAGESIZE))
+{
+	// The kernel needs a power of two number of data pages
+	if (data_pages == 0 || (data_pages & (data_pages - 1)))
+		throw_with_trace(std::runtime_error("The number of pages of the sample buffers must be a power of two"));
+}
+
+
+void PEBSMon::init()
+{
+	// Fail early if the CPU has no load latency event
+	perf_event_parse("cpu/mem-loads,ldlat={}/upp"_format(ldlat));
+
+	running = true;
+	drainer = std::thread(&PEBSMon::drain_loop, this);
+}
+
+
+void PEBSMon::setup(pid_t pid)
+{
+	PerfEventDesc desc = perf_event_parse("cpu/mem-loads,ldlat={}/upp"_format(ldlat));
+	desc.attr.sample_period = period;
+	desc.attr.sample_type = PERF_SAMPLE_ADDR | PERF_SAMPLE_WEIGHT;
+
+	TaskSampler task;
+	task.fd = perf_event_open(&desc.attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	if (task.fd < 0)
+		throw_with_trace(std::runtime_error("Cannot sample the loads of the task {}: {}"_format(pid, strerror(errno))));
+
+	task.base = mmap(NULL, (1 + data_pages) * page_size, PROT_READ | PROT_WRITE, MAP_SHARED, task.fd, 0);
+	if (task.base == MAP_FAILED)
+	{
+		close(task.fd);
+		throw_with_trace(std::runtime_error("Cannot map the sample buffer of the task {}: {}"_format(pid, strerror(errno))));
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	tasks[pid] = task;
+}
+
+
+void PEBSMon::clean(pid_t pid)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	const auto it = tasks.find(pid);
+	if (it == tasks.end())
+		return;
+	munmap(it->second.base, (1 + data_pages) * page_size);
+	close(it->second.fd);
+	tasks.erase(it);
+}
+
+
+void PEBSMon::clean()
+{
+	if (running)
+	{
+		running = false;
+		drainer.join();
+	}
+
+	auto pids = vector<pid_t>();
+	for (const auto &kv : tasks)
+		pids.push_back(kv.first);
+	for (const auto &pid : pids)
+		clean(pid);
+}
+
+
+// Must be called with the mutex held
+void PEBSMon::drain(TaskSampler &task)
+{
+	auto meta = (struct perf_event_mmap_page *) task.base;
+	const char *data = (const char *) task.base + page_size;
+	const uint64_t size = data_pages * page_size;
+
+	const uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+	uint64_t tail = meta->data_tail;
+	char record[256];
+	while (tail < head)
+	{
+		// Records can wrap around the end of the buffer
+		struct perf_event_header header;
+		for (size_t i = 0; i < sizeof(header); i++)
+			((char *) &header)[i] = data[(tail + i) % size];
+		if (header.size < sizeof(header))
+			break;
+		const size_t len = std::min((size_t) header.size, sizeof(record));
+		for (size_t i = 0; i < len; i++)
+			record[i] = data[(tail + i) % size];
+
+		// The fields of a sample are in the order of their bits in sample_type
+		if (header.type == PERF_RECORD_SAMPLE && len >= sizeof(header) + 2 * sizeof(uint64_t))
+		{
+			const uint64_t *fields = (const uint64_t *) (record + sizeof(header));
+			task.samples.push_back({fields[0], fields[1]});
+		}
+		else if (header.type == PERF_RECORD_LOST && len >= sizeof(header) + 2 * sizeof(uint64_t))
+		{
+			task.lost += ((const uint64_t *) (record + sizeof(header)))[1];
+		}
+		tail += header.size;
+	}
+	__atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+
+void PEBSMon::drain_loop()
+{
+	while (running)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto &kv : tasks)
+				drain(kv.second);
+		}
+		std::this_thread::sleep_for(chr::milliseconds(10));
+	}
+}
+
+
+counters_t PEBSMon::read_counters(pid_t pid)
+{
+	auto samples = vector<Sample>();
+	uint64_t lost;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto &task = tasks.at(pid);
+		drain(task);
+		std::swap(samples, task.samples);
+		lost = task.lost;
+		task.lost = 0;
+	}
+	if (lost)
+		LOGDEB("{} load samples of the task {} were lost"_format(lost, pid));
+
+	auto addrs = vector<uint64_t>();
+	double latency = 0;
+	for (const auto &s : samples)
+	{
+		addrs.push_back(s.addr);
+		latency += s.weight;
+	}
+	const ReuseStats stats = reuse_analyze(addrs);
+	const double n = stats.samples;
+
+	auto result = counters_t();
+	int id = 0;
+	result.insert({id++, "mem_samples", n, "", true, 1});
+	result.insert({id++, "load_lat", n ? latency / n : 0, "cycles", true, 1});
+	result.insert({id++, "ws_bytes", stats.ws_lines * 64, "bytes", true, 1});
+	for (size_t i = 0; i < stats.histogram.size(); i++)
+	{
+		const string name = i < ReuseStats::bounds.size() ? "rd_{}"_format(ReuseStats::bounds[i]) : "rd_inf";
+		result.insert({id++, name, n ? stats.histogram[i] / n : 0, "", true, 1});
+	}
+	result.insert({id++, "rd_cold", n ? stats.cold / n : 0, "", true, 1});
+	return result;
+}
+
+
+std::vector<std::string> PEBSMon::get_names() const
+{
+	auto names = vector<string>{"mem_samples", "load_lat", "ws_bytes"};
+	for (const auto &bound : ReuseStats::bounds)
+		names.push_back("rd_{}"_format(bound));
+	names.push_back("rd_inf");
+	names.push_back("rd_cold");
+	return names;
+}
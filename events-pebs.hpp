@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "events.hpp"
+
+
+// Reuse distance histogram and working set of a sequence of sampled data addresses. The distance of an access is the
+// number of different cache lines accessed since the previous access to the same line. Distances are counted among
+// the samples, so they are the real ones divided by the sampling period.
+struct ReuseStats
+{
+	static const std::vector<uint64_t> bounds;  // Upper bounds (exclusive) of the histogram buckets but the last
+
+	uint64_t samples = 0;
+	uint64_t lines = 0;                // Different cache lines sampled
+	double ws_lines = 0;               // Estimate of the lines accessed, sampled or not
+	uint64_t cold = 0;                 // First access to a line
+	std::vector<uint64_t> histogram;   // One bucket per bound, plus one for the longer distances
+};
+
+ReuseStats reuse_analyze(const std::vector<uint64_t> &addrs, uint32_t line_size = 64);
+
+
+// Samples the addresses and latencies of the loads of each task with the load latency facility of PEBS
+// (cpu/mem-loads/), and reports per interval, as snapshots:
+//   mem_samples  Loads sampled
+//   load_lat     Average latency of the sampled loads, in cycles
+//   ws_bytes     Working set, estimated from how many lines were sampled once and twice (Chao1)
+//   rd_N         Fraction of the samples with a reuse distance (in sampled lines) under N
+//   rd_inf       Fraction of the samples with a longer reuse distance
+//   rd_cold      Fraction of the samples to lines not seen before in the interval
+// The samples are written by the kernel in a ring buffer per task, which a background thread drains. Only the main
+// thread of each task is sampled, the kernel does not allow ring buffers for inherited per task events.
+class PEBSMon
+{
+	struct Sample
+	{
+		uint64_t addr;
+		uint64_t weight;
+	};
+
+	struct TaskSampler
+	{
+		int fd = -1;
+		void *base = nullptr;           // The mmap'ed ring buffer, its first page is the control page
+		std::vector<Sample> samples;    // Taken since the last read
+		uint64_t lost = 0;
+	};
+
+	uint64_t period;
+	uint32_t ldlat;
+	size_t data_pages;
+	size_t page_size;
+
+	std::map<pid_t, TaskSampler> tasks;
+	std::mutex mutex;                   // Protects tasks
+	std::thread drainer;
+	std::atomic<bool> running{false};
+
+	void drain(TaskSampler &task);
+	void drain_loop();
+
+	public:
+
+	PEBSMon(uint64_t period = 1000, uint32_t ldlat = 3, size_t data_pages = 64);
+
+	PEBSMon(const PEBSMon&) = delete;
+	PEBSMon& operator=(const PEBSMon&) = delete;
+	~PEBSMon() { clean(); }
+
+	// Starts the background thread
+	void init();
+
+	void setup(pid_t pid);
+	void clean(pid_t pid);
+	void clean();
+
+	counters_t read_counters(pid_t pid);
+	std::vector<std::string> get_names() const;
+};
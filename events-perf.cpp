@@ -1,3 +1,5 @@
+#include <memory>
+
 #include <fmt/format.h>
 
 extern "C"
@@ -5,13 +7,46 @@ extern "C"
 #include <libminiperf.h>
 }
 
+#include "common.hpp"
 #include "events-perf.hpp"
+#include "events-sched.hpp"
+#include "log.hpp"
 #include "throw-with-trace.hpp"
 
 
 using fmt::literals::operator""_format;
 
 
+static counters_t evlist_read(struct perf_evlist *evlist)
+{
+	int n = ::num_entries(evlist);
+	auto names = std::vector<const char *>(n);
+	auto results = std::vector<double>(n);
+	auto units = std::vector<const char *>(n);
+	auto snapshot = std::unique_ptr<bool[]>(new bool[n]);
+	auto enabled = std::vector<double>(n);
+	auto time_enabled = std::vector<uint64_t>(n);
+	auto time_running = std::vector<uint64_t>(n);
+	auto counters = counters_t();
+	::read_counters(evlist, names.data(), results.data(), units.data(), snapshot.get(), enabled.data(), time_enabled.data(), time_running.data());
+	for (int i = 0; i < n; i++)
+		counters.insert({i, names[i], results[i], units[i], snapshot[i], enabled[i], time_enabled[i], time_running[i]});
+	return counters;
+}
+
+
+static std::vector<std::string> evlist_names(struct perf_evlist *evlist)
+{
+	int n = ::num_entries(evlist);
+	auto names = std::vector<const char *>(n);
+	auto v = std::vector<std::string>();
+	::get_names(evlist, names.data());
+	for (int i = 0; i < n; i++)
+		v.push_back(names[i]);
+	return v;
+}
+
+
 void Perf::init()
 {}
 
@@ -34,14 +69,16 @@ void Perf::clean(pid_t pid)
 
 void Perf::setup_events(pid_t pid, const std::vector<std::string> &groups)
 {
+	static const uint32_t num_counters = pmu_num_gp_counters();
+
 	assert(pid >= 1);
 	for (const auto &events : groups)
 	{
-		const auto evlist = ::setup_events(std::to_string(pid).c_str(), events.c_str());
+		// Pack the events in groups that fit in the PMU, the kernel will rotate them if needed
+		const auto scheduled = events_schedule(events, num_counters);
+		const auto evlist = ::setup_events(std::to_string(pid).c_str(), scheduled.c_str());
 		if (evlist == NULL)
-			throw_with_trace(std::runtime_error("Could not setup events '{}'"_format(events)));
-		if (::num_entries(evlist) >= max_num_events)
-			throw_with_trace(std::runtime_error("Too many events"));
+			throw_with_trace(std::runtime_error("Could not setup events '{}'"_format(scheduled)));
 		pid_events[pid].append(evlist);
 		::enable_counters(evlist);
 	}
@@ -64,41 +101,20 @@ void Perf::disable_counters(pid_t pid)
 
 std::vector<counters_t> Perf::read_counters(pid_t pid)
 {
-	const char *names[max_num_events];
-	double results[max_num_events];
-	const char *units[max_num_events];
-	bool snapshot[max_num_events];
-	double enabled[max_num_events];
-
 	auto result = std::vector<counters_t>();
 
 	for (const auto &evlist : pid_events[pid].groups)
-	{
-		int n = ::num_entries(evlist);
-		auto counters = counters_t();
-		::read_counters(evlist, names, results, units, snapshot, enabled);
-		for (int i = 0; i < n; i++)
-			counters.insert({i, names[i], results[i], units[i], snapshot[i], enabled[i]});
-		result.push_back(counters);
-	}
+		result.push_back(evlist_read(evlist));
 	return result;
 }
 
 
 std::vector<std::vector<std::string>> Perf::get_names(pid_t pid)
 {
-	const char *names[max_num_events];
 	auto r = std::vector<std::vector<std::string>>();
 
 	for (const auto &evlist : pid_events[pid].groups)
-	{
-		int n = ::num_entries(evlist);
-		auto v = std::vector<std::string>();
-		::get_names(evlist, names);
-		for (int i = 0; i < n; i++)
-			v.push_back(names[i]);
-		r.push_back(v);
-	}
+		r.push_back(evlist_names(evlist));
 	return r;
 }
 
@@ -108,3 +124,125 @@ void Perf::print_counters(pid_t pid)
 	for (const auto &evlist : pid_events[pid].groups)
 		::print_counters(evlist);
 }
+
+
+void PerfCPU::init()
+{}
+
+
+void PerfCPU::clean()
+{
+	for (const auto &item : cpu_events)
+		for (const auto &evlist : item.second.evlists)
+			::clean(evlist);
+	cpu_events.clear();
+	tasks.clear();
+}
+
+
+// The counters of the core are kept, they will be reused by the next task in the core
+void PerfCPU::clean(pid_t pid)
+{
+	tasks.erase(pid);
+}
+
+
+void PerfCPU::setup_events(pid_t pid, const std::vector<std::string> &groups)
+{
+	static const uint32_t num_counters = pmu_num_gp_counters();
+
+	assert(pid >= 1);
+	const auto cpus = get_cpu_affinity(pid);
+	if (cpus.size() != 1)
+		LOGWAR("Task {} is allowed to run in {} cpus, only the events of the first are counted"_format(pid, cpus.size()));
+	const uint32_t cpu = cpus.front();
+
+	if (cpu_events.count(cpu) == 0)
+	{
+		LOGINF("Setting up the events of CPU {}"_format(cpu));
+		auto &desc = cpu_events[cpu];
+		desc.groups = groups;
+		for (const auto &events : groups)
+		{
+			const auto scheduled = events_schedule(events, num_counters);
+			const auto evlist = ::setup_events_cpu(std::to_string(cpu).c_str(), scheduled.c_str());
+			if (evlist == NULL)
+				throw_with_trace(std::runtime_error("Could not setup events '{}' in CPU {}"_format(scheduled, cpu)));
+			desc.evlists.push_back(evlist);
+			::enable_counters(evlist);
+		}
+	}
+	else if (cpu_events[cpu].groups != groups)
+		throw_with_trace(std::runtime_error("The events of the task {} are not the ones counted in CPU {}"_format(pid, cpu)));
+
+	tasks[pid] = {cpu, read_cpu(cpu)};
+}
+
+
+void PerfCPU::enable_counters(pid_t pid)
+{
+	for (const auto &evlist : cpu_events.at(tasks.at(pid).cpu).evlists)
+		::enable_counters(evlist);
+}
+
+
+void PerfCPU::disable_counters(pid_t pid)
+{
+	for (const auto &evlist : cpu_events.at(tasks.at(pid).cpu).evlists)
+		::disable_counters(evlist);
+}
+
+
+std::vector<counters_t> PerfCPU::read_cpu(uint32_t cpu)
+{
+	auto result = std::vector<counters_t>();
+	for (const auto &evlist : cpu_events.at(cpu).evlists)
+		result.push_back(evlist_read(evlist));
+	return result;
+}
+
+
+// Values relative to the ones the core had when the task was set up
+std::vector<counters_t> PerfCPU::read_counters(pid_t pid)
+{
+	const auto &task = tasks.at(pid);
+	auto result = std::vector<counters_t>();
+	const auto groups = read_cpu(task.cpu);
+
+	assert(groups.size() == task.base.size());
+	for (size_t i = 0; i < groups.size(); i++)
+	{
+		auto counters = counters_t();
+		const auto &base = task.base[i].get<by_name>();
+		for (auto c : groups[i].get<by_id>())
+		{
+			const auto b = base.find(c.name);
+			if (!c.snapshot && b != base.end())
+			{
+				c.value -= b->value;
+				c.time_enabled -= b->time_enabled;
+				c.time_running -= b->time_running;
+				c.enabled = c.time_running == c.time_enabled ? 1 : (double) c.time_running / c.time_enabled;
+			}
+			counters.insert(c);
+		}
+		result.push_back(counters);
+	}
+	return result;
+}
+
+
+std::vector<std::vector<std::string>> PerfCPU::get_names(pid_t pid)
+{
+	auto r = std::vector<std::vector<std::string>>();
+	for (const auto &evlist : cpu_events.at(tasks.at(pid).cpu).evlists)
+		r.push_back(evlist_names(evlist));
+	return r;
+}
+
+
+void PerfCPU::print_counters(pid_t pid)
+{
+	for (const auto &evlist : cpu_events.at(tasks.at(pid).cpu).evlists)
+		::print_counters(evlist);
+}
@@ -1,60 +1,18 @@
 #pragma once
 
 
+#include <cstdint>
 #include <map>
+#include <string>
 #include <vector>
 
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/identity.hpp>
-#include <boost/multi_index/member.hpp>
-
-
-namespace mi = boost::multi_index;
+#include "events.hpp"
 
 
 struct perf_evlist;
 
-struct Counter
+class Perf : public CounterBackend
 {
-	int id = 0;
-	std::string name = "";
-	double value = 0;
-	std::string unit = "";
-	bool snapshot = false;
-	double enabled = 0;
-
-	Counter() = default;
-	Counter(int id, const std::string &name, double value, const std::string &unit, bool snapshot, double enabled) :
-			id(id), name(name), value(value), unit(unit), snapshot(snapshot), enabled(enabled) {};
-	bool operator<(const Counter &c) const {return id < c.id;}
-};
-
-struct by_id {};
-struct by_name {};
-typedef mi::multi_index_container<
-	Counter,
-	mi::indexed_by<
-		// sort by Counter::operator<
-		mi::ordered_unique<mi::tag<by_id>, mi::identity<Counter> >,
-
-		// sort by less<string> on name
-		mi::ordered_unique<
-			mi::tag<by_name>,
-			mi::member<
-				Counter,
-				std::string,
-				&Counter::name
-			>
-		>
-	>
-> counters_t;
-
-
-class Perf
-{
-	const int max_num_events = 32;
-
 	struct EventDesc
 	{
 		std::vector<struct perf_evlist*> groups;
@@ -83,13 +41,64 @@ class Perf
 	~Perf() = default;
 
 
-	void init();
-	void clean();
-	void clean(pid_t pid);
-	void setup_events(pid_t pid, const std::vector<std::string> &groups);
-	std::vector<counters_t> read_counters(pid_t pid);
-	std::vector<std::vector<std::string>> get_names(pid_t pid);
-	void enable_counters(pid_t pid);
-	void disable_counters(pid_t pid);
-	void print_counters(pid_t pid);
+	void init() override;
+	void clean() override;
+	void clean(pid_t pid) override;
+	void setup_events(pid_t pid, const std::vector<std::string> &groups) override;
+	std::vector<counters_t> read_counters(pid_t pid) override;
+	std::vector<std::vector<std::string>> get_names(pid_t pid) override;
+	void enable_counters(pid_t pid) override;
+	void disable_counters(pid_t pid) override;
+	void print_counters(pid_t pid) override;
+};
+
+
+// Counts the events system wide in the cores the tasks are pinned to, instead of following each task. A single set
+// of counters is opened per core, the first time a task pinned to it is set up, so the tasks restarted in the same
+// core do not need any perf setup, the counters are only read to take the new base values. The counts include
+// everything that runs in the core, so it only makes sense when each task has a core for itself. The core of a task
+// is the first one in its affinity.
+class PerfCPU : public CounterBackend
+{
+	struct CPUEvents
+	{
+		std::vector<std::string> groups;
+		std::vector<struct perf_evlist*> evlists;
+	};
+
+	struct TaskDesc
+	{
+		uint32_t cpu = 0;
+		std::vector<counters_t> base;  // Values when the events were set up for the task
+	};
+
+	std::map<uint32_t, CPUEvents> cpu_events;
+	std::map<pid_t, TaskDesc> tasks;
+
+	std::vector<counters_t> read_cpu(uint32_t cpu);
+
+	public:
+
+	PerfCPU() = default;
+
+	// Allow move members
+	PerfCPU(PerfCPU&&) = default;
+	PerfCPU& operator=(PerfCPU&&) = default;
+
+	// Delete copy members
+	PerfCPU(const PerfCPU&) = delete;
+	PerfCPU& operator=(const PerfCPU&) = delete;
+
+	~PerfCPU() = default;
+
+
+	void init() override;
+	void clean() override;
+	void clean(pid_t pid) override;
+	void setup_events(pid_t pid, const std::vector<std::string> &groups) override;
+	std::vector<counters_t> read_counters(pid_t pid) override;
+	std::vector<std::vector<std::string>> get_names(pid_t pid) override;
+	void enable_counters(pid_t pid) override;
+	void disable_counters(pid_t pid) override;
+	void print_counters(pid_t pid) override;
 };
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <fstream>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "events-rapl.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace fs = boost::filesystem;
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+static string read_string(const fs::path &path)
+{
+	std::ifstream f = open_ifstream(path);
+	string value;
+	f >> value;
+	return value;
+}
+
+
+uint64_t Rapl::read_energy(const Domain &domain) const
+{
+	try
+	{
+		return std::stoull(read_string(domain.dir / "energy_uj"));
+	}
+	catch (const std::exception &e)
+	{
+		throw_with_trace(std::runtime_error("Cannot read the energy of the RAPL domain '{}'"_format(domain.dir.string())));
+	}
+}
+
+
+// Accumulates the energy consumed since the last read, taking into account that the counter may have wrapped
+void Rapl::update(Domain &domain)
+{
+	const uint64_t curr = read_energy(domain);
+	const uint64_t delta = curr >= domain.last ?
+			curr - domain.last :
+			domain.max_range - domain.last + curr;
+	domain.joules += delta / 1e6;
+	domain.last = curr;
+}
+
+
+void Rapl::setup()
+{
+	auto init = [this](Domain &domain, const fs::path &dir)
+	{
+		domain.dir = dir;
+		domain.max_range = std::stoull(read_string(dir / "max_energy_range_uj"));
+		domain.last = read_energy(domain);
+		domain.joules = 0;
+	};
+
+	if (!fs::exists(root))
+		throw_with_trace(std::runtime_error("RAPL is not available, '{}' does not exist"_format(root.string())));
+
+	// Packages are the intel-rapl:N zones named package-<socket>, and DRAM one of their subzones
+	for (const auto &p : fs::directory_iterator(root))
+	{
+		const string zone = p.path().filename().string();
+		if (!boost::starts_with(zone, "intel-rapl:") || zone.find(':') != zone.rfind(':'))
+			continue;
+		const string name = read_string(p.path() / "name");
+		if (!boost::starts_with(name, "package-"))
+			continue;
+
+		const uint32_t id = std::stoul(name.substr(std::string("package-").size()));
+		Socket &socket = sockets[id];
+		init(socket.pkg, p.path());
+		for (const auto &sub : fs::directory_iterator(p.path()))
+		{
+			if (!boost::starts_with(sub.path().filename().string(), zone + ":"))
+				continue;
+			if (read_string(sub.path() / "name") == "dram")
+			{
+				init(socket.dram, sub.path());
+				socket.has_dram = true;
+			}
+		}
+		LOGDEB("RAPL socket {}: package '{}'{}"_format(id, socket.pkg.dir.string(),
+				socket.has_dram ? ", DRAM '{}'"_format(socket.dram.dir.string()) : ""));
+	}
+	if (sockets.empty())
+		throw_with_trace(std::runtime_error("There are no RAPL package domains in '{}'"_format(root.string())));
+
+	// All the sockets have to report the same counters, so the DRAM energy is only measured if all have the domain
+	if (std::any_of(sockets.begin(), sockets.end(), [](const auto &kv) { return !kv.second.has_dram; }) &&
+			std::any_of(sockets.begin(), sockets.end(), [](const auto &kv) { return kv.second.has_dram; }))
+	{
+		LOGWAR("Some sockets have no RAPL DRAM domain, the DRAM energy is not measured");
+		for (auto &kv : sockets)
+			kv.second.has_dram = false;
+	}
+}
+
+
+counters_t Rapl::read_counters(uint32_t id)
+{
+	if (!sockets.count(id))
+		throw_with_trace(std::runtime_error("There is no RAPL package domain for the socket {}"_format(id)));
+	Socket &socket = sockets.at(id);
+
+	auto result = counters_t();
+	update(socket.pkg);
+	result.insert({0, "energy_pkg", socket.pkg.joules, "J", false, 1});
+	if (socket.has_dram)
+	{
+		update(socket.dram);
+		result.insert({1, "energy_dram", socket.dram.joules, "J", false, 1});
+	}
+	return result;
+}
+
+
+std::vector<std::string> Rapl::get_names() const
+{
+	auto names = vector<string>{"energy_pkg"};
+	if (!sockets.empty() && sockets.begin()->second.has_dram)
+		names.push_back("energy_dram");
+	return names;
+}
+
+
+std::vector<uint32_t> Rapl::get_sockets() const
+{
+	auto result = vector<uint32_t>();
+	for (const auto &kv : sockets)
+		result.push_back(kv.first);
+	return result;
+}
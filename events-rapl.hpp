@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "events.hpp"
+
+
+// Package and DRAM energy of each socket, read from the RAPL domains exposed by the powercap driver
+// (/sys/class/powercap/intel-rapl:N). The energy counters wrap around, the accumulated joules are kept here.
+class Rapl
+{
+	#define FS boost::filesystem
+	struct Domain
+	{
+		FS::path dir;
+		uint64_t max_range = 0;  // uJ, the counter wraps around at this value
+		uint64_t last = 0;       // Last raw value read, uJ
+		double joules = 0;       // Energy consumed since the setup
+	};
+
+	struct Socket
+	{
+		Domain pkg;
+		Domain dram;
+		bool has_dram = false;
+	};
+
+	FS::path root;
+	std::map<uint32_t, Socket> sockets;
+
+	uint64_t read_energy(const Domain &domain) const;
+	void update(Domain &domain);
+	#undef FS
+
+	public:
+
+	Rapl(const std::string &root = "/sys/class/powercap") : root(root) {}
+
+	void setup();
+
+	counters_t read_counters(uint32_t socket);
+	std::vector<std::string> get_names() const;
+	std::vector<uint32_t> get_sockets() const;
+};
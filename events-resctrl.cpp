@@ -0,0 +1,238 @@
+#include <cassert>
+#include <fstream>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "events-resctrl.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace fs = boost::filesystem;
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+// Features we know how to report, and whether they are snapshots of the state of the cache
+static const std::map<string, bool> known_features =
+{
+	{"llc_occupancy",   true},
+	{"mbm_total_bytes", false},
+	{"mbm_local_bytes", false},
+};
+
+
+void ResctrlMon::init()
+{
+	const auto path = root / "info" / "L3_MON" / "mon_features";
+	if (!fs::exists(path))
+		throw_with_trace(std::runtime_error("Resctrl monitoring is not available, '{}' does not exist"_format(path.string())));
+
+	std::ifstream f = open_ifstream(path);
+	f.exceptions(std::ifstream::badbit);
+	string feature;
+	features.clear();
+	while (f >> feature)
+	{
+		if (known_features.count(feature))
+			features.push_back(feature);
+		else
+			LOGDEB("Ignoring unknown resctrl monitoring feature '{}'"_format(feature));
+	}
+	if (features.empty())
+		throw_with_trace(std::runtime_error("Resctrl does not support any known monitoring feature"));
+}
+
+
+// The control group a task belongs to, it is the root group unless it has been assigned to a CLOS
+fs::path ResctrlMon::find_ctrl_group(pid_t pid) const
+{
+	for (const auto &p : fs::directory_iterator(root))
+	{
+		const string name = p.path().filename().string();
+		if (!fs::is_directory(p) || name == "info" || name == "mon_groups" || name == "mon_data")
+			continue;
+		if (group_has_task(p, pid))
+			return p;
+	}
+	return root;
+}
+
+
+bool ResctrlMon::group_has_task(const fs::path &dir, pid_t pid) const
+{
+	if (!fs::exists(dir / "tasks"))
+		return false;
+	std::ifstream f = open_ifstream(dir / "tasks");
+	f.exceptions(std::ifstream::badbit);
+	pid_t task;
+	while (f >> task)
+		if (task == pid)
+			return true;
+	return false;
+}
+
+
+// Creates a monitoring group for the task in its current control group, and moves all its threads to it.
+// The kernel takes a task out of its monitoring group when it is moved to another control group, so this
+// is also used to follow the task. Then the group is moved along with the task (renaming a monitoring group to
+// another control group needs Linux 6.2), which keeps its RMID and its counts. If it cannot be moved, a new group
+// is created and the cumulative counts of the previous one are kept as a base.
+void ResctrlMon::attach(pid_t pid, Group &group)
+{
+	const auto ctrl = find_ctrl_group(pid);
+	const auto dir = ctrl / "mon_groups" / "rmcat-{}"_format(pid);
+
+	bool reuse = false;
+	if (!group.dir.empty() && fs::exists(group.dir))
+	{
+		boost::system::error_code ec;
+		if (group.dir != dir)
+			fs::rename(group.dir, dir, ec);
+		reuse = !ec;
+		if (ec)
+			LOGDEB("Cannot move the monitoring group '{}' to '{}': {}"_format(group.dir.string(), dir.string(), ec.message()));
+	}
+
+	if (!group.dir.empty() && !reuse)
+	{
+		boost::system::error_code ec;
+		fs::remove(group.dir, ec);
+		for (const auto &feature : features)
+		{
+			if (!known_features.at(feature))
+				group.base[feature] += group.last[feature];
+			group.last[feature] = 0;
+		}
+	}
+
+	group.dir = dir;
+	if (!reuse)
+	{
+		try
+		{
+			if (fs::exists(group.dir))
+				fs::remove(group.dir);
+			fs::create_directory(group.dir);
+		}
+		catch (const fs::filesystem_error &e)
+		{
+			throw_with_trace(std::runtime_error("Cannot create the monitoring group '{}', there may not be RMIDs left: {}"_format(
+					group.dir.string(), e.what())));
+		}
+	}
+
+	const auto task_dir = fs::path("/proc") / std::to_string(pid) / "task";
+	auto tids = vector<string>{std::to_string(pid)};
+	if (fs::exists(task_dir))
+		for (const auto &p : fs::directory_iterator(task_dir))
+			if (p.path().filename().string() != tids.front())
+				tids.push_back(p.path().filename().string());
+	for (const auto &tid : tids)
+	{
+		try
+		{
+			std::ofstream f = open_ofstream(group.dir / "tasks");
+			f << tid << std::endl;
+		}
+		catch (const std::system_error &e)
+		{
+			throw_with_trace(std::runtime_error("Cannot write pid '{}' into '{}'"_format(tid, (group.dir / "tasks").string())));
+		}
+	}
+	LOGDEB("Monitoring task {} with the resctrl group '{}'"_format(pid, group.dir.string()));
+}
+
+
+// Adds up the value of a feature for all the cache domains. The kernel reports 'Unavailable' when the
+// hardware has no valid data for the RMID, in that case false is returned.
+bool ResctrlMon::read_feature(const fs::path &dir, const string &feature, uint64_t &value) const
+{
+	value = 0;
+	for (const auto &p : fs::directory_iterator(dir / "mon_data"))
+	{
+		std::ifstream f = open_ifstream(p.path() / feature);
+		f.exceptions(std::ifstream::badbit);
+		string data;
+		f >> data;
+		try
+		{
+			value += std::stoull(data);
+		}
+		catch (const std::logic_error &e)
+		{
+			LOGDEB("Cannot read '{}': {}"_format((p.path() / feature).string(), data));
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void ResctrlMon::setup(pid_t pid)
+{
+	assert(pid >= 1);
+	if (features.empty())
+		throw_with_trace(std::runtime_error("Resctrl monitoring has not been initialized"));
+	if (groups.count(pid))
+		throw_with_trace(std::runtime_error("Task {} is already being monitored"_format(pid)));
+	attach(pid, groups[pid]);
+}
+
+
+void ResctrlMon::clean(pid_t pid)
+{
+	const auto it = groups.find(pid);
+	if (it == groups.end())
+		return;
+	boost::system::error_code ec;
+	fs::remove(it->second.dir, ec);
+	if (ec)
+		LOGWAR("Cannot remove the monitoring group '{}': {}"_format(it->second.dir.string(), ec.message()));
+	groups.erase(it);
+}
+
+
+void ResctrlMon::clean()
+{
+	auto pids = vector<pid_t>();
+	for (const auto &kv : groups)
+		pids.push_back(kv.first);
+	for (const auto &pid : pids)
+		clean(pid);
+}
+
+
+counters_t ResctrlMon::read_counters(pid_t pid)
+{
+	auto &group = groups.at(pid);
+
+	// The task has changed of CLOS since the last read, follow it
+	if (!fs::exists(group.dir) || !group_has_task(group.dir, pid))
+	{
+		LOGDEB("Task {} has left the monitoring group '{}'"_format(pid, group.dir.string()));
+		attach(pid, group);
+	}
+
+	auto result = counters_t();
+	for (size_t i = 0; i < features.size(); i++)
+	{
+		const auto &feature = features[i];
+		uint64_t value;
+		if (read_feature(group.dir, feature, value))
+			group.last[feature] = value;
+		const bool snapshot = known_features.at(feature);
+		const double total = snapshot ? group.last[feature] : group.base[feature] + group.last[feature];
+		result.insert({(int) i, feature, total, "B", snapshot, 1});
+	}
+	return result;
+}
+
+
+std::vector<std::string> ResctrlMon::get_names() const
+{
+	return features;
+}
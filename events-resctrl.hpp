@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "events.hpp"
+
+
+// Cache occupancy (CMT) and memory bandwidth (MBM) monitoring through the resctrl filesystem.
+// Each task gets its own monitoring group (mon_groups/<name>) inside the control group (CLOS) it belongs to.
+// The occupancy is reported as a snapshot counter, while the bandwidth counters are cumulative byte counts.
+class ResctrlMon
+{
+	#define FS boost::filesystem
+	struct Group
+	{
+		FS::path dir;                          // Directory of the monitoring group
+		std::map<std::string, uint64_t> last;  // Last raw value read of each feature
+		std::map<std::string, uint64_t> base;  // Value accumulated by the cumulative features in previous groups
+	};
+
+	FS::path root;
+	std::vector<std::string> features;
+	std::map<pid_t, Group> groups;
+
+	FS::path find_ctrl_group(pid_t pid) const;
+	bool group_has_task(const FS::path &dir, pid_t pid) const;
+	void attach(pid_t pid, Group &group);
+	bool read_feature(const FS::path &dir, const std::string &feature, uint64_t &value) const;
+	#undef FS
+
+	public:
+
+	ResctrlMon(const std::string &root = "/sys/fs/resctrl") : root(root) {}
+
+	// Reads the supported monitoring features, throws if resctrl monitoring is not available
+	void init();
+
+	void setup(pid_t pid);
+	void clean(pid_t pid);
+	void clean();
+
+	counters_t read_counters(pid_t pid);
+	std::vector<std::string> get_names() const;
+};
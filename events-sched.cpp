@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include <cpuid.h>
+
+#include <fmt/format.h>
+
+#include "events-db.hpp"
+#include "events-sched.hpp"
+#include "log.hpp"
+
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+uint32_t pmu_num_gp_counters()
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	// Architectural performance monitoring leaf, if it is not there assume the minimum we have seen
+	if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx) || eax < 0xa)
+		return 4;
+	__cpuid(0xa, eax, ebx, ecx, edx);
+	const uint32_t num = (eax >> 8) & 0xff;
+	return num ? num : 4;
+}
+
+
+bool event_needs_gp_counter(const std::string &event)
+{
+	// Generic hardware events counted by the fixed counters, and software events
+	static const vector<string> no_gp =
+	{
+		"instructions", "cycles", "cpu-cycles", "ref-cycles",
+		"task-clock", "cpu-clock", "page-faults", "faults", "minor-faults", "major-faults",
+		"context-switches", "cs", "cpu-migrations", "migrations", "alignment-faults", "emulation-faults",
+	};
+
+	const string name = event.substr(0, event.find(':'));
+	if (std::find(no_gp.begin(), no_gp.end(), name) != no_gp.end())
+		return false;
+
+	// Events from other PMUs (uncore, msr, power...) do not use the core counters
+	const auto slash = event.find('/');
+	if (slash != string::npos && event.substr(0, slash) != "cpu")
+		return false;
+
+	return true;
+}
+
+
+std::string events_schedule(const std::string &events, uint32_t num_counters)
+{
+	auto tokens = event_list_split(events);
+	auto gp = vector<string>();
+	auto others = vector<string>();
+	int depth = 0;
+
+	assert(num_counters > 0);
+
+	for (const auto &token : tokens)
+	{
+		const bool grouped = depth > 0 || token.find('{') != string::npos;
+		depth += std::count(token.begin(), token.end(), '{');
+		depth -= std::count(token.begin(), token.end(), '}');
+
+		if (!grouped && event_needs_gp_counter(token))
+			gp.push_back(token);
+		else
+			others.push_back(token);
+	}
+
+	// Nothing to do, all the events fit in the PMU
+	if (gp.size() <= num_counters)
+		return events;
+
+	string result;
+	for (size_t i = 0; i < gp.size(); i += num_counters)
+	{
+		string group;
+		for (size_t j = i; j < std::min(i + num_counters, gp.size()); j++)
+			group += group.empty() ? gp[j] : "," + gp[j];
+		result += "{}{{{}}}"_format(result.empty() ? "" : ",", group);
+	}
+	for (const auto &other : others)
+		result += "," + other;
+
+	LOGINF("The events '{}' need {} counters but there are only {}, they will be multiplexed as '{}'"_format(
+			events, gp.size(), num_counters, result));
+
+	return result;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+// Number of general purpose counters available to each logical CPU, as reported by CPUID
+uint32_t pmu_num_gp_counters();
+
+// True if the event needs a general purpose counter, false if it is counted by a fixed counter
+// (instructions, cycles, ref-cycles), by software or by a PMU other than the core one
+bool event_needs_gp_counter(const std::string &event);
+
+// Packs the events of a comma separated list into groups that fit in the general purpose counters.
+// The kernel rotates the groups when they do not fit in the PMU at the same time, and the events of a group are
+// always scheduled together, so the ratios between them are exact. Events already grouped by the user with
+// braces and events that do not need a general purpose counter are left alone.
+std::string events_schedule(const std::string &events, uint32_t num_counters);
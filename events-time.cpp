@@ -0,0 +1,56 @@
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+
+#include "events-time.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace chr = std::chrono;
+namespace fs = boost::filesystem;
+
+using fmt::literals::operator""_format;
+
+
+void TimeMon::setup(pid_t pid)
+{
+	starts[pid] = chr::steady_clock::now();
+}
+
+
+void TimeMon::clean(pid_t pid)
+{
+	starts.erase(pid);
+}
+
+
+void TimeMon::clean()
+{
+	starts.clear();
+}
+
+
+counters_t TimeMon::read_counters(pid_t pid) const
+{
+	const auto it = starts.find(pid);
+	if (it == starts.end())
+		throw_with_trace(std::out_of_range("The time of the task {} is not monitored"_format(pid)));
+	const double wall = chr::duration<double>(chr::steady_clock::now() - it->second).count();
+
+	// The first field of schedstat is the time on the CPU, in ns. Threads can exit while they are read.
+	uint64_t cpu_ns = 0;
+	boost::system::error_code ec;
+	for (fs::directory_iterator it(fs::path("{}/{}/task"_format(proc, pid)), ec), end; !ec && it != end; it.increment(ec))
+	{
+		std::ifstream f((it->path() / "schedstat").string());
+		uint64_t ns;
+		if (f >> ns)
+			cpu_ns += ns;
+	}
+
+	auto result = counters_t();
+	result.insert({0, "wall_time", wall, "s", false, 1});
+	result.insert({1, "cpu_time", cpu_ns / 1e9, "s", false, 1});
+	return result;
+}
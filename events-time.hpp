@@ -0,0 +1,32 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "events.hpp"
+
+
+// Wall clock and CPU time of each task, so the counters of intervals of different lengths can be compared:
+//   wall_time  Seconds since the monitoring of the task started, when it was set up, read along with its counters
+//   cpu_time   Seconds the threads of the task have been running, from /proc/<pid>/task/*/schedstat
+// Both are cumulative, so the interval values are the length of the interval and the time the task has run in it.
+// The CPU time of the threads that have already exited is not included.
+class TimeMon
+{
+	std::string proc;
+	std::map<pid_t, std::chrono::steady_clock::time_point> starts;
+
+	public:
+
+	TimeMon(const std::string &proc = "/proc") : proc(proc) {}
+
+	// The wall time of a task counts from here, also when it is restarted with a new pid
+	void setup(pid_t pid);
+	void clean(pid_t pid);
+	void clean();
+
+	counters_t read_counters(pid_t pid) const;
+	std::vector<std::string> get_names() const { return {"wall_time", "cpu_time"}; }
+};
@@ -0,0 +1,125 @@
+#include <algorithm>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+
+extern "C"
+{
+#include <libminiperf.h>
+}
+
+#include "events-uncore.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+#include "topology.hpp"
+
+
+namespace fs = boost::filesystem;
+namespace chr = std::chrono;
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+void Uncore::setup()
+{
+	const fs::path devices = "/sys/bus/event_source/devices";
+
+	pmus.clear();
+	if (fs::exists(devices))
+		for (const auto &p : fs::directory_iterator(devices))
+			if (p.path().filename().string().find("uncore_imc") == 0 && fs::exists(p.path() / "events" / "cas_count_read"))
+				pmus.push_back(p.path().filename().string());
+	if (pmus.empty())
+		throw_with_trace(std::runtime_error("There are no uncore memory controller PMUs with CAS counters"));
+	std::sort(pmus.begin(), pmus.end());
+
+	string events;
+	for (const auto &pmu : pmus)
+		events += "{}{}/cas_count_read,name={}_rd/,{}/cas_count_write,name={}_wr/"_format(events.empty() ? "" : ",", pmu, pmu, pmu, pmu);
+
+	// Uncore events are counted by a single CPU per socket
+	for (const auto &kv : topology().sockets)
+	{
+		const string cpu = std::to_string(kv.second.front());
+		Socket &socket = sockets[kv.first];
+		socket.evlist = ::setup_events_cpu(cpu.c_str(), events.c_str());
+		if (socket.evlist == NULL)
+			throw_with_trace(std::runtime_error("Could not setup the uncore events '{}' in CPU {}"_format(events, cpu)));
+		::enable_counters(socket.evlist);
+		socket.last_time = chr::steady_clock::now();
+	}
+	LOGINF("Measuring memory traffic with the PMUs {}"_format(boost::algorithm::join(pmus, ", ")));
+}
+
+
+void Uncore::clean()
+{
+	for (auto &kv : sockets)
+	{
+		if (kv.second.evlist)
+			::clean(kv.second.evlist);
+		kv.second.evlist = nullptr;
+	}
+	sockets.clear();
+}
+
+
+counters_t Uncore::read_counters(uint32_t id)
+{
+	Socket &socket = sockets.at(id);
+
+	const int n = ::num_entries(socket.evlist);
+	auto names = vector<const char *>(n);
+	auto results = vector<double>(n);
+	auto units = vector<const char *>(n);
+	::read_counters(socket.evlist, names.data(), results.data(), units.data(), NULL, NULL, NULL, NULL);
+
+	// The CAS counts are scaled by perf using the sysfs scale, usually to MiB. Each CAS transfers a cache line.
+	double read = 0, write = 0;
+	for (int i = 0; i < n; i++)
+	{
+		const string unit = units[i] ? units[i] : "";
+		const double bytes = unit == "MiB" ? results[i] * 1024 * 1024 : results[i] * 64;
+		if (boost::algorithm::ends_with(names[i], "_rd"))
+			read += bytes;
+		else
+			write += bytes;
+	}
+
+	const auto now = chr::steady_clock::now();
+	const double secs = chr::duration<double>(now - socket.last_time).count();
+	const double bw = secs > 0 ? (read + write - socket.last_bytes) / secs : 0;
+	socket.last_bytes = read + write;
+	socket.last_time = now;
+
+	auto result = counters_t();
+	int id_c = 0;
+	result.insert({id_c++, "mem_read_bytes", read, "B", false, 1});
+	result.insert({id_c++, "mem_write_bytes", write, "B", false, 1});
+	result.insert({id_c++, "mem_bw", bw, "B/s", true, 1});
+	if (peak_bw > 0)
+		result.insert({id_c++, "mem_util", bw / peak_bw, "", true, 1});
+	return result;
+}
+
+
+std::vector<std::string> Uncore::get_names() const
+{
+	auto names = vector<string>{"mem_read_bytes", "mem_write_bytes", "mem_bw"};
+	if (peak_bw > 0)
+		names.push_back("mem_util");
+	return names;
+}
+
+
+std::vector<uint32_t> Uncore::get_sockets() const
+{
+	auto result = vector<uint32_t>();
+	for (const auto &kv : sockets)
+		result.push_back(kv.first);
+	return result;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "events.hpp"
+
+
+struct perf_evlist;
+
+
+// System wide memory traffic of each socket, measured with the CAS counters of the integrated memory
+// controllers (uncore_imc_N PMUs). Reports the bytes read and written as cumulative counters, and the
+// bandwidth of the last interval and its utilization (if the peak bandwidth is known) as snapshots.
+class Uncore
+{
+	typedef std::chrono::steady_clock::time_point time_point_t;
+
+	struct Socket
+	{
+		struct perf_evlist *evlist = nullptr;
+		double last_bytes = 0;   // Bytes read and written until the last read
+		time_point_t last_time;
+	};
+
+	std::map<uint32_t, Socket> sockets;
+	std::vector<std::string> pmus;
+	double peak_bw = 0;          // Bytes per second
+
+	public:
+
+	// The peak bandwidth of each socket in GB/s, or 0 if it is not known
+	Uncore(double peak_bw_gbs = 0) : peak_bw(peak_bw_gbs * 1e9) {}
+
+	Uncore(const Uncore&) = delete;
+	Uncore& operator=(const Uncore&) = delete;
+	~Uncore() { clean(); }
+
+	void setup();
+	void clean();
+
+	counters_t read_counters(uint32_t socket);
+	std::vector<std::string> get_names() const;
+	std::vector<uint32_t> get_sockets() const;
+};
@@ -0,0 +1,47 @@
+#include <algorithm>
+
+#include <fmt/format.h>
+
+#include "events.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+counters_t CounterBackend::read_all_counters(pid_t pid)
+{
+	return counters_merge(read_counters(pid));
+}
+
+
+std::vector<std::string> CounterBackend::get_all_names(pid_t pid)
+{
+	auto result = std::vector<std::string>();
+	for (const auto &group : get_names(pid))
+	{
+		for (const auto &name : group)
+		{
+			if (std::find(result.begin(), result.end(), name) != result.end())
+				throw_with_trace(std::runtime_error("The event '{}' is in more than one group"_format(name)));
+			result.push_back(name);
+		}
+	}
+	return result;
+}
+
+
+counters_t counters_merge(const std::vector<counters_t> &groups)
+{
+	auto result = counters_t();
+	int id = 0;
+	for (const auto &group : groups)
+	{
+		for (const auto &c : group.get<by_id>())
+		{
+			if (!result.insert({id++, c.name, c.value, c.unit, c.snapshot, c.enabled, c.time_enabled, c.time_running}).second)
+				throw_with_trace(std::runtime_error("The event '{}' is in more than one group"_format(c.name)));
+		}
+	}
+	return result;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/identity.hpp>
+#include <boost/multi_index/member.hpp>
+
+
+namespace mi = boost::multi_index;
+
+
+struct Counter
+{
+	int id = 0;
+	std::string name = "";
+	double value = 0;
+	std::string unit = "";
+	bool snapshot = false;
+	double enabled = 0;
+	uint64_t time_enabled = 0; // Time (ns) the counter has been enabled and running, used to
+	uint64_t time_running = 0; // scale the value when the counter has been multiplexed
+
+	Counter() = default;
+	Counter(int id, const std::string &name, double value, const std::string &unit, bool snapshot, double enabled, uint64_t time_enabled = 0, uint64_t time_running = 0) :
+			id(id), name(name), value(value), unit(unit), snapshot(snapshot), enabled(enabled), time_enabled(time_enabled), time_running(time_running) {};
+	bool operator<(const Counter &c) const {return id < c.id;}
+};
+
+struct by_id {};
+struct by_name {};
+typedef mi::multi_index_container<
+	Counter,
+	mi::indexed_by<
+		// sort by Counter::operator<
+		mi::ordered_unique<mi::tag<by_id>, mi::identity<Counter> >,
+
+		// sort by less<string> on name
+		mi::ordered_unique<
+			mi::tag<by_name>,
+			mi::member<
+				Counter,
+				std::string,
+				&Counter::name
+			>
+		>
+	>
+> counters_t;
+
+
+// Joins the counters of several event groups in a single set, renumbering them consecutively
+// in group order. Throws if two groups have counters with the same name.
+counters_t counters_merge(const std::vector<counters_t> &groups);
+
+
+// Interface of the engines that count hardware events for the tasks (perf, PCM...)
+class CounterBackend
+{
+	public:
+
+	CounterBackend() = default;
+	virtual ~CounterBackend() = default;
+
+	virtual void init() = 0;
+	virtual void clean() = 0;
+	virtual void clean(pid_t pid) = 0;
+
+	// Each string is a comma separated list of events that are counted together
+	virtual void setup_events(pid_t pid, const std::vector<std::string> &groups) = 0;
+	virtual std::vector<counters_t> read_counters(pid_t pid) = 0;
+
+	// Reads the counters of several tasks at once, the next read_counters call for each of them returns these
+	// values instead of reading again. Engines that cannot batch the reads do nothing.
+	virtual void prefetch_counters(const std::vector<pid_t> &pids) {}
+
+	virtual std::vector<std::vector<std::string>> get_names(pid_t pid) = 0;
+	virtual void enable_counters(pid_t pid) = 0;
+	virtual void disable_counters(pid_t pid) = 0;
+	virtual void print_counters(pid_t pid) = 0;
+
+	// Counters and names of all the groups of a task, merged
+	counters_t read_all_counters(pid_t pid);
+	std::vector<std::string> get_all_names(pid_t pid);
+};
+
+typedef std::shared_ptr<CounterBackend> CounterBackend_ptr_t;
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include <fmt/format.h>
+
+#include "expr.hpp"
+#include "throw-with-trace.hpp"
+
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+static bool is_name_start(char c)
+{
+	return std::isalpha((unsigned char) c) || c == '_';
+}
+
+
+static bool is_name_char(char c)
+{
+	return std::isalnum((unsigned char) c) || c == '_' || c == '.' || c == ':' || c == '-';
+}
+
+
+// Recursive descent parser, it emits the bytecode in postfix order as it goes
+//   expr    := term (('+' | '-') term)*
+//   term    := unary (('*' | '/') unary)*
+//   unary   := '-' unary | primary
+//   primary := number | name | '(' expr ')'
+template <typename Emit>
+class ExprParser
+{
+	const string &text;
+	size_t pos = 0;
+	Emit emit;
+
+	void skip()
+	{
+		while (pos < text.size() && std::isspace((unsigned char) text[pos]))
+			pos++;
+	}
+
+	[[noreturn]] void error(const string &msg) const
+	{
+		throw_with_trace(std::runtime_error("Invalid expression '{}' at position {}: {}"_format(text, pos, msg)));
+	}
+
+	void expr()
+	{
+		term();
+		for (skip(); pos < text.size() && (text[pos] == '+' || text[pos] == '-'); skip())
+		{
+			const char op = text[pos++];
+			term();
+			emit(op, 0, "");
+		}
+	}
+
+	void term()
+	{
+		unary();
+		for (skip(); pos < text.size() && (text[pos] == '*' || text[pos] == '/'); skip())
+		{
+			const char op = text[pos++];
+			unary();
+			emit(op, 0, "");
+		}
+	}
+
+	void unary()
+	{
+		skip();
+		if (pos < text.size() && text[pos] == '-')
+		{
+			pos++;
+			unary();
+			emit('n', 0, "");
+			return;
+		}
+		primary();
+	}
+
+	void primary()
+	{
+		skip();
+		if (pos == text.size())
+			error("unexpected end");
+
+		if (text[pos] == '(')
+		{
+			pos++;
+			expr();
+			skip();
+			if (pos == text.size() || text[pos] != ')')
+				error("missing ')'");
+			pos++;
+		}
+		else if (std::isdigit((unsigned char) text[pos]) || text[pos] == '.')
+		{
+			const char *start = text.c_str() + pos;
+			char *end;
+			const double value = std::strtod(start, &end);
+			if (end == start)
+				error("invalid number");
+			pos += end - start;
+			emit('c', value, "");
+		}
+		else if (is_name_start(text[pos]))
+		{
+			const size_t start = pos;
+			while (pos < text.size() && is_name_char(text[pos]))
+				pos++;
+			emit('v', 0, text.substr(start, pos - start));
+		}
+		else
+		{
+			error("unexpected '{}'"_format(text[pos]));
+		}
+	}
+
+	public:
+
+	ExprParser(const string &text, Emit emit) : text(text), emit(emit) {}
+
+	void parse()
+	{
+		expr();
+		skip();
+		if (pos != text.size())
+			error("unexpected '{}'"_format(text[pos]));
+	}
+};
+
+
+Expr::Expr(const std::string &text) : text(text)
+{
+	size_t depth = 0;
+	auto emit = [this, &depth](char op, double value, const string &name)
+	{
+		switch (op)
+		{
+			case 'c':
+				code.push_back({Op::Const, 0, value});
+				depth++;
+				break;
+			case 'v':
+			{
+				auto it = std::find(vars.begin(), vars.end(), name);
+				if (it == vars.end())
+					it = vars.insert(vars.end(), name);
+				code.push_back({Op::Var, (uint32_t) (it - vars.begin()), 0});
+				depth++;
+				break;
+			}
+			case 'n':
+				code.push_back({Op::Neg, 0, 0});
+				break;
+			default:
+				code.push_back({op == '+' ? Op::Add : op == '-' ? Op::Sub : op == '*' ? Op::Mul : Op::Div, 0, 0});
+				depth--;
+				break;
+		}
+		if (depth > max_depth)
+			throw_with_trace(std::runtime_error("The expression '{}' is too deeply nested"_format(this->text)));
+	};
+
+	ExprParser<decltype(emit)>(text, emit).parse();
+}
+
+
+Expr Expr::bind(const std::vector<size_t> &slots) const
+{
+	if (slots.size() != vars.size())
+		throw_with_trace(std::runtime_error("The expression '{}' has {} variables, but {} slots were given"_format(
+				text, vars.size(), slots.size())));
+
+	Expr result = *this;
+	for (auto &instr : result.code)
+		if (instr.op == Op::Var)
+			instr.index = slots[instr.index];
+	return result;
+}
+
+
+double Expr::eval(const std::vector<double> &values) const
+{
+	double stack[max_depth];
+	size_t top = 0;
+
+	for (const auto &instr : code)
+	{
+		switch (instr.op)
+		{
+			case Op::Const: stack[top++] = instr.value; break;
+			case Op::Var:   stack[top++] = values[instr.index]; break;
+			case Op::Add:   top--; stack[top - 1] += stack[top]; break;
+			case Op::Sub:   top--; stack[top - 1] -= stack[top]; break;
+			case Op::Mul:   top--; stack[top - 1] *= stack[top]; break;
+			case Op::Div:   top--; stack[top - 1] /= stack[top]; break;
+			case Op::Neg:   stack[top - 1] = -stack[top - 1]; break;
+		}
+	}
+	return stack[0];
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Arithmetic expression over named variables, e.g. '1000 * LLC_MISSES / instructions', compiled once into a stack
+// bytecode and then evaluated as many times as needed. It supports numbers, variables, the four basic operations,
+// unary minus and parentheses. Variable names can contain letters, digits and the characters '_', '.', ':' and '-',
+// so a subtraction needs spaces around the sign ('cycles - stalls', not 'cycles-stalls').
+class Expr
+{
+	enum class Op : uint8_t {Const, Var, Add, Sub, Mul, Div, Neg};
+
+	struct Instr
+	{
+		Op op;
+		uint32_t index;   // Variable, for Var
+		double value;     // Constant, for Const
+	};
+
+	std::string text;
+	std::vector<std::string> vars;  // Variables, in order of first appearance
+	std::vector<Instr> code;
+
+	public:
+
+	// Deepest stack an expression can need
+	static const size_t max_depth = 64;
+
+	Expr() = default;
+	Expr(const std::string &text);
+
+	const std::string& str() const { return text; }
+
+	// Names of the variables, the values passed to eval are indexed like them
+	const std::vector<std::string>& variables() const { return vars; }
+
+	// Copy of the expression whose variable i is the value slots[i], so it can be evaluated directly on a vector
+	// with more values, e.g. all the counters of a task
+	Expr bind(const std::vector<size_t> &slots) const;
+
+	double eval(const std::vector<double> &values) const;
+};
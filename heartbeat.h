@@ -0,0 +1,98 @@
+#pragma once
+
+// Heartbeats of an application for the manager, to report its progress as it perceives it (requests served, their
+// latency...) along with the hardware counters. The application, or a library preloaded into it, creates a ring of
+// records in shared memory, /dev/shm/heartbeat.<pid>, and appends a record each time it completes some work:
+//
+//     struct heartbeat_ring *hb = heartbeat_open(NULL);
+//     ...
+//     heartbeat(hb, 1, latency_ns);  // A request has been served in latency_ns
+//
+// The manager reads the new records each interval. Writing is lock-free and safe from several threads: a writer
+// claims a slot by incrementing 'head', invalidates its sequence number, fills it and publishes it by setting the
+// sequence number to its index plus one. The reader takes the records whose sequence number is the expected one before
+// and after copying them. If the application writes more than HEARTBEAT_SLOTS records in an interval the oldest ones
+// are overwritten and lost. Plain C, so any application can include it.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+#define HEARTBEAT_MAGIC   0x31544248u  // "HBT1"
+#define HEARTBEAT_VERSION 1u
+#define HEARTBEAT_SLOTS   4096u        // A power of two
+#define HEARTBEAT_DIR     "/dev/shm"
+
+
+struct heartbeat_record
+{
+	uint64_t seq;         // Index of the record plus one, 0 while it is being written
+	uint64_t items;       // Units of work completed, e.g. requests
+	uint64_t latency_ns;  // Latency of that work, e.g. of the request or the mean of the batch
+	uint64_t reserved;
+};
+
+
+struct heartbeat_ring
+{
+	uint32_t magic;       // Set last, when the ring is ready
+	uint32_t version;
+	uint32_t slots;
+	uint32_t reserved;
+	uint64_t head;        // Records claimed by the writers, in a cache line of its own
+	uint64_t pad[5];
+	struct heartbeat_record records[HEARTBEAT_SLOTS];
+};
+
+
+// Creates the ring of this process in 'dir', HEARTBEAT_DIR if it is NULL. Returns NULL on error.
+static inline struct heartbeat_ring* heartbeat_open(const char *dir)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "%s/heartbeat.%d", dir ? dir : HEARTBEAT_DIR, (int) getpid());
+
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, sizeof(struct heartbeat_ring)) < 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	void *p = mmap(NULL, sizeof(struct heartbeat_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	struct heartbeat_ring *hb = (struct heartbeat_ring *) p;
+	hb->version = HEARTBEAT_VERSION;
+	hb->slots = HEARTBEAT_SLOTS;
+	__atomic_store_n(&hb->magic, HEARTBEAT_MAGIC, __ATOMIC_RELEASE);
+	return hb;
+}
+
+
+static inline void heartbeat(struct heartbeat_ring *hb, uint64_t items, uint64_t latency_ns)
+{
+	if (!hb)
+		return;
+
+	const uint64_t n = __atomic_fetch_add(&hb->head, 1, __ATOMIC_RELAXED);
+	struct heartbeat_record *r = &hb->records[n & (HEARTBEAT_SLOTS - 1)];
+
+	__atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&r->items, items, __ATOMIC_RELAXED);
+	__atomic_store_n(&r->latency_ns, latency_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&r->seq, n + 1, __ATOMIC_RELEASE);
+}
+
+
+static inline void heartbeat_close(struct heartbeat_ring *hb)
+{
+	if (hb)
+		munmap(hb, sizeof(struct heartbeat_ring));
+}
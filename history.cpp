@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <cstring>
+
+#include <fmt/format.h>
+
+#include "events-db.hpp"
+#include "history.hpp"
+#include "throw-with-trace.hpp"
+
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+static uint64_t mask(size_t n)
+{
+	return n == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << n) - 1;
+}
+
+
+static uint64_t to_bits(double value)
+{
+	uint64_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+
+static double from_bits(uint64_t bits)
+{
+	double value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+
+// Writes the n low bits of the value, the most significant first
+void History::Stream::write(uint64_t value, size_t n)
+{
+	value &= mask(n);
+	const size_t offset = bits % 64;
+	const size_t room = 64 - offset;
+	if (offset == 0)
+		words.push_back(0);
+	if (n <= room)
+	{
+		words.back() |= value << (room - n);
+	}
+	else
+	{
+		words.back() |= value >> (n - room);
+		words.push_back(value << (64 - (n - room)));
+	}
+	bits += n;
+}
+
+
+// The first value is stored as is. The next ones are XORed with the previous one: 0 if they are equal, otherwise 1,
+// the leading zeros of the XOR (6 bits), its length without the leading and trailing zeros minus 1 (6 bits) and
+// the bits in between.
+void History::Stream::append(double value)
+{
+	const uint64_t v = to_bits(value);
+	if (bits == 0)
+	{
+		write(v, 64);
+	}
+	else
+	{
+		const uint64_t x = v ^ last;
+		if (x == 0)
+		{
+			write(0, 1);
+		}
+		else
+		{
+			const size_t lz = __builtin_clzll(x);
+			const size_t tz = __builtin_ctzll(x);
+			const size_t len = 64 - lz - tz;
+			write(1, 1);
+			write(lz, 6);
+			write(len - 1, 6);
+			write(x >> tz, len);
+		}
+	}
+	last = v;
+}
+
+
+static uint64_t read(const vector<uint64_t> &words, size_t &pos, size_t n)
+{
+	const size_t word = pos / 64;
+	const size_t room = 64 - pos % 64;
+	uint64_t value;
+	if (n <= room)
+		value = (words[word] >> (room - n)) & mask(n);
+	else
+		value = ((words[word] & mask(room)) << (n - room)) | (words[word + 1] >> (64 - (n - room)));
+	pos += n;
+	return value;
+}
+
+
+History::History(const std::vector<std::string> &names, size_t length, size_t archive) :
+		names(names), width(names.size()), length(length), archive(archive), rows(length * names.size())
+{
+	if (length == 0)
+		throw_with_trace(std::runtime_error("The history must keep at least one interval"));
+}
+
+
+void History::push(const std::vector<double> &row)
+{
+	if (row.size() != width)
+		throw_with_trace(std::runtime_error("The history has {} metrics, but {} values were given"_format(width, row.size())));
+
+	// When the ring is full the next position holds the oldest row
+	if (count == length && archive)
+		archive_row(&rows[head * width]);
+
+	std::copy(row.begin(), row.end(), rows.begin() + head * width);
+	head = (head + 1) % length;
+	count = std::min(count + 1, length);
+}
+
+
+void History::archive_row(const double *row)
+{
+	if (blocks.empty() || blocks.back().rows == block_rows)
+	{
+		blocks.emplace_back();
+		blocks.back().streams.resize(width);
+	}
+
+	auto &block = blocks.back();
+	for (size_t c = 0; c < width; c++)
+		block.streams[c].append(row[c]);
+	block.rows++;
+	archived++;
+
+	// Drop whole blocks, as long as the archive keeps at least the intervals requested
+	while (blocks.size() > 1 && archived - blocks.front().rows >= archive)
+	{
+		archived -= blocks.front().rows;
+		blocks.pop_front();
+	}
+}
+
+
+void History::decode(const Block &block, size_t column, std::vector<double> &out) const
+{
+	const auto &words = block.streams[column].words;
+	size_t pos = 0;
+	uint64_t last = read(words, pos, 64);
+	out.push_back(from_bits(last));
+	for (size_t r = 1; r < block.rows; r++)
+	{
+		if (read(words, pos, 1))
+		{
+			const size_t lz = read(words, pos, 6);
+			const size_t len = read(words, pos, 6) + 1;
+			last ^= read(words, pos, len) << (64 - lz - len);
+		}
+		out.push_back(from_bits(last));
+	}
+}
+
+
+size_t History::column(const std::string &name) const
+{
+	auto it = std::find(names.begin(), names.end(), name);
+	if (it == names.end())
+	{
+		const string canonical = event_db_canonical(name);
+		it = std::find_if(names.begin(), names.end(), [&canonical](const string &n) { return event_db_canonical(n) == canonical; });
+	}
+	if (it == names.end())
+		throw_with_trace(std::runtime_error("The metric '{}' is not in the history"_format(name)));
+	return it - names.begin();
+}
+
+
+const double* History::row(size_t age) const
+{
+	if (age >= count)
+		throw_with_trace(std::runtime_error("There are only {} recent intervals in the history"_format(count)));
+	return &rows[((head + length - 1 - age) % length) * width];
+}
+
+
+std::vector<double> History::slice(size_t column, size_t n) const
+{
+	if (column >= width)
+		throw_with_trace(std::runtime_error("The history has only {} metrics"_format(width)));
+
+	const size_t total = size();
+	if (n == 0 || n > total)
+		n = total;
+	size_t skip = total - n;
+
+	auto result = vector<double>();
+	result.reserve(n);
+
+	// Only the blocks with some of the intervals are decoded
+	for (const auto &block : blocks)
+	{
+		if (skip >= block.rows)
+		{
+			skip -= block.rows;
+			continue;
+		}
+		auto values = vector<double>();
+		decode(block, column, values);
+		result.insert(result.end(), values.begin() + skip, values.end());
+		skip = 0;
+	}
+
+	for (size_t age = count - skip; age-- > 0;)
+		result.push_back(row(age)[column]);
+
+	return result;
+}
+
+
+double History::trend(size_t column, size_t n) const
+{
+	const auto y = slice(column, n);
+	if (y.size() < 2)
+		return 0;
+
+	const double xm = (y.size() - 1) / 2.0;
+	double ym = 0;
+	for (const auto &v : y)
+		ym += v;
+	ym /= y.size();
+
+	double num = 0, den = 0;
+	for (size_t x = 0; x < y.size(); x++)
+	{
+		num += (x - xm) * (y[x] - ym);
+		den += (x - xm) * (x - xm);
+	}
+	return num / den;
+}
+
+
+std::vector<double> History::gradients(size_t n) const
+{
+	auto result = vector<double>();
+	for (size_t c = 0; c < width; c++)
+		result.push_back(trend(c, n));
+	return result;
+}
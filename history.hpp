@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+
+// Values of the metrics of a task in its last intervals. The last 'length' intervals are kept as rows in a flat ring
+// buffer. Optionally, the ones that fall out of it are compressed into an archive of up to 'archive' more intervals,
+// in blocks that encode each metric on its own with the XOR scheme of Gorilla (Pelkonen et al., 2015): a value that
+// repeats takes one bit, and one that changes only its low bits a few more. The memory used is bounded either way.
+class History
+{
+	// Bit stream of the values of one metric in a block
+	struct Stream
+	{
+		std::vector<uint64_t> words;
+		size_t bits = 0;
+		uint64_t last = 0;  // Last value written, as bits
+
+		void write(uint64_t value, size_t n);
+		void append(double value);
+	};
+
+	struct Block
+	{
+		size_t rows = 0;
+		std::vector<Stream> streams;  // One per metric
+	};
+
+	static const size_t block_rows = 256;
+
+	std::vector<std::string> names;
+	size_t width = 0;
+	size_t length = 0;
+	size_t archive = 0;
+
+	std::vector<double> rows;  // length * width values
+	size_t head = 0;           // Where the next row goes
+	size_t count = 0;          // Rows in the ring
+
+	std::deque<Block> blocks;  // Oldest first
+	size_t archived = 0;       // Rows in the blocks
+
+	void archive_row(const double *row);
+	void decode(const Block &block, size_t column, std::vector<double> &out) const;
+
+	public:
+
+	History() = default;
+	History(const std::vector<std::string> &names, size_t length, size_t archive = 0);
+
+	// Appends the values of an interval, in the order of the names
+	void push(const std::vector<double> &row);
+
+	const std::vector<std::string>& metrics() const { return names; }
+
+	// Column of a metric, by its exact name or by its portable name if it is a known event
+	size_t column(const std::string &name) const;
+
+	// Intervals stored, the most recent ones are in the ring buffer and can be accessed row by row
+	size_t size() const { return count + archived; }
+	size_t recent() const { return count; }
+
+	// Values of the interval 'age' intervals ago, 0 being the last one. Only for the ones in the ring buffer.
+	const double* row(size_t age) const;
+
+	// Values of a metric in the last 'n' intervals (all if 0, or fewer if there are not so many), the oldest first
+	std::vector<double> slice(size_t column, size_t n = 0) const;
+	std::vector<double> slice(const std::string &name, size_t n = 0) const { return slice(column(name), n); }
+
+	// Slope of the least squares line through the values of a metric in the last 'n' intervals, i.e. its change per
+	// interval. It is 0 with less than two intervals.
+	double trend(size_t column, size_t n = 0) const;
+	double trend(const std::string &name, size_t n = 0) const { return trend(column(name), n); }
+
+	// Trends of all the metrics, in the order of the names
+	std::vector<double> gradients(size_t n = 0) const;
+};
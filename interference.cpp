@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cmath>
+
+#include <fmt/format.h>
+
+#include "interference.hpp"
+#include "throw-with-trace.hpp"
+
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+InterferenceGraph::InterferenceGraph(const std::vector<std::string> &pressure, const std::string &victim, double half_life) :
+		pressure(pressure), victim(victim), alpha(1 - std::exp2(-1.0 / half_life))
+{
+	if (pressure.empty())
+		throw_with_trace(std::runtime_error("The interference graph needs at least one pressure metric"));
+	if (half_life <= 0)
+		throw_with_trace(std::runtime_error("The interference graph needs a positive half life"));
+}
+
+
+void InterferenceGraph::init(size_t tasks)
+{
+	const size_t metrics = pressure.size();
+	this->tasks = tasks;
+	perf_mean.assign(tasks, 0);
+	perf_var.assign(tasks, 0);
+	press_mean.assign(tasks * metrics, 0);
+	press_var.assign(tasks * metrics, 0);
+	cov.assign(tasks * tasks * metrics, 0);
+}
+
+
+void InterferenceGraph::update(const std::vector<double> &perf, const std::vector<double> &press)
+{
+	const size_t metrics = pressure.size();
+	if (n == 0)
+		init(perf.size());
+	if (perf.size() != tasks || press.size() != tasks * metrics)
+		throw_with_trace(std::runtime_error("The interference graph has {} tasks and {} pressure metrics, but {} and {} values were given"_format(
+				tasks, metrics, perf.size(), press.size())));
+
+	// The first values are the means
+	if (n++ == 0)
+	{
+		perf_mean = perf;
+		press_mean = press;
+		return;
+	}
+
+	// Deviations from the means before updating them, i.e. the bursts and the drops
+	auto dperf = vector<double>(tasks);
+	auto dpress = vector<double>(tasks * metrics);
+	for (size_t i = 0; i < tasks; i++)
+		dperf[i] = perf[i] - perf_mean[i];
+	for (size_t k = 0; k < tasks * metrics; k++)
+		dpress[k] = press[k] - press_mean[k];
+
+	for (size_t i = 0; i < tasks; i++)
+		for (size_t k = 0; k < tasks * metrics; k++)
+		{
+			double &c = cov[i * tasks * metrics + k];
+			c = (1 - alpha) * (c + alpha * dperf[i] * dpress[k]);
+		}
+
+	for (size_t i = 0; i < tasks; i++)
+	{
+		perf_var[i] = (1 - alpha) * (perf_var[i] + alpha * dperf[i] * dperf[i]);
+		perf_mean[i] += alpha * dperf[i];
+	}
+	for (size_t k = 0; k < tasks * metrics; k++)
+	{
+		press_var[k] = (1 - alpha) * (press_var[k] + alpha * dpress[k] * dpress[k]);
+		press_mean[k] += alpha * dpress[k];
+	}
+}
+
+
+void InterferenceGraph::update(const std::vector<Task> &tasklist)
+{
+	auto perf = vector<double>();
+	auto press = vector<double>();
+	for (const auto &task : tasklist)
+	{
+		const History &hist = task.stats.history();
+		try
+		{
+			const double *row = hist.row(0);
+			perf.push_back(row[hist.column(victim)]);
+			for (const auto &p : pressure)
+				press.push_back(row[hist.column(p)]);
+		}
+		catch (const std::exception &e)
+		{
+			std::string msg = "The interference graph requires the metrics " + victim;
+			for (const auto &p : pressure)
+				msg += ", " + p;
+			msg += ". The metrics monitorized are:";
+			for (const auto &m : hist.metrics())
+				msg += "\n" + m;
+			throw_with_trace(std::runtime_error(msg));
+		}
+	}
+	update(perf, press);
+}
+
+
+double InterferenceGraph::at(size_t victim, size_t aggressor) const
+{
+	if (victim >= tasks || aggressor >= tasks)
+		throw_with_trace(std::runtime_error("The interference graph has only {} tasks"_format(tasks)));
+	if (victim == aggressor)
+		return 0;
+
+	// The performance drops when the pressure bursts, so the correlation is negative
+	const size_t metrics = pressure.size();
+	double result = 0;
+	for (size_t m = 0; m < metrics; m++)
+	{
+		const size_t k = aggressor * metrics + m;
+		const double den = std::sqrt(perf_var[victim] * press_var[k]);
+		if (den > 0)
+			result = std::max(result, -cov[victim * tasks * metrics + k] / den);
+	}
+	return std::min(result, 1.0);
+}
+
+
+std::vector<std::vector<double>> InterferenceGraph::matrix() const
+{
+	auto result = vector<vector<double>>(tasks, vector<double>(tasks));
+	for (size_t i = 0; i < tasks; i++)
+		for (size_t j = 0; j < tasks; j++)
+			result[i][j] = at(i, j);
+	return result;
+}
+
+
+void InterferenceGraph::print_headers(std::ostream &out, const std::string &sep) const
+{
+	out << "interval" << sep << "victim" << sep << "aggressor" << sep << "interference" << std::endl;
+}
+
+
+// One row per pair of tasks, identified by their ids
+void InterferenceGraph::print(uint64_t interval, const std::vector<Task> &tasklist, std::ostream &out, const std::string &sep) const
+{
+	for (size_t i = 0; i < tasks; i++)
+		for (size_t j = 0; j < tasks; j++)
+			if (i != j)
+				out << interval << sep << tasklist[i].id << sep << tasklist[j].id << sep << at(i, j) << std::endl;
+}
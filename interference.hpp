@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "task.hpp"
+
+
+// Pairwise estimate of how much each task hurts the others, from the metric history of the tasks. The interference
+// of an aggressor on a victim is the correlation between the bursts of the aggressor in some pressure metric (e.g. LLC
+// misses or memory bandwidth) and the drops of the victim in some performance metric (e.g. IPC), taking the pressure
+// metric with the strongest correlation. It goes from 0, no interference, to 1. The bursts and drops are the
+// deviations from exponentially weighted means, and the correlations are updated incrementally each interval with
+// exponentially weighted (co)variances, so old intervals lose weight every 'half_life' intervals and the estimate
+// follows the phases of the tasks.
+class InterferenceGraph
+{
+	std::vector<std::string> pressure;
+	std::string victim;
+	double alpha;
+
+	size_t tasks = 0;
+	uint64_t n = 0;
+
+	// Means and variances of the performance of each task and of its pressure in each metric
+	std::vector<double> perf_mean, perf_var;
+	std::vector<double> press_mean, press_var;  // tasks * metrics
+
+	// Covariance of the performance of each victim and the pressure of each aggressor in each metric
+	std::vector<double> cov;  // tasks * tasks * metrics
+
+	void init(size_t tasks);
+
+	public:
+
+	InterferenceGraph(const std::vector<std::string> &pressure = {"llc_misses"}, const std::string &victim = "ipc",
+			double half_life = 16);
+
+	// Adds the performance of each task and its pressure in each metric (tasks * metrics values) in an interval
+	void update(const std::vector<double> &perf, const std::vector<double> &press);
+
+	// Same, with the values of the last interval in the history of the tasks
+	void update(const std::vector<Task> &tasklist);
+
+	// Interference of a task on another, by their positions in the task list
+	double at(size_t victim, size_t aggressor) const;
+
+	// Interference of each task (columns) on each other (rows)
+	std::vector<std::vector<double>> matrix() const;
+
+	size_t size() const { return tasks; }
+
+	void print_headers(std::ostream &out, const std::string &sep = ",") const;
+	void print(uint64_t interval, const std::vector<Task> &tasklist, std::ostream &out, const std::string &sep = ",") const;
+};
@@ -98,7 +98,7 @@ static int read_counter(struct perf_evlist *evsel_list, struct perf_evsel *count
 }
 
 
-void read_counters(struct perf_evlist *evsel_list, const char **names, double *results, const char **units, bool *snapshot, double *enabled)
+void read_counters(struct perf_evlist *evsel_list, const char **names, double *results, const char **units, bool *snapshot, double *enabled, uint64_t *time_enabled, uint64_t *time_running)
 {
 	struct perf_evsel *counter;
 	struct perf_stat_config stat_config =
@@ -142,6 +142,10 @@ void read_counters(struct perf_evlist *evsel_list, const char **names, double *r
 			snapshot[i] = counter->snapshot;
 		if (enabled)
 			enabled[i] = run == ena ? 1 : (double) run / (double) ena;
+		if (time_enabled)
+			time_enabled[i] = ena;
+		if (time_running)
+			time_running[i] = run;
 		i++;
 	}
 }
@@ -208,16 +212,12 @@ void print_counters2(struct perf_evlist *evsel_list, struct timespec *ts)
 }
 
 
-struct perf_evlist* setup_events(const char *pid, const char *events)
+static struct perf_evlist* setup_events_target(struct target *target, const char *events)
 {
 	struct perf_evlist	*evsel_list = NULL;
 	bool group = false;
 
-	struct target target = {
-		.uid	= UINT_MAX,
-		.pid = pid,
-	};
-	target__validate(&target);
+	target__validate(target);
 
 	evsel_list = perf_evlist__new();
 	if (evsel_list == NULL)
@@ -228,10 +228,12 @@ struct perf_evlist* setup_events(const char *pid, const char *events)
 		goto out;
 	}
 
-	if (perf_evlist__create_maps(evsel_list, &target) < 0)
+	if (perf_evlist__create_maps(evsel_list, target) < 0)
 	{
-		assert(target__has_task(&target));
-		pr_err("Problems finding threads of monitor\n");
+		if (target__has_task(target))
+			pr_err("Problems finding threads of monitor\n");
+		else
+			pr_err("Problems parsing the list of cpus to monitor\n");
 		goto out;
 	}
 	cpu_map__put(evsel_list->cpus);
@@ -247,7 +249,7 @@ struct perf_evlist* setup_events(const char *pid, const char *events)
 	struct perf_evsel *counter;
 	evlist__for_each_entry(evsel_list, counter)
 	{
-		if (create_perf_stat_counter(evsel_list, counter, &target) < 0)
+		if (create_perf_stat_counter(evsel_list, counter, target) < 0)
 			exit(-1);
 		counter->supported = true;
 	}
@@ -274,6 +276,31 @@ out:
 }
 
 
+struct perf_evlist* setup_events(const char *pid, const char *events)
+{
+	struct target target = {
+		.uid	= UINT_MAX,
+		.pid = pid,
+	};
+	return setup_events_target(&target, events);
+}
+
+
+/*
+ * Count the events system wide in the given cpus (e.g. "0,12"). This is
+ * needed for uncore events, which are not associated with any task.
+ */
+struct perf_evlist* setup_events_cpu(const char *cpu_list, const char *events)
+{
+	struct target target = {
+		.uid	= UINT_MAX,
+		.cpu_list = cpu_list,
+		.system_wide = true,
+	};
+	return setup_events_target(&target, events);
+}
+
+
 void print_counters(struct perf_evlist *evsel_list)
 {
 	struct perf_evsel *counter;
@@ -311,7 +338,7 @@ void clean(struct perf_evlist *evlist)
 	 * group leaders.
 	 */
 	disable_counters(evlist);
-	read_counters(evlist, NULL, NULL, NULL, NULL, NULL);
+	read_counters(evlist, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
 	perf_evlist__close(evlist);
 	perf_evlist__free_stats(evlist);
 	perf_evlist__delete(evlist);
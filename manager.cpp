@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <clocale>
 #include <iostream>
 #include <thread>
 
+#include <boost/algorithm/string/join.hpp>
 #include <boost/program_options.hpp>
 #include <boost/stacktrace.hpp>
 #include <fmt/format.h>
@@ -12,21 +14,24 @@
 #include "cat-policy.hpp"
 #include "common.hpp"
 #include "config.hpp"
+#include "events-bpf.hpp"
+#include "events-db.hpp"
+#include "events-direct.hpp"
+#include "events-heartbeat.hpp"
+#include "events-intel.hpp"
+#include "events-libpfm.hpp"
+#include "events-msr.hpp"
+#include "events-pebs.hpp"
 #include "events-perf.hpp"
+#include "events-resctrl.hpp"
+#include "events-time.hpp"
+#include "interference.hpp"
 #include "log.hpp"
 #include "stats.hpp"
+#include "sys-stats.hpp"
 #include "task.hpp"
-
-
-// Some predefined events, used when no events are supplied, but only tested in the Intel Xeon e5 2658A v3, so be carefull
-#define L1_HITS   "cpu/umask=0x01,event=0xD1,name=MEM_LOAD_UOPS_RETIRED.L1_HIT/"
-#define L1_MISSES "cpu/umask=0x08,event=0xD1,name=MEM_LOAD_UOPS_RETIRED.L1_MISS/"
-#define L2_HITS   "cpu/umask=0x02,event=0xD1,name=MEM_LOAD_UOPS_RETIRED.L2_HIT/"
-#define L2_MISSES "cpu/umask=0x10,event=0xD1,name=MEM_LOAD_UOPS_RETIRED.L2_MISS/"
-#define L3_HITS   "cpu/umask=0x04,event=0xD1,name=MEM_LOAD_UOPS_RETIRED.L3_HIT/"
-#define L3_MISSES "cpu/umask=0x20,event=0xD1,name=MEM_LOAD_UOPS_RETIRED.L3_MISS/"
-#define STALLS_L2_PENDING  "cpu/umask=0x05,event=0xA3,name=CYCLE_ACTIVITY.STALLS_L2_PENDING,cmask=5/"
-#define STALLS_LDM_PENDING "cpu/umask=0x06,event=0xA3,name=CYCLE_ACTIVITY.STALLS_LDM_PENDING,cmask=6/"
+#include "topology.hpp"
+#include "workload-stats.hpp"
 
 
 namespace po = boost::program_options;
@@ -42,13 +47,25 @@ using std::endl;
 using fmt::literals::operator""_format;
 
 typedef std::shared_ptr<CAT> CAT_ptr_t;
+
+
+// Optional per task collectors that complement perf
+struct TaskMonitors
+{
+	std::shared_ptr<ResctrlMon> resctrl;
+	std::shared_ptr<MSRMon> msr;
+	std::shared_ptr<PEBSMon> pebs;
+	std::shared_ptr<TimeMon> time;
+	std::shared_ptr<HeartbeatMon> heartbeat;
+};
 typedef std::chrono::system_clock::time_point time_point_t;
 
 
 CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist);
-void loop(vector<Task> &tasklist, std::shared_ptr<cat::policy::Base> catpol, Perf &perf, const vector<string> &events, uint64_t time_int_us, uint32_t max_int, std::ostream &out, std::ostream &ucompl_out, std::ostream &total_out);
-void clean(vector<Task> &tasklist, CAT_ptr_t cat, Perf &perf);
-[[noreturn]] void clean_and_die(vector<Task> &tasklist, CAT_ptr_t cat, Perf &perf);
+CounterBackend_ptr_t counters_setup(const string &kind);
+void loop(vector<Task> &tasklist, std::shared_ptr<cat::policy::Base> catpol, CounterBackend &perf, TaskMonitors &mon, SysStats &sys, const vector<string> &events, uint64_t time_int_us, uint32_t max_int, std::ostream &out, std::ostream &ucompl_out, std::ostream &total_out, std::ostream &sys_out, std::ostream &sys_total_out, std::ostream &wl_out, std::ostream &wl_total_out, std::shared_ptr<InterferenceGraph> interference, std::ostream *if_out);
+void clean(vector<Task> &tasklist, CAT_ptr_t cat, CounterBackend &perf, TaskMonitors &mon);
+[[noreturn]] void clean_and_die(vector<Task> &tasklist, CAT_ptr_t cat, CounterBackend &perf, TaskMonitors &mon);
 std::string program_options_to_string(const std::vector<po::option>& raw);
 void adjust_time(const time_point_t &start_int, const time_point_t &start_glob, const uint64_t interval, const uint64_t time_int_us, int64_t &adj_delay_us);
 
@@ -80,16 +97,113 @@ CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist)
 }
 
 
+// Names of the counters of a task, from perf and from the enabled monitors
+vector<string> task_counter_names(CounterBackend &perf, const TaskMonitors &mon, pid_t pid)
+{
+	auto names = perf.get_all_names(pid);
+	auto append = [&names](const vector<string> &v) { names.insert(names.end(), v.begin(), v.end()); };
+	if (mon.resctrl)
+		append(mon.resctrl->get_names());
+	if (mon.msr)
+		append(mon.msr->get_names());
+	if (mon.pebs)
+		append(mon.pebs->get_names());
+	if (mon.time)
+		append(mon.time->get_names());
+	if (mon.heartbeat)
+		append(mon.heartbeat->get_names());
+	return names;
+}
+
+
+counters_t task_read_counters(CounterBackend &perf, TaskMonitors &mon, pid_t pid)
+{
+	auto groups = vector<counters_t>{perf.read_all_counters(pid)};
+	if (mon.resctrl)
+		groups.push_back(mon.resctrl->read_counters(pid));
+	if (mon.msr)
+		groups.push_back(mon.msr->read_counters(pid));
+	if (mon.pebs)
+		groups.push_back(mon.pebs->read_counters(pid));
+	if (mon.time)
+		groups.push_back(mon.time->read_counters(pid));
+	if (mon.heartbeat)
+		groups.push_back(mon.heartbeat->read_counters(pid));
+	return counters_merge(groups);
+}
+
+
+void task_monitors_setup(TaskMonitors &mon, const Task &task)
+{
+	if (mon.resctrl)
+		mon.resctrl->setup(task.pid);
+	if (mon.msr)
+		mon.msr->setup(task.pid);
+	if (mon.pebs)
+		mon.pebs->setup(task.pid);
+	if (mon.heartbeat)
+		mon.heartbeat->setup(task.pid);
+	if (mon.time)
+		mon.time->setup(task.pid);
+}
+
+
+void task_monitors_clean(TaskMonitors &mon, pid_t pid)
+{
+	if (mon.resctrl)
+		mon.resctrl->clean(pid);
+	if (mon.msr)
+		mon.msr->clean(pid);
+	if (mon.pebs)
+		mon.pebs->clean(pid);
+	if (mon.heartbeat)
+		mon.heartbeat->clean(pid);
+	if (mon.time)
+		mon.time->clean(pid);
+}
+
+
+CounterBackend_ptr_t counters_setup(const string &kind)
+{
+	LOGINF("Using {} to count events"_format(kind));
+	CounterBackend_ptr_t counters;
+	if (kind == "perf")
+		counters = std::make_shared<Perf>();
+	else if (kind == "perf-cpu")
+		counters = std::make_shared<PerfCPU>();
+	else if (kind == "pcm")
+		counters = std::make_shared<PCMCounters>();
+	else if (kind == "pfm")
+		counters = std::make_shared<PFM>();
+	else if (kind == "direct")
+		counters = std::make_shared<PerfDirect>();
+	else if (kind == "bpf")
+		counters = std::make_shared<BPFCounters>();
+	else
+		throw_with_trace(std::runtime_error("Unknown counters implementation '{}'"_format(kind)));
+	counters->init();
+	return counters;
+}
+
+
 void loop(
 		vector<Task> &tasklist,
 		std::shared_ptr<cat::policy::Base> catpol,
-		Perf &perf,
+		CounterBackend &perf,
+		TaskMonitors &mon,
+		SysStats &sys,
 		const vector<string> &events,
 		uint64_t time_int_us,
 		uint32_t max_int,
 		std::ostream &out,
 		std::ostream &ucompl_out,
-		std::ostream &total_out)
+		std::ostream &total_out,
+		std::ostream &sys_out,
+		std::ostream &sys_total_out,
+		std::ostream &wl_out,
+		std::ostream &wl_total_out,
+		std::shared_ptr<InterferenceGraph> interference,
+		std::ostream *if_out)
 {
 	if (time_int_us <= 0)
 		throw_with_trace(std::runtime_error("Interval time must be positive and greater than 0"));
@@ -98,20 +212,45 @@ void loop(
 
 	// Prepare Perf to measure events and initialize stats
 	for (auto &task : tasklist)
-		task.stats.init(perf.get_names(task.pid)[0]);
+		task.stats.init(task_counter_names(perf, mon, task.pid));
+
+	// The throughput and fairness of the workload need the IPC of the tasks, alone and now
+	bool workload = workload_has_references(tasklist);
+	if (workload && !std::all_of(tasklist.begin(), tasklist.end(), [](const Task &t) { return t.stats.events.count("ipc"); }))
+	{
+		LOGWAR("The throughput and fairness metrics need the instructions and cycles of the tasks");
+		workload = false;
+	}
+	if (workload)
+	{
+		workload_print_headers(wl_out);
+		workload_print_headers(wl_total_out);
+	}
+
+	if (interference && if_out)
+		interference->print_headers(*if_out);
 
 	// Print headers
 	task_stats_print_headers(tasklist[0], out);
 	task_stats_print_headers(tasklist[0], ucompl_out);
 	task_stats_print_headers(tasklist[0], total_out);
+	if (sys.enabled())
+	{
+		sys.print_headers(sys_out);
+		sys.print_headers(sys_total_out);
+	}
 
 	// First reading of counters
 	for (auto &task : tasklist)
-	{
 		perf.enable_counters(task.pid);
-		const counters_t counters = perf.read_counters(task.pid)[0];
+	perf.prefetch_counters(tasks_pids(tasklist));
+	for (auto &task : tasklist)
+	{
+		const counters_t counters = task_read_counters(perf, mon, task.pid);
 		task.stats.accum(counters);
 	}
+	if (sys.enabled())
+		sys.accum(tasklist);
 
 	// Loop
 	uint32_t interval;
@@ -132,12 +271,15 @@ void loop(
 		tasks_pause(tasklist);
 		LOGDEB("Slept for {} us"_format(adj_delay_us));
 
-		// Read stats
+		// Read stats, the counters of all the tasks at once if the engine can
+		perf.prefetch_counters(tasks_pids(tasklist));
 		for (auto &task : tasklist)
 		{
-			const counters_t counters = perf.read_counters(task.pid)[0];
+			const counters_t counters = task_read_counters(perf, mon, task.pid);
 			task.stats.accum(counters);
 		}
+		if (sys.enabled())
+			sys.accum(tasklist);
 
 		// Process tasks...
 		for (auto &task : tasklist)
@@ -163,13 +305,33 @@ void loop(
 			// Print interval stats
 			task_stats_print_interval(task, interval, out);
 		}
+		if (sys.enabled())
+			sys.print_interval(interval, sys_out);
+		if (workload)
+			workload_print(interval, workload_metrics(tasklist), wl_out);
+
+		// Update the interference between the tasks before the policy uses it
+		if (interference)
+		{
+			interference->update(tasklist);
+			if (if_out)
+				interference->print(interval, tasklist, *if_out);
+		}
 
 		// All the tasks have reached their limit -> finish execution
 		if (all_completed)
 			break;
 
-		// Restart the tasks that have reached their limit
+		// Restart the tasks that have reached their limit, the monitors of the restarted ones have to be set up again
+		const auto pids = tasks_pids(tasklist);
 		tasks_kill_and_restart(tasklist, perf, events);
+		for (size_t i = 0; i < tasklist.size(); i++)
+		{
+			if (tasklist[i].pid == pids[i])
+				continue;
+			task_monitors_clean(mon, pids[i]);
+			task_monitors_setup(mon, tasklist[i]);
+		}
 
 		// Adjust CAT according to the selected policy
 		catpol->apply(interval, tasklist);
@@ -185,6 +347,10 @@ void loop(
 			task_stats_print_total(task, interval, ucompl_out);
 		task_stats_print_total(task, interval, total_out);
 	}
+	if (sys.enabled())
+		sys.print_total(interval, sys_total_out);
+	if (workload)
+		workload_print(interval, workload_metrics(tasklist, true), wl_total_out);
 }
 
 
@@ -213,8 +379,19 @@ void adjust_time(const time_point_t &start_int, const time_point_t &start_glob,
 
 
 // Leave the machine in a consistent state
-void clean(vector<Task> &tasklist, CAT_ptr_t cat, Perf &perf)
+void clean(vector<Task> &tasklist, CAT_ptr_t cat, CounterBackend &perf, TaskMonitors &mon)
 {
+	// Monitoring groups live inside the CLOS directories, remove them before resetting CAT
+	if (mon.resctrl)
+		mon.resctrl->clean();
+	if (mon.msr)
+		mon.msr->clean();
+	if (mon.pebs)
+		mon.pebs->clean();
+	if (mon.heartbeat)
+		mon.heartbeat->clean();
+	if (mon.time)
+		mon.time->clean();
 	cat->reset();
 	perf.clean();
 
@@ -239,10 +416,20 @@ void clean(vector<Task> &tasklist, CAT_ptr_t cat, Perf &perf)
 }
 
 
-void clean_and_die(vector<Task> &tasklist, CAT_ptr_t cat, Perf &perf)
+void clean_and_die(vector<Task> &tasklist, CAT_ptr_t cat, CounterBackend &perf, TaskMonitors &mon)
 {
 	LOGERR("--- PANIC, TRYING TO CLEAN ---");
 
+	try
+	{
+		if (mon.resctrl)
+			mon.resctrl->clean();
+	}
+	catch (const std::exception &e)
+	{
+		LOGERR("Could not remove the resctrl monitoring groups: " << e.what());
+	}
+
 	try
 	{
 		if (cat->is_initialized())
@@ -355,16 +542,32 @@ int main(int argc, char *argv[])
 		("output,o", po::value<string>()->default_value(""), "pathname for output")
 		("fin-output", po::value<string>()->default_value(""), "pathname for output values when tasks are completed")
 		("total-output", po::value<string>()->default_value(""), "pathname for total output values")
+		("sys-output", po::value<string>()->default_value(""), "pathname for the output of the system wide (per socket) values")
+		("sys-total-output", po::value<string>()->default_value(""), "pathname for the total system wide (per socket) values")
+		("workload-output", po::value<string>()->default_value(""), "pathname for the throughput (STP, ANTT) and fairness of the workload, needs the ref_ipc of the tasks")
+		("workload-total-output", po::value<string>()->default_value(""), "pathname for the total throughput and fairness of the workload")
+		("interference-output", po::value<string>()->default_value(""), "pathname for the estimated interference between each pair of tasks, in each interval")
 		("rundir", po::value<string>()->default_value("run"), "directory for creating the directories where the applications are gonna be executed")
 		("id", po::value<string>()->default_value(random_string(5)), "identifier for the experiment")
 		("ti", po::value<double>()->default_value(1), "time-interval, duration in seconds of the time interval to sample performance counters.")
 		("mi", po::value<uint32_t>()->default_value(std::numeric_limits<uint32_t>::max()), "max-intervals, maximum number of intervals.")
-		("event,e", po::value<vector<string>>()->composing()->multitoken(), "optional list of custom events to monitor (up to 4)")
+		("event,e", po::value<vector<string>>()->composing()->multitoken(), "optional list of custom events to monitor, either raw or by portable name (llc_hits, llc_misses, mem_stalls...)")
+		("topdown", po::bool_switch()->default_value(false), "count the events of the top-down analysis, for the tma-* metrics (frontend, bad speculation, retiring, backend memory and core bound). Not with the pcm counters")
 		("cpu-affinity", po::value<vector<uint32_t>>()->multitoken(), "cpus in which this application (not the workloads) is allowed to run")
 		("clog-min", po::value<string>()->default_value(min_clog), "Minimum severity level to log into the console, defaults to warning")
 		("flog-min", po::value<string>()->default_value(min_flog), "Minimum severity level to log into the log file, defaults to info")
 		("log-file", po::value<string>()->default_value("manager.log"), "file used for the general application log")
 		("cat-impl", po::value<string>()->default_value("intel"), "Which implementation of CAT to use (linux or intel)")
+		("counters-impl", po::value<string>()->default_value("perf"), "Which implementation of the performance counters to use (perf, perf-cpu, pcm, pfm, direct or bpf)")
+		("resctrl-mon", po::bool_switch()->default_value(false), "monitor the LLC occupancy and memory bandwidth of the tasks using resctrl (CMT/MBM)")
+		("msr", po::bool_switch()->default_value(false), "monitor the effective frequency and the C-state residency of the cores of the tasks using the MSRs")
+		("uncore-imc", po::bool_switch()->default_value(false), "monitor the memory bandwidth of each socket with the uncore memory controller counters")
+		("mem-sampling", po::bool_switch()->default_value(false), "sample the loads of the tasks with PEBS to estimate their working set and reuse distances")
+		("mem-sampling-period", po::value<uint64_t>()->default_value(1000), "sample one of every this many loads with latency above 3 cycles")
+		("heartbeats", po::bool_switch()->default_value(false), "read the progress the tasks report with heartbeats (requests, latency) from their rings in shared memory")
+		("heartbeat-dir", po::value<string>()->default_value(HEARTBEAT_DIR), "directory where the tasks create their heartbeat rings")
+		("rapl", po::bool_switch()->default_value(false), "measure the package and DRAM energy of each socket with RAPL")
+		("mem-bw-peak", po::value<double>()->default_value(0), "peak memory bandwidth of a socket in GB/s, used to report the memory bandwidth utilization")
 		;
 
 	bool option_error = false;
@@ -406,6 +609,16 @@ int main(int argc, char *argv[])
 	LOGINF("Program cmdline:{}"_format(cmdline));
 	LOGINF("Program options:\n" + options);
 
+	// Read the hardware topology once, before anyone needs it
+	try
+	{
+		LOGINF("Topology: " + topology().to_string());
+	}
+	catch (const std::exception &e)
+	{
+		LOGFAT("Could not read the hardware topology: " << e.what());
+	}
+
 	// Set CPU affinity for not interfering with the executed workloads
 	if (vm.count("cpu-affinity"))
 		set_cpu_affinity(vm["cpu-affinity"].as<vector<uint32_t>>());
@@ -416,19 +629,59 @@ int main(int argc, char *argv[])
 	auto total_out  = std::shared_ptr<std::ostream>();
 	open_output_streams(vm["output"].as<string>(), vm["fin-output"].as<string>(), vm["total-output"].as<string>(), int_out, ucompl_out, total_out);
 
+	// Output streams for the system wide stats, buffered as the final stats if not given
+	auto sys_out       = std::shared_ptr<std::ostream>();
+	auto sys_total_out = std::shared_ptr<std::ostream>();
+	if (vm["sys-output"].as<string>() == "")
+		sys_out.reset(new std::stringstream());
+	else
+		sys_out.reset(new std::ofstream(vm["sys-output"].as<string>()));
+	if (vm["sys-total-output"].as<string>() == "")
+		sys_total_out.reset(new std::stringstream());
+	else
+		sys_total_out.reset(new std::ofstream(vm["sys-total-output"].as<string>()));
+
+	// Same for the workload metrics
+	auto wl_out       = std::shared_ptr<std::ostream>();
+	auto wl_total_out = std::shared_ptr<std::ostream>();
+	if (vm["workload-output"].as<string>() == "")
+		wl_out.reset(new std::stringstream());
+	else
+		wl_out.reset(new std::ofstream(vm["workload-output"].as<string>()));
+	if (vm["workload-total-output"].as<string>() == "")
+		wl_total_out.reset(new std::stringstream());
+	else
+		wl_total_out.reset(new std::ofstream(vm["workload-total-output"].as<string>()));
+
+	// The interference is only printed to a file, there is no final summary to buffer it for
+	auto if_out = std::shared_ptr<std::ostream>();
+	if (vm["interference-output"].as<string>() != "")
+		if_out.reset(new std::ofstream(vm["interference-output"].as<string>()));
+
 	// Read config
 	auto tasklist = vector<Task>();
 	auto coslist = vector<Cos>();
 	CAT_ptr_t cat;
-	auto perf = Perf();
+	CounterBackend_ptr_t perf;
+	auto mon = TaskMonitors();
+	SysStats sys;
 	auto catpol = std::make_shared<cat::policy::Base>(); // We want to use polimorfism, so we need a pointer
+	auto stats_config = StatsConfig();
+	auto interference = std::shared_ptr<InterferenceGraph>();
 	string config_file;
 	try
 	{
 		// Read config and set tasklist and coslist
 		config_file = vm["config"].as<string>();
 		string config_override = vm["config-override"].as<string>();
-		config_read(config_file, config_override, tasklist, coslist, catpol);
+		config_read(config_file, config_override, tasklist, coslist, catpol, stats_config, interference);
+		Stats::configure(stats_config);
+
+		// The interference is estimated if it is configured or printed, with the default metrics if it is not configured
+		if (!interference && vm["interference-output"].as<string>() != "")
+			interference = std::make_shared<InterferenceGraph>();
+		if (interference)
+			catpol->set_interference(interference);
 		tasks_set_rundirs(tasklist, vm["rundir"].as<string>() + "/" + vm["id"].as<string>());
 	}
 	catch(const YAML::ParserException &e)
@@ -449,6 +702,12 @@ int main(int argc, char *argv[])
 		// Initial CAT configuration. It may be modified by the CAT policy.
 		cat = cat_setup(vm["cat-impl"].as<string>(), coslist);
 		catpol->set_cat(cat);
+
+		perf = counters_setup(vm["counters-impl"].as<string>());
+
+		// PCM cannot multiplex, and the top-down events do not fit in its general purpose counters with the default ones
+		if (vm["topdown"].as<bool>() && vm["counters-impl"].as<string>() == "pcm")
+			throw_with_trace(std::runtime_error("The top-down metrics are not supported with '--counters-impl pcm', use perf"));
 	}
 	catch (const std::exception &e)
 	{
@@ -468,19 +727,96 @@ int main(int argc, char *argv[])
 		tasks_map_to_initial_clos(tasklist, std::dynamic_pointer_cast<CATLinux>(cat));
 		LOGINF("Tasks ready");
 
-		// Setup events
+		// Setup events, translating the portable event names (llc_misses, mem_stalls...) to raw encodings for this CPU
 		auto events = vector<string>{"ref-cycles", "instructions"};
 		if (vm.count("event"))
 			events = vm["event"].as<vector<string>>();
+		const Microarch uarch = microarch_detect();
+		LOGINF("Microarchitecture: {}"_format(microarch_to_string(uarch)));
+		if (vm["topdown"].as<bool>())
+		{
+			const auto topdown = event_db_topdown(uarch);
+			if (topdown.empty())
+				LOGWAR("The top-down metrics are not available for this microarchitecture");
+
+			// Skip the events already counted, in any group and by any of their names
+			auto counted = vector<string>();
+			for (const auto &group : events)
+				for (const auto &e : event_list_split(group))
+					counted.push_back(event_db_name(e));
+			for (const auto &e : topdown)
+				if (std::find(counted.begin(), counted.end(), e) == counted.end())
+					events.push_back(e);
+		}
+		for (auto &group : events)
+			group = event_db_resolve(group, uarch);
 		for (auto &task : tasklist)
-			perf.setup_events(task.pid, events);
+			perf->setup_events(task.pid, events);
+
+		// Counting per core needs a core for each task
+		if (vm["counters-impl"].as<string>() == "perf-cpu")
+		{
+			auto cores = tasks_cores_used(tasklist);
+			std::sort(cores.begin(), cores.end());
+			if (std::adjacent_find(cores.begin(), cores.end()) != cores.end())
+				LOGWAR("Some tasks share a core, their events will be mixed");
+		}
+
+		// Always measure the length of the intervals and the CPU time of the tasks, to normalize the counters
+		mon.time = std::make_shared<TimeMon>();
+
+		// Setup cache occupancy and memory bandwidth monitoring
+		if (vm["resctrl-mon"].as<bool>())
+		{
+			mon.resctrl = std::make_shared<ResctrlMon>();
+			mon.resctrl->init();
+			LOGINF("Monitoring with resctrl: {}"_format(boost::algorithm::join(mon.resctrl->get_names(), ", ")));
+		}
+
+		// Setup frequency and C-state residency monitoring of the cores of the tasks
+		if (vm["msr"].as<bool>())
+		{
+			mon.msr = std::make_shared<MSRMon>();
+			mon.msr->init();
+			LOGINF("Monitoring with MSRs: {}"_format(boost::algorithm::join(mon.msr->get_names(), ", ")));
+		}
+
+		// Setup load sampling for the working set and reuse distance estimates
+		if (vm["mem-sampling"].as<bool>())
+		{
+			mon.pebs = std::make_shared<PEBSMon>(vm["mem-sampling-period"].as<uint64_t>());
+			mon.pebs->init();
+			LOGINF("Sampling loads with PEBS: {}"_format(boost::algorithm::join(mon.pebs->get_names(), ", ")));
+		}
+
+		// Setup the reading of the heartbeats of the tasks
+		if (vm["heartbeats"].as<bool>())
+		{
+			mon.heartbeat = std::make_shared<HeartbeatMon>(vm["heartbeat-dir"].as<string>());
+			LOGINF("Reading heartbeats: {}"_format(boost::algorithm::join(mon.heartbeat->get_names(), ", ")));
+		}
+
+		for (const auto &task : tasklist)
+			task_monitors_setup(mon, task);
+
+		// Setup system wide monitoring
+		if (vm["uncore-imc"].as<bool>())
+			sys.set_uncore(std::make_shared<Uncore>(vm["mem-bw-peak"].as<double>()));
+		if (vm["rapl"].as<bool>())
+			sys.set_rapl(std::make_shared<Rapl>());
+		if (sys.enabled())
+		{
+			const auto names = task_counter_names(*perf, mon, tasklist.front().pid);
+			sys.init(std::find(names.begin(), names.end(), "instructions") != names.end());
+		}
 
 		// Start doing things
 		LOGINF("Start main loop");
-		loop(tasklist, catpol, perf, events, vm["ti"].as<double>() * 1000 * 1000, vm["mi"].as<uint32_t>(), *int_out, *ucompl_out, *total_out);
+		loop(tasklist, catpol, *perf, mon, sys, events, vm["ti"].as<double>() * 1000 * 1000, vm["mi"].as<uint32_t>(), *int_out, *ucompl_out, *total_out, *sys_out, *sys_total_out, *wl_out, *wl_total_out, interference, if_out.get());
 
 		// Kill tasks, reset CAT, performance monitors, etc...
-		clean(tasklist, catpol->get_cat(), perf);
+		clean(tasklist, catpol->get_cat(), *perf, mon);
+		sys.clean();
 
 		// If no --fin-output argument, then the final stats are buffered in a stringstream and then outputted to stdout.
 		// If we don't do this and the normal output also goes to stdout, they would mix.
@@ -495,6 +831,26 @@ int main(int argc, char *argv[])
 			auto o = total_out.get();
 			cout << dynamic_cast<std::stringstream *>(o)->str();
 		}
+		if (sys.enabled() && vm["sys-output"].as<string>() == "")
+		{
+			auto o = sys_out.get();
+			cout << dynamic_cast<std::stringstream *>(o)->str();
+		}
+		if (sys.enabled() && vm["sys-total-output"].as<string>() == "")
+		{
+			auto o = sys_total_out.get();
+			cout << dynamic_cast<std::stringstream *>(o)->str();
+		}
+		if (vm["workload-output"].as<string>() == "")
+		{
+			auto o = wl_out.get();
+			cout << dynamic_cast<std::stringstream *>(o)->str();
+		}
+		if (vm["workload-total-output"].as<string>() == "")
+		{
+			auto o = wl_total_out.get();
+			cout << dynamic_cast<std::stringstream *>(o)->str();
+		}
 	}
 	catch(const std::exception &e)
 	{
@@ -503,6 +859,6 @@ int main(int argc, char *argv[])
 			LOGERR(e.what() << std::endl << *st);
 		else
 			LOGERR(e.what());
-		clean_and_die(tasklist, catpol->get_cat(), perf);
+		clean_and_die(tasklist, catpol->get_cat(), *perf, mon);
 	}
 }
@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <cmath>
+
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "phase.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+bool PageHinkley::add(double x)
+{
+	// Intervals without a value (e.g. an IPC without cycles) are ignored
+	if (!std::isfinite(x))
+		return false;
+
+	n++;
+	mean += (x - mean) / n;
+	if (n <= warmup)
+		return false;
+
+	const double d = mean != 0 ? (x - mean) / std::abs(mean) : 0;
+	up += d - delta;
+	up_min = std::min(up_min, up);
+	down += d + delta;
+	down_max = std::max(down_max, down);
+
+	if (up - up_min > threshold || down_max - down > threshold)
+	{
+		reset();
+		return true;
+	}
+	return false;
+}
+
+
+void PageHinkley::reset()
+{
+	n = 0;
+	mean = 0;
+	up = up_min = 0;
+	down = down_max = 0;
+}
+
+
+bool PhaseTrigger::update(uint64_t current_interval, const std::vector<Task> &tasklist)
+{
+	bool changed = false;
+	for (const auto &task : tasklist)
+	{
+		auto it = detectors.find(task.id);
+		if (it == detectors.end())
+			it = detectors.insert(std::make_pair(task.id, PageHinkley(delta, threshold))).first;
+		if (it->second.add(task.stats.estimate(metric, Estimator::Last)))
+		{
+			LOGINF("Task {}:{} has changed its phase in the interval {}"_format(task.id, task.name, current_interval));
+			changed = true;
+		}
+	}
+
+	if (!changed && current_interval - last_run < timer)
+		return false;
+	last_run = current_interval;
+	return true;
+}
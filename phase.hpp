@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "task.hpp"
+
+
+// Page-Hinkley test (Page, 1954) for changes in the mean of a series, in both directions. The deviations from the
+// mean of the current phase are taken relative to it, so the parameters do not depend on the scale of the values:
+// a change is detected when the deviations, minus 'delta' each, add up to more than 'threshold'. After a change the
+// test starts over, and waits for 'warmup' values to have a mean again.
+class PageHinkley
+{
+	double delta;
+	double threshold;
+	uint64_t warmup;
+
+	uint64_t n = 0;
+	double mean = 0;
+	double up = 0, up_min = 0;      // Cumulative deviations, to detect increases...
+	double down = 0, down_max = 0;  // ...and decreases
+
+	public:
+
+	PageHinkley(double delta = 0.05, double threshold = 1, uint64_t warmup = 3) :
+			delta(delta), threshold(threshold), warmup(warmup) {}
+
+	// Adds a value and returns true if it starts a new phase
+	bool add(double x);
+
+	void reset();
+};
+
+
+// Tracks the phases of the tasks with a Page-Hinkley test over the interval values of a metric, so periodic policies
+// can run only when some task has changed its phase, or as a safety net when 'timer' intervals have passed since their
+// last run. The timer is meant to be long, several times the period of the policy, to save its runs while the phases
+// last.
+class PhaseTrigger
+{
+	std::string metric;
+	double delta;
+	double threshold;
+	uint64_t timer;
+	std::map<uint32_t, PageHinkley> detectors;  // By task id
+	uint64_t last_run = 0;
+
+	public:
+
+	PhaseTrigger(const std::string &metric, uint64_t timer, double delta = 0.05, double threshold = 1) :
+			metric(metric), delta(delta), threshold(threshold), timer(timer) {}
+
+	// Must be called every interval. Returns true if some task has changed its phase in it or the timer has expired
+	// since the last time it returned true.
+	bool update(uint64_t current_interval, const std::vector<Task> &tasklist);
+};
@@ -0,0 +1,49 @@
+#include <algorithm>
+
+#include "slowdown.hpp"
+
+
+void SlowdownModel::add(double instructions, double cycles, double stalls)
+{
+	// Without instructions retired the stalls per instruction are meaningless, the interval is counted as is
+	double alone = cycles;
+	if (instructions > 0 && cycles > 0)
+	{
+		const double spi = std::min(stalls, cycles) / instructions;
+
+		min_spi = std::min(min_spi, spi);
+		const double excess = (spi - min_spi) * instructions;
+		alone = std::max(cycles - excess, 1.0);
+	}
+
+	last_cycles = cycles;
+	last_alone = alone;
+	last_instructions = instructions;
+	total_cycles += cycles;
+	total_alone += alone;
+	total_instructions += instructions;
+}
+
+
+double SlowdownModel::alone_ipc() const
+{
+	return last_alone > 0 ? last_instructions / last_alone : 0;
+}
+
+
+double SlowdownModel::slowdown() const
+{
+	return last_alone > 0 ? last_cycles / last_alone : 1;
+}
+
+
+double SlowdownModel::total_alone_ipc() const
+{
+	return total_alone > 0 ? total_instructions / total_alone : 0;
+}
+
+
+double SlowdownModel::total_slowdown() const
+{
+	return total_alone > 0 ? total_cycles / total_alone : 1;
+}
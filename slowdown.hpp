@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+
+// Stall accounting estimate of the slowdown of a task due to the tasks it shares the memory hierarchy with, without
+// running it alone. The cycles stalled on memory per instruction retired grow with the contention, while the rest of
+// the cycles do not depend on it. The contention-free stalls per instruction are taken as the minimum seen since the
+// task started, the excess over them as the interference, and the cycles the interval would have taken alone as the
+// cycles minus the excess stalls. The minimum is kept for the whole execution: a minimum over the last intervals
+// would rise to the contended value under steady contention, and the slowdown would drift to 1. A task contended
+// from its start has no slowdown until an interval with less contention is seen.
+class SlowdownModel
+{
+	double min_spi = std::numeric_limits<double>::infinity();  // Contention-free stalls per instruction
+
+	double last_cycles = 0, last_alone = 0, last_instructions = 0;
+	double total_cycles = 0, total_alone = 0, total_instructions = 0;
+
+	public:
+
+	// Adds the values of an interval
+	void add(double instructions, double cycles, double stalls);
+
+	// Cycles the last interval would have taken alone, and its IPC and slowdown (>= 1) then
+	double alone_cycles() const { return last_alone; }
+	double alone_ipc() const;
+	double slowdown() const;
+
+	// The same for the whole execution
+	double total_alone_ipc() const;
+	double total_slowdown() const;
+};
@@ -1,18 +1,16 @@
-#include <functional>
+#include <algorithm>
 #include <iomanip>
 #include <sstream>
 
 #include <boost/io/ios_state.hpp>
 #include <fmt/format.h>
 
+#include "events-db.hpp"
 #include "log.hpp"
 #include "stats.hpp"
 #include "throw-with-trace.hpp"
 
 
-#define WIN_SIZE 7
-
-
 namespace acc = boost::accumulators;
 
 using fmt::literals::operator""_format;
@@ -24,57 +22,165 @@ Stats::Stats(const std::vector<std::string> &counters)
 }
 
 
-void Stats::init_derived_metrics_total(const std::vector<std::string> &counters)
+// Value of a counter for the interval between l and c. When the counter has been multiplexed, i.e. it has been
+// running only for a fraction of the time it has been enabled, the value is extrapolated to the whole interval.
+// The fraction is returned in 'confidence'.
+static double interval_value(const Counter &c, const Counter *l, double &confidence)
 {
-	bool instructions = std::find(counters.begin(), counters.end(), "instructions") != counters.end();
-	bool cycles = std::find(counters.begin(), counters.end(), "cycles") != counters.end();
-	bool ref_cycles = std::find(counters.begin(), counters.end(), "ref-cycles") != counters.end();
+	const double delta = l ? c.value - l->value : c.value;
+	const uint64_t dena = l ? c.time_enabled - l->time_enabled : c.time_enabled;
+	const uint64_t drun = l ? c.time_running - l->time_running : c.time_running;
+
+	confidence = 1;
+
+	// Snapshots are not counted by the PMU, and without timing information there is nothing to scale
+	if (c.snapshot)
+		return c.value;
+	if (dena == 0)
+		return delta;
+
+	confidence = (double) drun / dena;
+	if (drun == 0)
+		return 0;
+	if (drun < dena)
+		return delta * dena / drun;
+	return delta;
+}
+
 
-	if (instructions && cycles)
+// Position of a counter in 'names', by its exact name or by its portable name if it is a known event, or the size
+// of 'names' if it is not there
+static size_t find_counter(const std::vector<std::string> &names, const std::string &name)
+{
+	auto it = std::find(names.begin(), names.end(), name);
+	if (it == names.end())
 	{
-		derived_metrics_total.push_back(std::make_pair("ipc", [this]()
-		{
-			double inst = acc::sum(this->events.at("instructions"));
-			double cycl = acc::sum(this->events.at("cycles"));
-			return inst / cycl;
-		}));
+		const std::string canonical = event_db_canonical(name);
+		it = std::find_if(names.begin(), names.end(), [&canonical](const auto &n) { return event_db_canonical(n) == canonical; });
 	}
+	return it - names.begin();
+}
+
+
+// Built-in derived metrics, the energy includes DRAM if it is measured
+static const std::vector<std::pair<std::string, std::string>> builtin_metrics =
+{
+	{"ipc",              "instructions / cycles"},
+	{"ref-ipc",          "instructions / ref-cycles"},
+	{"inst-per-joule",   "instructions / (energy_pkg + energy_dram)"},
+	{"inst-per-joule",   "instructions / energy_pkg"},
+	{"edp",              "(energy_pkg + energy_dram) * time"},
+	{"edp",              "energy_pkg * time"},
+
+	// Top-down analysis, level 1 and the split of the frontend and the backend of level 2. The fractions of the issue
+	// slots, measured from Ice Lake on and 4 per cycle before, only with the cycles counted for it. The backend is
+	// split by the share of memory stalls.
+	{"tma-frontend",     "uops_not_delivered / topdown_slots"},
+	{"tma-frontend",     "uops_not_delivered / (4 * topdown_cycles)"},
+	{"tma-bad-spec",     "(uops_issued - uops_retired_slots + 5 * recovery_cycles) / topdown_slots"},
+	{"tma-bad-spec",     "(uops_issued - uops_retired_slots + 4 * recovery_cycles) / (4 * topdown_cycles)"},
+	{"tma-retiring",     "uops_retired_slots / topdown_slots"},
+	{"tma-retiring",     "uops_retired_slots / (4 * topdown_cycles)"},
+	{"tma-backend",      "1 - (uops_not_delivered + uops_issued + 5 * recovery_cycles) / topdown_slots"},
+	{"tma-backend",      "1 - (uops_not_delivered + uops_issued + 4 * recovery_cycles) / (4 * topdown_cycles)"},
+	{"tma-fe-latency",   "5 * fe_latency_cycles / topdown_slots"},
+	{"tma-fe-latency",   "fe_latency_cycles / topdown_cycles"},
+	{"tma-fe-bandwidth", "(uops_not_delivered - 5 * fe_latency_cycles) / topdown_slots"},
+	{"tma-fe-bandwidth", "(uops_not_delivered - 4 * fe_latency_cycles) / (4 * topdown_cycles)"},
+	{"tma-be-memory",    "(1 - (uops_not_delivered + uops_issued + 5 * recovery_cycles) / topdown_slots) * mem_stalls / stalls_total"},
+	{"tma-be-memory",    "(1 - (uops_not_delivered + uops_issued + 4 * recovery_cycles) / (4 * topdown_cycles)) * mem_stalls / stalls_total"},
+	{"tma-be-core",      "(1 - (uops_not_delivered + uops_issued + 5 * recovery_cycles) / topdown_slots) * (1 - mem_stalls / stalls_total)"},
+	{"tma-be-core",      "(1 - (uops_not_delivered + uops_issued + 4 * recovery_cycles) / (4 * topdown_cycles)) * (1 - mem_stalls / stalls_total)"},
+};
+
+
+// Metrics estimated by the slowdown model
+static const std::vector<std::string> model_metrics = {"alone-ipc", "slowdown"};
+
+
+StatsConfig Stats::config;
+
+
+void Stats::configure(const StatsConfig &config)
+{
+	Stats::config = config;
+}
+
 
-	if (instructions && ref_cycles)
+Estimator str_to_estimator(const std::string &str)
+{
+	static const std::map<std::string, Estimator> estimators =
 	{
-		derived_metrics_total.push_back(std::make_pair("ref-ipc", [this]()
-		{
-			double inst = acc::sum(this->events.at("instructions"));
-			double ref_cycl = acc::sum(this->events.at("ref-cycles"));
-			return inst / ref_cycl;
-		}));
-	}
+		{"last",           Estimator::Last},
+		{"mean",           Estimator::Mean},
+		{"rolling_mean",   Estimator::RollingMean},
+		{"ewma",           Estimator::Ewma},
+		{"rolling_median", Estimator::RollingMedian},
+		{"p50",            Estimator::P50},
+		{"p95",            Estimator::P95},
+		{"p99",            Estimator::P99},
+	};
+	const auto it = estimators.find(str);
+	if (it == estimators.end())
+		throw_with_trace(std::runtime_error("Unknown estimator '{}'"_format(str)));
+	return it->second;
 }
 
 
-void Stats::init_derived_metrics_int(const std::vector<std::string> &counters)
+Stats::accum_t Stats::make_accum(const std::string &name)
 {
-	bool instructions = std::find(counters.begin(), counters.end(), "instructions") != counters.end();
-	bool cycles = std::find(counters.begin(), counters.end(), "cycles") != counters.end();
-	bool ref_cycles = std::find(counters.begin(), counters.end(), "ref-cycles") != counters.end();
-	if (instructions && cycles)
+	auto it = config.events.find(name);
+	if (it == config.events.end())
 	{
-		derived_metrics_int.push_back(std::make_pair("ipc", [this]()
-		{
-			double inst = this->get_interval("instructions");
-			double cycl = this->get_interval("cycles");
-			return inst / cycl;
-		}));
+		const std::string canonical = event_db_canonical(name);
+		it = std::find_if(config.events.begin(), config.events.end(),
+				[&canonical](const auto &kv) { return event_db_canonical(kv.first) == canonical; });
 	}
+	const EstimatorParams &p = it == config.events.end() ? config.estimators : it->second;
+
+	return accum_t(
+			acc::tag::rolling_window::window_size = p.window,
+			acc::tag::ewma::half_life = p.half_life,
+			acc::tag::kll_quantile::sketch_size = p.sketch_size);
+}
 
-	if (instructions && ref_cycles)
+
+void Stats::init_derived_metrics(const std::vector<std::string> &counters)
+{
+	auto metrics = config.metrics;
+	for (const auto &m : builtin_metrics)
+		metrics.push_back({m.first, Expr(m.second)});
+
+	for (size_t i = 0; i < metrics.size(); i++)
 	{
-		derived_metrics_int.push_back(std::make_pair("ref-ipc", [this]()
+		const auto &m = metrics[i];
+		const bool user = i < config.metrics.size();
+
+		if (std::find_if(derived.begin(), derived.end(), [&m](const auto &d) { return d.name == m.name; }) != derived.end())
+			continue;
+		if (std::find(counters.begin(), counters.end(), m.name) != counters.end())
+			throw_with_trace(std::runtime_error("The derived metric '{}' has the name of a counter"_format(m.name)));
+
+		// Bind the variables to the counters, by their exact name or by their portable name if they are known events
+		auto slots = std::vector<size_t>();
+		for (const auto &var : m.expr.variables())
 		{
-			double inst = this->get_interval("instructions");
-			double ref_cycl = this->get_interval("ref-cycles");
-			return inst / ref_cycl;
-		}));
+			auto it = std::find(counters.begin(), counters.end(), var);
+			if (it == counters.end())
+			{
+				const std::string canonical = event_db_canonical(var);
+				it = std::find_if(counters.begin(), counters.end(), [&canonical](const auto &c) { return event_db_canonical(c) == canonical; });
+			}
+			if (it == counters.end())
+			{
+				if (user && !std::any_of(metrics.begin() + i + 1, metrics.end(), [&m](const auto &o) { return o.name == m.name; }))
+					LOGWAR("The derived metric '{}' needs the counter '{}', which is not measured"_format(m.name, var));
+				break;
+			}
+			slots.push_back(it - counters.begin());
+		}
+		if (slots.size() == m.expr.variables().size())
+			derived.push_back({m.name, m.expr.bind(slots)});
 	}
 }
 
@@ -84,28 +190,53 @@ void Stats::init(const std::vector<std::string> &counters)
 	assert(!initialized);
 
 	for (const auto &c : counters)
-		events.insert(std::make_pair(c, accum_t(acc::tag::rolling_window::window_size = WIN_SIZE)));
-
-	init_derived_metrics_int(counters);
-	init_derived_metrics_total(counters);
-
-	// Test der metrics
-	if (derived_metrics_int.size() != derived_metrics_total.size())
-		throw_with_trace(std::runtime_error("Different number of derived metrics for int ({}) and total ({})"_format(
-				derived_metrics_int.size(), derived_metrics_total.size())));
-	for(const auto &der : derived_metrics_int)
 	{
-		auto it = std::find_if(derived_metrics_total.begin(), derived_metrics_total.end(),
-				[&der](const auto& tuple) {return tuple.first == der.first;});
-		if (it == derived_metrics_total.end())
-			throw_with_trace(std::runtime_error("Different derived metrics for int and total results"));
+		events.insert(std::make_pair(c, make_accum(c)));
+		mux.insert(std::make_pair(c, MuxInfo()));
 	}
 
-	for (const auto &der : derived_metrics_int)
-		events.insert(std::make_pair(der.first, accum_t(acc::tag::rolling_window::window_size = WIN_SIZE)));
+	init_derived_metrics(counters);
+	for (const auto &der : derived)
+		events.insert(std::make_pair(der.name, make_accum(der.name)));
 
 	// Store the names of the counters
 	names = counters;
+	values.assign(names.size(), 0);
+	sums.assign(names.size(), 0);
+	snapshots.assign(names.size(), false);
+	normalized.assign(names.size(), false);
+
+	// Counter that divides the others to get rates
+	norm = names.size();
+	if (!config.normalize.empty())
+	{
+		norm = find_counter(names, config.normalize);
+		if (norm == names.size())
+			LOGWAR("Cannot normalize by '{}', it is not measured"_format(config.normalize));
+	}
+
+	// The slowdown is modeled only if enabled, the counters it needs are measured and no derived metric replaces it
+	model_instructions = find_counter(names, "instructions");
+	model_cycles = find_counter(names, "cycles");
+	model_stalls = find_counter(names, config.slowdown_stalls);
+	modeled = config.slowdown && model_instructions < names.size() && model_cycles < names.size() && model_stalls < names.size() &&
+			std::none_of(derived.begin(), derived.end(), [](const auto &d)
+			{
+				return std::find(model_metrics.begin(), model_metrics.end(), d.name) != model_metrics.end();
+			});
+	if (modeled)
+	{
+		model = SlowdownModel();
+		for (const auto &m : model_metrics)
+			events.insert(std::make_pair(m, make_accum(m)));
+	}
+
+	auto metrics = names;
+	for (const auto &der : derived)
+		metrics.push_back(der.name);
+	if (modeled)
+		metrics.insert(metrics.end(), model_metrics.begin(), model_metrics.end());
+	hist = History(metrics, config.history, config.history_archive);
 
 	initialized = true;
 }
@@ -123,13 +254,32 @@ Stats& Stats::accum(const counters_t &counters)
 
 	assert(!curr.empty());
 
+	// Find where each counter goes in the values for the derived metrics, only once
+	if (order.empty())
+	{
+		for (const auto &c : curr_id_idx)
+		{
+			const auto it = std::find(names.begin(), names.end(), c.name);
+			if (it == names.end())
+				throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(c.name)));
+			order.push_back(it - names.begin());
+			snapshots[order.back()] = c.snapshot;
+
+			// Snapshots and times (durations) are not normalized, nor is the divisor
+			normalized[order.back()] = norm < names.size() && order.back() != norm && !c.snapshot && c.unit != "s";
+		}
+	}
+	assert(order.size() == curr.size());
+
 	// App has just started, no last data
 	if (last.empty())
 	{
 		auto it = curr_id_idx.cbegin();
-		while (it != curr_id_idx.cend())
+		for (size_t i = 0; it != curr_id_idx.cend(); i++)
 		{
-			events.at(it->name)(it->value);
+			double confidence;
+			values[order[i]] = interval_value(*it, nullptr, confidence);
+			update_mux(*it, nullptr, confidence);
 			it++;
 		}
 	}
@@ -140,27 +290,52 @@ Stats& Stats::accum(const counters_t &counters)
 		assert(curr.size() == last.size());
 		auto curr_it = curr_id_idx.cbegin();
 		auto last_it = last_id_idx.cbegin();
-		while (curr_it != curr_id_idx.cend() && last_it != last_id_idx.cend())
+		for (size_t i = 0; curr_it != curr_id_idx.cend() && last_it != last_id_idx.cend(); i++)
 		{
 			const Counter &c = *curr_it;
 			const Counter &l = *last_it;
 			assert(c.id == l.id);
 			assert(c.name == l.name);
-			double value = c.snapshot ?
-					c.value :
-					c.value - l.value;
+			double confidence;
+			double value = interval_value(c, &l, confidence);
 			if (value < 0)
 				LOGERR("Negative interval value ({}) for the counter '{}'"_format(value, c.name));
-			events.at(c.name)(value);
+			values[order[i]] = value;
+			update_mux(c, &l, confidence);
 
 			curr_it++;
 			last_it++;
 		}
 	}
 
+	// The accumulators get the rates if the values are normalized, the totals are always the raw sums
+	const double divisor = norm < names.size() ? values[norm] : 1;
+	auto row = values;
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (normalized[i])
+			row[i] = divisor > 0 ? values[i] / divisor : 0;
+		events.at(names[i])(row[i]);
+		sums[i] += values[i];
+	}
+
 	// Compute and add derived metrics
-	for (const auto &der : derived_metrics_int)
-		events.at(der.first)(der.second());
+	for (const auto &der : derived)
+	{
+		row.push_back(der.expr.eval(values));
+		events.at(der.name)(row.back());
+	}
+
+	// Estimate the slowdown
+	if (modeled)
+	{
+		model.add(values[model_instructions], values[model_cycles], values[model_stalls]);
+		row.push_back(model.alone_ipc());
+		events.at("alone-ipc")(row.back());
+		row.push_back(model.slowdown());
+		events.at("slowdown")(row.back());
+	}
+	hist.push(row);
 
 	counter++;
 
@@ -168,6 +343,42 @@ Stats& Stats::accum(const counters_t &counters)
 }
 
 
+void Stats::update_mux(const Counter &c, const Counter *l, double confidence)
+{
+	auto &m = mux.at(c.name);
+	m.last = confidence;
+	m.ena += l ? c.time_enabled - l->time_enabled : c.time_enabled;
+	m.run += l ? c.time_running - l->time_running : c.time_running;
+	if (confidence < 1 && !m.warned)
+	{
+		LOGWAR("The counter '{}' is being multiplexed (running {:.0f}% of the time), its values are scaled estimates"_format(
+				c.name, confidence * 100));
+		m.warned = true;
+	}
+}
+
+
+double Stats::confidence(const std::string &name, bool total) const
+{
+	const auto it = mux.find(name);
+	if (it == mux.end())
+		throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(name)));
+	const auto &m = it->second;
+	if (!total)
+		return m.last;
+	return m.ena ? (double) m.run / m.ena : 1;
+}
+
+
+double Stats::min_confidence(bool total) const
+{
+	double result = 1;
+	for (const auto &name : names)
+		result = std::min(result, confidence(name, total));
+	return result;
+}
+
+
 std::string Stats::header_to_string(const std::string &sep) const
 {
 	if (!names.size()) return "";
@@ -178,8 +389,12 @@ std::string Stats::header_to_string(const std::string &sep) const
 	it++;
 	for (; it != names.end(); it++)
 		ss << sep << *it;
-	for (const auto &der : derived_metrics_int) // Int, snapshot and total have the same derived metrics
-		ss << sep << der.first;
+	for (const auto &der : derived)
+		ss << sep << der.name;
+	if (modeled)
+		for (const auto &m : model_metrics)
+			ss << sep << m;
+	ss << sep << "confidence";
 	return ss.str();
 }
 
@@ -194,26 +409,24 @@ std::string Stats::data_to_string_total(const std::string &sep) const
 
 	assert(curr.size() > 0);
 
-	const auto &name_index = curr.get<by_name>();
+	const auto totals = get_totals();
 	for (size_t i = 0; i < names.size(); i++)
 	{
-		const auto &name = names[i];
-		const accum_t &event = events.at(name);
-		const auto &c = name_index.find(name);
-		double value = c->snapshot ?
-				acc::mean(event) :
-				acc::sum(event);
-		ss << value;
+		ss << totals[i];
 		if (i < names.size() - 1)
 			ss << sep;
 	}
 
 	// Derived metrics
-	for (auto it = derived_metrics_total.cbegin(); it != derived_metrics_total.cend(); it++)
-	{
-		double value = it->second();
-		ss << sep << value;
-	}
+	for (const auto &der : derived)
+		ss << sep << der.expr.eval(totals);
+
+	// Modeled metrics
+	if (modeled)
+		ss << sep << model.total_alone_ipc() << sep << model.total_slowdown();
+
+	// Worst case fraction of the time the counters have been running
+	ss << sep << min_confidence(true);
 
 	return ss.str();
 }
@@ -238,11 +451,15 @@ std::string Stats::data_to_string_int(const std::string &sep) const
 	}
 
 	// Derived metrics
-	for (auto it = derived_metrics_int.cbegin(); it != derived_metrics_int.cend(); it++)
-	{
-		double value = it->second();
-		ss << sep << value;
-	}
+	for (const auto &der : derived)
+		ss << sep << acc::last(events.at(der.name));
+
+	// Modeled metrics
+	if (modeled)
+		for (const auto &m : model_metrics)
+			ss << sep << acc::last(events.at(m));
+
+	ss << sep << min_confidence(false);
 
 	return ss.str();
 }
@@ -263,10 +480,8 @@ double Stats::get_interval(const std::string &name) const
 	if (c == curr_index.end())
 		throw_with_trace(std::runtime_error("Missing current data"));
 
-	double value = c->snapshot || last.size() == 0 ?
-			c->value :
-			c->value - l->value;
-	return value;
+	double confidence;
+	return interval_value(*c, last.size() == 0 ? nullptr : &*l, confidence);
 }
 
 
@@ -282,10 +497,89 @@ double Stats::get_current(const std::string &name) const
 
 double Stats::sum(const std::string &name) const
 {
+	const auto it = std::find(names.begin(), names.end(), name);
+	if (it != names.end())
+		return sums[it - names.begin()];
 	return acc::sum(events.at(name));
 }
 
 
+std::vector<double> Stats::get_totals() const
+{
+	auto totals = std::vector<double>(names.size());
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		totals[i] = snapshots[i] ?
+				acc::mean(events.at(names[i])) :
+				sums[i];
+	}
+	return totals;
+}
+
+
+double Stats::get_total(const std::string &name) const
+{
+	const auto it = std::find(names.begin(), names.end(), name);
+	if (it != names.end())
+		return get_totals()[it - names.begin()];
+
+	for (const auto &der : derived)
+		if (der.name == name)
+			return der.expr.eval(get_totals());
+
+	if (modeled && name == "alone-ipc")
+		return model.total_alone_ipc();
+	if (modeled && name == "slowdown")
+		return model.total_slowdown();
+
+	throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(name)));
+}
+
+
+double Stats::get_rate(const std::string &name, const std::string &per) const
+{
+	const auto n = std::find(names.begin(), names.end(), name);
+	const auto p = std::find(names.begin(), names.end(), per);
+	if (n == names.end() || p == names.end())
+		throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(n == names.end() ? name : per)));
+	const double divisor = values[p - names.begin()];
+	return divisor > 0 ? values[n - names.begin()] / divisor : 0;
+}
+
+
+const Stats::accum_t& Stats::event(const std::string &name) const
+{
+	const auto it = events.find(name);
+	if (it != events.end())
+		return it->second;
+
+	const std::string canonical = event_db_canonical(name);
+	for (const auto &kv : events)
+		if (event_db_canonical(kv.first) == canonical)
+			return kv.second;
+
+	throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(name)));
+}
+
+
+double Stats::estimate(const std::string &name, Estimator estimator) const
+{
+	const accum_t &e = event(name);
+	switch (estimator)
+	{
+		case Estimator::Last:          return acc::last(e);
+		case Estimator::Mean:          return acc::mean(e);
+		case Estimator::RollingMean:   return acc::rolling_mean(e);
+		case Estimator::Ewma:          return acc::ewma(e);
+		case Estimator::RollingMedian: return acc::rolling_median(e);
+		case Estimator::P50:           return acc::kll_quantile(e, acc::quantile_probability = 0.50);
+		case Estimator::P95:           return acc::kll_quantile(e, acc::quantile_probability = 0.95);
+		case Estimator::P99:           return acc::kll_quantile(e, acc::quantile_probability = 0.99);
+	}
+	throw_with_trace(std::runtime_error("Unknown estimator"));
+}
+
+
 const counters_t& Stats::get_current_counters() const
 {
 	return curr;
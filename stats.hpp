@@ -3,6 +3,8 @@
 #include <cstdint>
 #include <map>
 #include <ostream>
+#include <string>
+#include <vector>
 
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/rolling_mean.hpp>
@@ -11,8 +13,60 @@
 #include <boost/accumulators/statistics/stats.hpp>
 #include <boost/accumulators/statistics/variance.hpp>
 
+#include "accum-estimators.hpp"
 #include "accum-last.hpp"
-#include "events-perf.hpp"
+#include "events.hpp"
+#include "expr.hpp"
+#include "history.hpp"
+#include "slowdown.hpp"
+
+
+// Metric computed from the counters of a task, e.g. 'llc-mpki' as '1000 * llc_misses / instructions'. The interval
+// value uses the values of the counters in the interval and the total one their sums (means for snapshots).
+struct DerivedMetric
+{
+	std::string name;
+	Expr expr;
+};
+
+
+// Parameters of the estimators of an event
+struct EstimatorParams
+{
+	size_t window = 7;         // Intervals in the rolling mean and median
+	double half_life = 4;      // Intervals for the weight of an interval in the EWMA to halve
+	size_t sketch_size = 200;  // Samples in the top level of the quantile sketch, the error is about 1.7 / size
+};
+
+
+// Stats settings from the config file
+struct StatsConfig
+{
+	std::vector<DerivedMetric> metrics;             // Tried before the built-in ones
+	EstimatorParams estimators;                     // For all the events...
+	std::map<std::string, EstimatorParams> events;  // ...but these, by exact or portable name
+	size_t history = 64;                            // Intervals kept in the history of each task...
+	size_t history_archive = 0;                     // ...plus these, compressed
+	std::string normalize;                          // Counter that divides the others, e.g. wall_time, cycles
+	bool slowdown = false;                          // Estimate the slowdown of the tasks, for the policies to rank them...
+	std::string slowdown_stalls = "mem_stalls";     // ...from the stalls that grow with the contention
+};
+
+
+// Ways of estimating the value of an event from its interval values, for the policies to choose
+enum class Estimator
+{
+	Last,
+	Mean,
+	RollingMean,
+	Ewma,
+	RollingMedian,
+	P50,
+	P95,
+	P99,
+};
+
+Estimator str_to_estimator(const std::string &str);
 
 
 class Stats
@@ -26,7 +80,10 @@ class Stats
 			ACC::tag::sum,
 			ACC::tag::mean,
 			ACC::tag::variance,
-			ACC::tag::rolling_mean>> accum_t;
+			ACC::tag::rolling_mean,
+			ACC::tag::rolling_median,
+			ACC::tag::ewma,
+			ACC::tag::kll_quantile>> accum_t;
 	#undef ACC
 
 	// Set to true when the 'init' method is called
@@ -39,19 +96,55 @@ class Stats
 	counters_t last;
 	counters_t curr;
 
-	// Vectors with lambdas that compute derived stats
-	std::vector<
-		std::pair<
-			std::string,
-			std::function<double()>
-		>
-	> derived_metrics_int, derived_metrics_total;
-
 	// Vector with the names of the counters that will be accumulated
 	std::vector<std::string> names;
 
+	// Derived metrics that can be computed with these counters, bound to their positions in 'names'
+	std::vector<DerivedMetric> derived;
+
+	// Position in 'names' of each counter, in the order of their ids, and whether it is a snapshot
+	std::vector<size_t> order;
+	std::vector<bool> snapshots;
+
+	// Values of the counters in the last interval and their sums, in the order of 'names'
+	std::vector<double> values;
+	std::vector<double> sums;
+
+	// Counters whose accumulators get rates, their values divided by the one in position 'norm' of 'names'
+	std::vector<bool> normalized;
+	size_t norm = 0;
+
+	// Estimates of the IPC of the task alone and of its slowdown, when instructions, cycles and the stalls are measured
+	SlowdownModel model;
+	bool modeled = false;
+	size_t model_instructions = 0, model_cycles = 0, model_stalls = 0;
+
+	// Values of the counters, derived metrics and modeled metrics in the last intervals
+	History hist;
+
+	static StatsConfig config;
+
+	static accum_t make_accum(const std::string &name);
+
+	// Fraction of the time each counter has been running in the PMU, for the last interval and in total.
+	// It is lower than 1 when the counter has been multiplexed, and the values are then scaled estimates.
+	struct MuxInfo
+	{
+		double last = 1;
+		uint64_t ena = 0;
+		uint64_t run = 0;
+		bool warned = false;
+	};
+	std::map<std::string, MuxInfo> mux;
+
+	void update_mux(const Counter &c, const Counter *l, double confidence);
+	double min_confidence(bool total) const;
+
 	std::string data_to_string(const std::string &sep, bool force_snapshot) const;
 
+	// Values of the counters for the whole execution: the sums, or the means for the snapshots
+	std::vector<double> get_totals() const;
+
 	public:
 
 	std::map<std::string, accum_t> events;
@@ -59,9 +152,12 @@ class Stats
 	Stats() = default;
 	Stats(const std::vector<std::string> &counters);
 
+	// Settings for the stats initialized from now on. If several derived metrics have the same name, the first whose
+	// counters are all available is used, so the configured ones can replace the built-in ones.
+	static void configure(const StatsConfig &config);
+
 	void init(const std::vector<std::string> &counters);
-	void init_derived_metrics_total(const std::vector<std::string> &counters);
-	void init_derived_metrics_int(const std::vector<std::string> &counters);
+	void init_derived_metrics(const std::vector<std::string> &counters);
 	Stats& accum(const counters_t &c);
 
 	void reset_counters();
@@ -72,6 +168,25 @@ class Stats
 
 	double sum(const std::string &name) const;
 
+	// Value of a counter or derived metric for the whole execution, as in the total output
+	double get_total(const std::string &name) const;
+
+	// Value of a counter in the last interval divided by the value of another one, e.g. per second of wall_time or
+	// per cycle
+	double get_rate(const std::string &name, const std::string &per = "wall_time") const;
+
+	// Fraction of the time the counter has been counting, for the last interval or for the whole execution
+	double confidence(const std::string &name, bool total = false) const;
+
+	// Accumulator of an event, looked up by its exact name, or by its portable name if it is a known event
+	const accum_t& event(const std::string &name) const;
+
+	// Value of an event (or derived metric) given by an estimator
+	double estimate(const std::string &name, Estimator estimator) const;
+
+	// Values of the events and derived metrics in the last intervals
+	const History& history() const { return hist; }
+
 	std::string header_to_string(const std::string &sep) const;
 	std::string data_to_string_int(const std::string &sep) const;
 	std::string data_to_string_total(const std::string &sep) const;
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <iomanip>
+
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "sys-stats.hpp"
+#include "throw-with-trace.hpp"
+#include "topology.hpp"
+
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+void SysStats::init(bool instructions)
+{
+	if (!enabled())
+		throw_with_trace(std::runtime_error("There are no system wide collectors enabled"));
+
+	if (uncore)
+		uncore->setup();
+	if (rapl)
+		rapl->setup();
+
+	this->instructions = instructions;
+	// Only the sockets that all the collectors can measure
+	auto covered = [](const vector<uint32_t> &v, uint32_t socket) { return std::find(v.begin(), v.end(), socket) != v.end(); };
+	const auto names = get_names();
+	for (const auto &kv : topology().sockets)
+	{
+		if (uncore && !covered(uncore->get_sockets(), kv.first))
+		{
+			LOGWAR("The uncore counters of the socket {} are not available, it is not monitored"_format(kv.first));
+			continue;
+		}
+		if (rapl && !covered(rapl->get_sockets(), kv.first))
+		{
+			LOGWAR("The socket {} has no RAPL package domain, it is not monitored"_format(kv.first));
+			continue;
+		}
+		sockets[kv.first].stats.init(names);
+	}
+	start = std::chrono::steady_clock::now();
+}
+
+
+void SysStats::clean()
+{
+	if (uncore)
+		uncore->clean();
+}
+
+
+std::vector<std::string> SysStats::get_names() const
+{
+	auto names = vector<string>();
+	if (uncore)
+		for (const auto &name : uncore->get_names())
+			names.push_back(name);
+	if (rapl)
+		for (const auto &name : rapl->get_names())
+			names.push_back(name);
+	if (instructions)
+		names.push_back("instructions");
+	names.push_back("time");
+	return names;
+}
+
+
+counters_t SysStats::read_counters(uint32_t socket)
+{
+	const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	auto groups = vector<counters_t>();
+	if (uncore)
+		groups.push_back(uncore->read_counters(socket));
+	if (rapl)
+		groups.push_back(rapl->read_counters(socket));
+
+	auto common = counters_t();
+	int id_c = 0;
+	if (instructions)
+		common.insert({id_c++, "instructions", sockets.at(socket).instructions, "", false, 1});
+	common.insert({id_c++, "time", time, "s", false, 1});
+	groups.push_back(common);
+
+	return counters_merge(groups);
+}
+
+
+void SysStats::accum(const std::vector<Task> &tasklist)
+{
+	// Instructions retired in each socket, the tasks count them from zero when restarted, so add the intervals
+	// The socket is the one of the first CPU of the task, the tasks not pinned to any CPU are left out
+	for (const auto &task : tasklist)
+	{
+		if (!instructions)
+			break;
+		if (task.cpus.empty())
+		{
+			if (!warned_unpinned)
+				LOGWAR("The task {} is not pinned to any CPU, its instructions are not added to any socket"_format(task.id));
+			warned_unpinned = true;
+			continue;
+		}
+		const uint32_t socket = topology().cpu(task.cpus.front()).socket;
+		if (sockets.count(socket))
+			sockets.at(socket).instructions += task.stats.get_interval("instructions");
+	}
+
+	for (auto &kv : sockets)
+		kv.second.stats.accum(read_counters(kv.first));
+}
+
+
+void SysStats::print_headers(std::ostream &out, const std::string &sep) const
+{
+	if (sockets.empty())
+		return;
+	out << "interval" << sep;
+	out << "socket" << sep;
+	out << sockets.begin()->second.stats.header_to_string(sep);
+	out << std::endl;
+}
+
+
+void SysStats::print_interval(uint64_t interval, std::ostream &out, const std::string &sep) const
+{
+	for (const auto &kv : sockets)
+	{
+		out << interval << sep << "socket" << std::setfill('0') << std::setw(2) << kv.first << sep;
+		out << kv.second.stats.data_to_string_int(sep);
+		out << std::endl;
+	}
+}
+
+
+void SysStats::print_total(uint64_t interval, std::ostream &out, const std::string &sep) const
+{
+	for (const auto &kv : sockets)
+	{
+		out << interval << sep << "socket" << std::setfill('0') << std::setw(2) << kv.first << sep;
+		out << kv.second.stats.data_to_string_total(sep);
+		out << std::endl;
+	}
+}
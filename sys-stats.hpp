@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "events-rapl.hpp"
+#include "events-uncore.hpp"
+#include "stats.hpp"
+#include "task.hpp"
+
+
+// System wide counters, one row per socket, printed in its own output next to the task rows.
+// The counters come from the enabled collectors, which are merged in a single set per socket, plus the
+// instructions retired by the tasks running in the socket (if the tasks count them) and the elapsed time, for the
+// efficiency metrics.
+class SysStats
+{
+	struct Socket
+	{
+		Stats stats;
+		double instructions = 0;
+	};
+
+	std::shared_ptr<Uncore> uncore;
+	std::shared_ptr<Rapl> rapl;
+	std::map<uint32_t, Socket> sockets;
+	std::chrono::steady_clock::time_point start;
+	bool instructions = false;  // Whether the tasks count their instructions
+	bool warned_unpinned = false;
+
+	std::vector<std::string> get_names() const;
+	counters_t read_counters(uint32_t socket);
+
+	public:
+
+	SysStats() = default;
+
+	SysStats(const SysStats&) = delete;
+	SysStats& operator=(const SysStats&) = delete;
+
+	void set_uncore(std::shared_ptr<Uncore> _uncore) { uncore = _uncore; }
+	void set_rapl(std::shared_ptr<Rapl> _rapl) { rapl = _rapl; }
+
+	// True if there is any collector enabled
+	bool enabled() const { return uncore || rapl; }
+
+	// Setup the collectors, must be called after they have been set. Without the instructions of the tasks, the
+	// metrics per instruction are not computed.
+	void init(bool instructions);
+	void clean();
+
+	// Must be called after the stats of the tasks have been updated
+	void accum(const std::vector<Task> &tasklist);
+
+	void print_headers(std::ostream &out, const std::string &sep = ",") const;
+	void print_interval(uint64_t interval, std::ostream &out, const std::string &sep = ",") const;
+	void print_total(uint64_t interval, std::ostream &out, const std::string &sep = ",") const;
+};
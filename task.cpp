@@ -311,8 +311,17 @@ std::vector<uint32_t> tasks_cores_used(const std::vector<Task> &tasklist)
 }
 
 
+std::vector<pid_t> tasks_pids(const std::vector<Task> &tasklist)
+{
+	auto res = std::vector<pid_t>();
+	for (const auto &task : tasklist)
+		res.push_back(task.pid);
+	return res;
+}
+
+
 // Kill and restart the tasks that have reached their exec limit
-void tasks_kill_and_restart(std::vector<Task> &tasklist, Perf &perf, const std::vector<std::string> &events)
+void tasks_kill_and_restart(std::vector<Task> &tasklist, CounterBackend &perf, const std::vector<std::string> &events)
 {
 	for (auto &task : tasklist)
 	{
@@ -24,6 +24,7 @@ struct Task
 	const std::string err;         // Stderr redirection
 	const std::string skel;        // Directory containing files and folders to copy to rundir
 	const uint64_t max_instr = 0;  // Max number of instructions to execute
+	const double ref_ipc = 0;      // IPC running alone, for the throughput and fairness metrics, 0 if unknown
 
 	std::string rundir = ""; // Set before executing the task
 	pid_t pid = 0;           // Set after executing the task
@@ -37,8 +38,8 @@ struct Task
 	bool batch = false;         // Batch tasks do not need to be completed in order to finish the execution
 
 	Task() = delete;
-	Task(const std::string &name, const std::string &cmd, uint32_t initial_clos, const std::vector<uint32_t> &cpus, const std::string &out, const std::string &in, const std::string &err, const std::string &skel, uint64_t max_instr, bool batch) :
-		id(ID++), name(name), cmd(cmd), initial_clos(initial_clos), cpus(cpus), out(out), in(in), err(err), skel(skel), max_instr(max_instr), batch(batch) {}
+	Task(const std::string &name, const std::string &cmd, uint32_t initial_clos, const std::vector<uint32_t> &cpus, const std::string &out, const std::string &in, const std::string &err, const std::string &skel, uint64_t max_instr, bool batch, double ref_ipc = 0) :
+		id(ID++), name(name), cmd(cmd), initial_clos(initial_clos), cpus(cpus), out(out), in(in), err(err), skel(skel), max_instr(max_instr), ref_ipc(ref_ipc), batch(batch) {}
 
 	// Reset flags
 	void reset()
@@ -62,9 +63,10 @@ enum class StatsKind
 void tasks_set_rundirs(std::vector<Task> &tasklist, const std::string &rundir_base);
 void tasks_pause(std::vector<Task> &tasklist);
 void tasks_resume(const std::vector<Task> &tasklist);
-void tasks_kill_and_restart(std::vector<Task> &tasklist, Perf &perf, const std::vector<std::string> &events);
+void tasks_kill_and_restart(std::vector<Task> &tasklist, CounterBackend &perf, const std::vector<std::string> &events);
 void tasks_map_to_initial_clos(std::vector<Task> &tasklist, const std::shared_ptr<CATLinux> &cat);
 std::vector<uint32_t> tasks_cores_used(const std::vector<Task> &tasklist);
+std::vector<pid_t> tasks_pids(const std::vector<Task> &tasklist);
 
 void task_create_rundir(const Task &task);
 void task_remove_rundir(const Task &task);
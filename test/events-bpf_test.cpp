@@ -0,0 +1,102 @@
+#include <chrono>
+#include <csignal>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "events-bpf.hpp"
+
+
+// Burns some CPU time and gets switched out a few times
+static double spin()
+{
+	volatile double x = 0;
+	for (int j = 0; j < 10; j++)
+	{
+		for (int i = 0; i < 1000000; i++)
+			x += i;
+		usleep(1000);
+	}
+	return x;
+}
+
+
+TEST(BPFCounters, Count)
+{
+	BPFCounters bpf;
+	const pid_t pid = getpid();
+	bpf.init();
+	bpf.setup_events(pid, {"cpu-clock,page-faults"});
+	EXPECT_THROW(bpf.setup_events(1, {"cpu-clock"}), std::runtime_error);
+
+	const auto names = bpf.get_names(pid);
+	ASSERT_EQ(names.size(), 2U);
+	EXPECT_EQ(names[0], std::vector<std::string>({"cpu-clock", "page-faults"}));
+	EXPECT_EQ(names[1], std::vector<std::string>({"sched_switches", "rq_wait", "rq_waits"}));
+
+	spin();
+	const auto before = bpf.read_all_counters(pid);
+	spin();
+	const auto after = bpf.read_all_counters(pid);
+
+	const auto &b = before.get<by_name>();
+	const auto &a = after.get<by_name>();
+	EXPECT_GT(a.find("cpu-clock")->value, b.find("cpu-clock")->value);
+	EXPECT_GT(a.find("cpu-clock")->time_running, 0U);
+	EXPECT_GE(a.find("sched_switches")->value, b.find("sched_switches")->value + 10);
+
+	bpf.clean(pid);
+	EXPECT_THROW(bpf.read_counters(pid), std::out_of_range);
+}
+
+
+TEST(BPFCounters, PreemptedFlag)
+{
+	// The '+' is TASK_REPORT_MAX, 0x100 in Linux 6.x
+	EXPECT_EQ(sched_switch_preempted_flag("\"prev_state=%s%s ==> next_comm=%s\", REC->prev_comm, (REC->prev_state & ((((0x00000000 | 0x00000001 | 0x00000002 | 0x00000004 | 0x00000008 | 0x00000010 | 0x00000020 | 0x00000040) + 1) << 1) - 1)) ? __print_flags(REC->prev_state & ((((0x00000000 | 0x00000001 | 0x00000002 | 0x00000004 | 0x00000008 | 0x00000010 | 0x00000020 | 0x00000040) + 1) << 1) - 1), \"|\", { 0x00000001, \"S\" }) : \"R\", REC->prev_state & (((0x00000000 | 0x00000001 | 0x00000002 | 0x00000004 | 0x00000008 | 0x00000010 | 0x00000020 | 0x00000040) + 1) << 1) ? \"+\" : \"\", REC->next_comm"), 0x100U);
+	EXPECT_EQ(sched_switch_preempted_flag("\"prev_state=%s%s\", __print_flags(REC->prev_state & (0x80 - 1), \"|\") : \"R\", REC->prev_state & 0x80 ? \"+\" : \"\""), 0x80U);
+	EXPECT_EQ(sched_switch_preempted_flag("\"prev_state=%s\", REC->prev_state ? \"S\" : \"R\""), 0U);
+}
+
+
+TEST(BPFCounters, Preempted)
+{
+	BPFCounters bpf;
+	const pid_t pid = getpid();
+	bpf.init();
+	bpf.setup_events(pid, {"cpu-clock"});
+
+	// Share a CPU with a task that never sleeps, so that this one is preempted without having been woken up
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(sched_getcpu(), &cpus);
+	ASSERT_EQ(sched_setaffinity(0, sizeof(cpus), &cpus), 0);
+	const int zero = open("/dev/zero", O_RDONLY);
+	ASSERT_GE(zero, 0);
+	const pid_t child = fork();
+	ASSERT_GE(child, 0);
+	if (child == 0)
+		while (true);
+
+	// Spin in user space and in the kernel, which is preempted in a different way, without sleeping
+	auto buf = std::vector<char>(1 << 20);
+	const auto before = bpf.read_all_counters(pid);
+	const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+	while (std::chrono::steady_clock::now() < end && read(zero, buf.data(), buf.size()) > 0);
+	const auto after = bpf.read_all_counters(pid);
+	close(zero);
+
+	kill(child, SIGKILL);
+	waitpid(child, nullptr, 0);
+
+	const auto &b = before.get<by_name>();
+	const auto &a = after.get<by_name>();
+	EXPECT_GT(a.find("rq_waits")->value, b.find("rq_waits")->value);
+	EXPECT_GT(a.find("rq_wait")->value, b.find("rq_wait")->value);
+}
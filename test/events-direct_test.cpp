@@ -0,0 +1,174 @@
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "common.hpp"
+#include "events-direct.hpp"
+
+
+namespace fs = boost::filesystem;
+
+
+// Burns some CPU time so the software counters have something to count
+static double spin()
+{
+	volatile double x = 0;
+	for (int i = 0; i < 10000000; i++)
+		x += i;
+	return x;
+}
+
+
+// Fake sysfs PMUs, so the parsing does not depend on the CPU
+class PerfEventParse : public testing::Test
+{
+	protected:
+
+	fs::path pmus;
+
+	void write(const fs::path &path, const std::string &contents)
+	{
+		fs::create_directories(path.parent_path());
+		open_ofstream(path) << contents << std::endl;
+	}
+
+	virtual void SetUp() override
+	{
+		pmus = fs::temp_directory_path() / fs::unique_path();
+		write(pmus / "cpu" / "type", "4");
+		write(pmus / "cpu" / "format" / "event", "config:0-7");
+		write(pmus / "cpu" / "format" / "umask", "config:8-15");
+		write(pmus / "cpu" / "format" / "cmask", "config:24-31");
+		write(pmus / "cpu" / "format" / "ldlat", "config1:0-15");
+		write(pmus / "cpu" / "format" / "split", "config:32-33,40");
+		write(pmus / "cpu" / "events" / "mem-loads", "event=0xcd,umask=0x1,ldlat=3");
+		write(pmus / "uncore_imc_0" / "type", "14");
+		write(pmus / "uncore_imc_0" / "format" / "event", "config:0-7");
+		write(pmus / "uncore_imc_0" / "format" / "umask", "config:8-15");
+		write(pmus / "uncore_imc_0" / "events" / "cas_count_read", "event=0x04,umask=0x03");
+		write(pmus / "uncore_imc_0" / "events" / "cas_count_read.scale", "6.103515625e-5");
+		write(pmus / "uncore_imc_0" / "events" / "cas_count_read.unit", "MiB");
+	}
+
+	virtual void TearDown() override
+	{
+		fs::remove_all(pmus);
+	}
+};
+
+
+TEST_F(PerfEventParse, Generic)
+{
+	auto desc = perf_event_parse("instructions:u", pmus.string());
+	EXPECT_EQ(desc.name, "instructions:u");
+	EXPECT_EQ(desc.attr.type, (uint32_t) PERF_TYPE_HARDWARE);
+	EXPECT_EQ(desc.attr.config, (uint64_t) PERF_COUNT_HW_INSTRUCTIONS);
+	EXPECT_TRUE(desc.attr.exclude_kernel);
+	EXPECT_FALSE(desc.attr.exclude_user);
+	EXPECT_TRUE(desc.attr.exclude_hv);
+
+	// Both levels are counted, not excluded
+	desc = perf_event_parse("instructions:uk", pmus.string());
+	EXPECT_FALSE(desc.attr.exclude_kernel);
+	EXPECT_FALSE(desc.attr.exclude_user);
+	EXPECT_TRUE(desc.attr.exclude_hv);
+
+	desc = perf_event_parse("instructions", pmus.string());
+	EXPECT_FALSE(desc.attr.exclude_kernel);
+	EXPECT_FALSE(desc.attr.exclude_user);
+	EXPECT_FALSE(desc.attr.exclude_hv);
+
+	desc = perf_event_parse("task-clock", pmus.string());
+	EXPECT_EQ(desc.attr.type, (uint32_t) PERF_TYPE_SOFTWARE);
+	EXPECT_EQ(desc.unit, "ns");
+
+	EXPECT_THROW(perf_event_parse("no-such-event", pmus.string()), std::runtime_error);
+}
+
+
+TEST_F(PerfEventParse, PMU)
+{
+	auto desc = perf_event_parse("cpu/event=0xa3,umask=0x14,cmask=20,name=mem_stalls/k", pmus.string());
+	EXPECT_EQ(desc.name, "mem_stalls");
+	EXPECT_EQ(desc.attr.type, 4U);
+	EXPECT_EQ(desc.attr.config, 0xa3ULL | 0x14ULL << 8 | 20ULL << 24);
+	EXPECT_TRUE(desc.attr.exclude_user);
+	EXPECT_FALSE(desc.attr.exclude_kernel);
+
+	desc = perf_event_parse("cpu/event=0xa3,umask=0x14,cmask=20,name=mem_stalls/uk", pmus.string());
+	EXPECT_FALSE(desc.attr.exclude_user);
+	EXPECT_FALSE(desc.attr.exclude_kernel);
+
+	// Non contiguous formats and aliases with terms for other config fields
+	desc = perf_event_parse("cpu/mem-loads,split=7/", pmus.string());
+	EXPECT_EQ(desc.name, "cpu/mem-loads,split=7/");
+	EXPECT_EQ(desc.attr.config, 0xcdULL | 0x1ULL << 8 | 3ULL << 32 | 1ULL << 40);
+	EXPECT_EQ(desc.attr.config1, 3ULL);
+
+	desc = perf_event_parse("uncore_imc_0/cas_count_read/", pmus.string());
+	EXPECT_EQ(desc.attr.type, 14U);
+	EXPECT_EQ(desc.attr.config, 0x0304ULL);
+	EXPECT_DOUBLE_EQ(desc.scale, 6.103515625e-5);
+	EXPECT_EQ(desc.unit, "MiB");
+
+	EXPECT_THROW(perf_event_parse("cpu/event=0x1ff/", pmus.string()), std::runtime_error);
+	EXPECT_THROW(perf_event_parse("cpu/foo=1/", pmus.string()), std::runtime_error);
+	EXPECT_THROW(perf_event_parse("nopmu/event=1/", pmus.string()), std::runtime_error);
+}
+
+
+TEST(PerfDirect, Count)
+{
+	PerfDirect perf;
+	const pid_t pid = getpid();
+	perf.init();
+	perf.setup_events(pid, {"task-clock,page-faults", "{context-switches,cpu-migrations,task-clock}"});
+
+	const auto names = perf.get_names(pid);
+	ASSERT_EQ(names.size(), 2U);
+	EXPECT_EQ(names[0], std::vector<std::string>({"task-clock", "page-faults"}));
+	EXPECT_EQ(names[1], std::vector<std::string>({"context-switches", "cpu-migrations", "task-clock"}));
+
+	spin();
+	const auto before = perf.read_counters(pid);
+	spin();
+	const auto after = perf.read_counters(pid);
+
+	ASSERT_EQ(after.size(), 2U);
+	ASSERT_EQ(after[1].size(), 3U);
+	for (size_t i = 0; i < after.size(); i++)
+	{
+		const auto &b = before[i].get<by_name>().find("task-clock");
+		const auto &a = after[i].get<by_name>().find("task-clock");
+		EXPECT_GT(a->value, b->value);
+		EXPECT_GT(a->time_enabled, 0U);
+	}
+
+	perf.clean(pid);
+	EXPECT_THROW(perf.read_counters(pid), std::out_of_range);
+}
+
+
+TEST(PerfDirect, Prefetch)
+{
+	PerfDirect perf;
+	const pid_t pid = getpid();
+	perf.init();
+	perf.setup_events(pid, {"{task-clock,page-faults}", "context-switches"});
+
+	spin();
+	perf.prefetch_counters({pid});
+	const auto prefetched = perf.read_counters(pid);
+	spin();
+	const auto read = perf.read_counters(pid);
+
+	ASSERT_EQ(prefetched.size(), 2U);
+	ASSERT_EQ(prefetched[0].size(), 2U);
+	ASSERT_EQ(prefetched[1].size(), 1U);
+	EXPECT_GT(prefetched[0].get<by_name>().find("task-clock")->value, 0);
+	EXPECT_GT(read[0].get<by_name>().find("task-clock")->value, prefetched[0].get<by_name>().find("task-clock")->value);
+}
@@ -0,0 +1,56 @@
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "events-heartbeat.hpp"
+
+
+static double value(const counters_t &counters, const std::string &name)
+{
+	return counters.get<by_name>().find(name)->value;
+}
+
+
+TEST(HeartbeatMon, Read)
+{
+	char dir[] = "/tmp/heartbeat_test.XXXXXX";
+	ASSERT_NE(mkdtemp(dir), nullptr);
+
+	HeartbeatMon mon(dir);
+	mon.setup(getpid());
+
+	// The ring does not exist yet
+	auto c = mon.read_counters(getpid());
+	EXPECT_EQ(value(c, "hb_beats"), 0);
+
+	heartbeat_ring *hb = heartbeat_open(dir);
+	ASSERT_NE(hb, nullptr);
+	for (uint64_t i = 1; i <= 100; i++)
+		heartbeat(hb, 2, i * 1000);
+
+	c = mon.read_counters(getpid());
+	EXPECT_EQ(value(c, "hb_beats"), 100);
+	EXPECT_EQ(value(c, "hb_items"), 200);
+	EXPECT_DOUBLE_EQ(value(c, "hb_latency"), 50500);
+	EXPECT_DOUBLE_EQ(value(c, "hb_latency_p99"), 99000);
+
+	// More records than slots, the oldest are lost
+	for (uint64_t i = 0; i < HEARTBEAT_SLOTS + 10; i++)
+		heartbeat(hb, 1, 10);
+	c = mon.read_counters(getpid());
+	EXPECT_EQ(value(c, "hb_beats"), 100 + HEARTBEAT_SLOTS);
+	EXPECT_DOUBLE_EQ(value(c, "hb_latency"), 10);
+
+	// Without new heartbeats the totals stay and the latencies are 0
+	c = mon.read_counters(getpid());
+	EXPECT_EQ(value(c, "hb_items"), 200 + HEARTBEAT_SLOTS);
+	EXPECT_DOUBLE_EQ(value(c, "hb_latency_p99"), 0);
+
+	heartbeat_close(hb);
+	mon.clean();
+	EXPECT_NE(access((std::string(dir) + "/heartbeat." + std::to_string(getpid())).c_str(), F_OK), 0);
+	rmdir(dir);
+}
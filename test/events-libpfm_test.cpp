@@ -0,0 +1,87 @@
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "events-libpfm.hpp"
+
+
+// Burns some CPU time so the software counters have something to count
+static double spin()
+{
+	volatile double x = 0;
+	for (int i = 0; i < 10000000; i++)
+		x += i;
+	return x;
+}
+
+
+TEST(PFMEncode, Raw)
+{
+	struct perf_event_attr attr;
+	const auto name = pfm_encode_event("cpu/event=0xa3,umask=0x14,cmask=20,name=mem_stalls/u", attr);
+	EXPECT_EQ(name, "mem_stalls");
+	EXPECT_EQ(attr.type, (uint32_t) PERF_TYPE_RAW);
+	EXPECT_EQ(attr.config, 0xa3ULL | 0x14ULL << 8 | 20ULL << 24);
+	EXPECT_TRUE(attr.exclude_kernel);
+	EXPECT_FALSE(attr.exclude_user);
+
+	// Both levels are counted, not excluded
+	pfm_encode_event("cpu/event=0xa3,umask=0x14,cmask=20,name=mem_stalls/uk", attr);
+	EXPECT_FALSE(attr.exclude_kernel);
+	EXPECT_FALSE(attr.exclude_user);
+	EXPECT_TRUE(attr.exclude_hv);
+	EXPECT_THROW(pfm_encode_event("cpu/event=0xa3,foo=1/", attr), std::runtime_error);
+}
+
+
+class PFMTest : public testing::Test
+{
+	protected:
+
+	PFM pfm;
+
+	virtual void SetUp() override
+	{
+		pfm.init();
+	}
+};
+
+
+TEST_F(PFMTest, Encode)
+{
+	struct perf_event_attr attr;
+	EXPECT_EQ(pfm_encode_event("task-clock", attr), "task-clock");
+	EXPECT_EQ(attr.type, (uint32_t) PERF_TYPE_SOFTWARE);
+	EXPECT_EQ(attr.config, (uint64_t) PERF_COUNT_SW_TASK_CLOCK);
+	EXPECT_THROW(pfm_encode_event("no-such-event", attr), std::runtime_error);
+}
+
+
+TEST_F(PFMTest, Count)
+{
+	const pid_t pid = getpid();
+	pfm.setup_events(pid, {"task-clock,page-faults", "{context-switches,cpu-migrations}"});
+
+	const auto names = pfm.get_names(pid);
+	ASSERT_EQ(names.size(), 2U);
+	EXPECT_EQ(names[0], std::vector<std::string>({"task-clock", "page-faults"}));
+	EXPECT_EQ(names[1], std::vector<std::string>({"context-switches", "cpu-migrations"}));
+
+	spin();
+	const auto before = pfm.read_all_counters(pid);
+	spin();
+	const auto after = pfm.read_all_counters(pid);
+
+	ASSERT_EQ(after.size(), 4U);
+	const auto &before_idx = before.get<by_name>();
+	const auto &after_idx = after.get<by_name>();
+	EXPECT_GT(after_idx.find("task-clock")->value, before_idx.find("task-clock")->value);
+	EXPECT_GT(after_idx.find("task-clock")->time_enabled, 0U);
+	EXPECT_EQ(after.get<by_id>().begin()->name, "task-clock");
+
+	pfm.clean(pid);
+	EXPECT_THROW(pfm.read_counters(pid), std::out_of_range);
+}
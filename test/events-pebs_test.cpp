@@ -0,0 +1,40 @@
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "events-pebs.hpp"
+
+
+TEST(ReuseAnalyze, Distances)
+{
+	// A B C A(2) A(0), the second address is in the same line as the first
+	const auto stats = reuse_analyze({0, 64 + 8, 128, 63, 32});
+	EXPECT_EQ(stats.samples, 5U);
+	EXPECT_EQ(stats.lines, 3U);
+	EXPECT_EQ(stats.cold, 3U);
+	ASSERT_EQ(stats.histogram.size(), ReuseStats::bounds.size() + 1);
+	EXPECT_EQ(stats.histogram[0], 1U);
+	EXPECT_EQ(stats.histogram[1], 1U);
+}
+
+
+TEST(ReuseAnalyze, LongDistances)
+{
+	auto addrs = std::vector<uint64_t>();
+	for (uint64_t i = 0; i < 5000; i++)
+		addrs.push_back(i * 64);
+	addrs.push_back(0);
+	const auto stats = reuse_analyze(addrs);
+	EXPECT_EQ(stats.cold, 5000U);
+	EXPECT_EQ(stats.histogram.back(), 1U);
+}
+
+
+TEST(ReuseAnalyze, WorkingSet)
+{
+	// Lines seen once (B, C) and twice (A)
+	const auto stats = reuse_analyze({0, 64, 128, 0});
+	EXPECT_DOUBLE_EQ(stats.ws_lines, 3 + 2.0 * 2 / 2);
+
+	EXPECT_EQ(reuse_analyze({}).samples, 0U);
+}
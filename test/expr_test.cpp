@@ -0,0 +1,49 @@
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "expr.hpp"
+
+
+TEST(Expr, Eval)
+{
+	const Expr e("1000 * LLC_MISSES / instructions");
+	ASSERT_EQ(e.variables(), std::vector<std::string>({"LLC_MISSES", "instructions"}));
+	EXPECT_DOUBLE_EQ(e.eval({5, 2000}), 2.5);
+
+	EXPECT_DOUBLE_EQ(Expr("2 + 3 * 4").eval({}), 14);
+	EXPECT_DOUBLE_EQ(Expr("(2 + 3) * 4").eval({}), 20);
+	EXPECT_DOUBLE_EQ(Expr("10 - 4 - 3").eval({}), 3);
+	EXPECT_DOUBLE_EQ(Expr("-x * -2").eval({1.5}), 3);
+	EXPECT_DOUBLE_EQ(Expr("1e3 / .5").eval({}), 2000);
+}
+
+
+TEST(Expr, Names)
+{
+	// Dashes belong to the names, the same variable appears once
+	const Expr e("ref-cycles - cpu:stalls.total + ref-cycles");
+	ASSERT_EQ(e.variables(), std::vector<std::string>({"ref-cycles", "cpu:stalls.total"}));
+	EXPECT_DOUBLE_EQ(e.eval({10, 4}), 16);
+
+	// Bound to the positions of a larger vector
+	EXPECT_DOUBLE_EQ(e.bind({2, 0}).eval({4, 0, 10}), 16);
+}
+
+
+TEST(Expr, Errors)
+{
+	EXPECT_THROW(Expr(""), std::runtime_error);
+	EXPECT_THROW(Expr("a +"), std::runtime_error);
+	EXPECT_THROW(Expr("(a + b"), std::runtime_error);
+	EXPECT_THROW(Expr("a b"), std::runtime_error);
+	EXPECT_THROW(Expr("a % b"), std::runtime_error);
+
+	// Every '1 + (' leaves an operand in the stack
+	std::string deep = "1";
+	for (int i = 0; i < 100; i++)
+		deep = "1 + (" + deep + ")";
+	EXPECT_THROW(Expr e(deep), std::runtime_error);
+}
+
@@ -0,0 +1,68 @@
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "history.hpp"
+
+
+TEST(History, Ring)
+{
+	History h({"instructions", "cycles"}, 3);
+	for (int i = 0; i < 5; i++)
+		h.push({(double) i, 10.0 * i});
+
+	EXPECT_EQ(h.size(), 3U);
+	EXPECT_DOUBLE_EQ(h.row(0)[0], 4);
+	EXPECT_DOUBLE_EQ(h.row(2)[1], 20);
+	EXPECT_THROW(h.row(3), std::runtime_error);
+
+	EXPECT_EQ(h.slice("cycles"), std::vector<double>({20, 30, 40}));
+	EXPECT_EQ(h.slice(0, 2), std::vector<double>({3, 4}));
+	EXPECT_THROW(h.slice("llc_misses"), std::runtime_error);
+	EXPECT_THROW(h.push({1}), std::runtime_error);
+}
+
+
+TEST(History, Archive)
+{
+	// Values that change in all their bits, in a few of them and not at all
+	History h({"noise", "steps", "constant"}, 10, 1000);
+	auto noise = std::vector<double>();
+	for (int i = 0; i < 2000; i++)
+	{
+		noise.push_back(std::sin(i) * 1e6);
+		h.push({noise.back(), (double) (i / 100), 42});
+	}
+
+	// The whole blocks that fall out of the archive are dropped
+	EXPECT_GE(h.size(), 1010U);
+	EXPECT_LT(h.size(), 1010U + 256);
+	EXPECT_EQ(h.recent(), 10U);
+
+	const auto n = h.slice("noise", 1500);
+	ASSERT_EQ(n.size(), std::min<size_t>(1500, h.size()));
+	EXPECT_TRUE(std::equal(n.begin(), n.end(), noise.end() - n.size()));
+
+	const auto steps = h.slice("steps");
+	EXPECT_DOUBLE_EQ(steps.back(), 19);
+	EXPECT_DOUBLE_EQ(steps.front(), (2000 - h.size()) / 100);
+	for (const auto &v : h.slice("constant"))
+		EXPECT_EQ(v, 42);
+}
+
+
+TEST(History, Trend)
+{
+	History h({"a", "b"}, 8);
+	EXPECT_DOUBLE_EQ(h.trend("a"), 0);
+	for (int i = 0; i < 8; i++)
+		h.push({3.0 * i + 1, i % 2 ? 1.0 : -1.0});
+
+	EXPECT_DOUBLE_EQ(h.trend("a"), 3);
+	EXPECT_DOUBLE_EQ(h.trend("a", 2), 3);
+	const auto g = h.gradients(2);
+	EXPECT_DOUBLE_EQ(g[0], 3);
+	EXPECT_DOUBLE_EQ(g[1], 2);
+}
@@ -0,0 +1,29 @@
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "interference.hpp"
+
+
+TEST(InterferenceGraph, Correlation)
+{
+	InterferenceGraph g({"llc_misses"}, "ipc", 4);
+
+	// The IPC of the first task drops when the second one misses, the third one does not hurt anyone
+	for (int i = 0; i < 40; i++)
+	{
+		const double burst = i % 3 == 0 ? 1000 : 100;
+		const double quiet = i % 2 == 0 ? 300 : 200;
+		g.update({burst > 100 ? 0.5 : 1.5, 1, 2}, {10, burst, quiet});
+	}
+
+	EXPECT_GT(g.at(0, 1), 0.99);
+	EXPECT_DOUBLE_EQ(g.at(0, 0), 0);
+	EXPECT_LT(g.at(0, 2), 0.5);
+	EXPECT_DOUBLE_EQ(g.at(1, 0), 0);
+	EXPECT_DOUBLE_EQ(g.at(2, 1), 0);
+	EXPECT_EQ(g.matrix().size(), 3U);
+	EXPECT_THROW(g.at(3, 0), std::runtime_error);
+	EXPECT_THROW(g.update({1, 1}, {1, 1}), std::runtime_error);
+}
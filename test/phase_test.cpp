@@ -0,0 +1,40 @@
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+#include "phase.hpp"
+
+
+TEST(PageHinkley, Steps)
+{
+	PageHinkley ph;
+
+	// Noise around a stable mean is not a change
+	for (int i = 0; i < 100; i++)
+		EXPECT_FALSE(ph.add(1 + 0.03 * std::sin(i)));
+
+	// A jump up is detected in a few intervals, and so is a jump down after the new warmup
+	int detected = -1;
+	for (int i = 0; i < 10 && detected < 0; i++)
+		if (ph.add(2))
+			detected = i;
+	EXPECT_GE(detected, 0);
+	EXPECT_LE(detected, 4);
+
+	detected = -1;
+	for (int i = 0; i < 20 && detected < 0; i++)
+		if (ph.add(i < 5 ? 2 : 0.5))
+			detected = i;
+	EXPECT_GE(detected, 5);
+	EXPECT_LE(detected, 8);
+}
+
+
+TEST(PageHinkley, Invalid)
+{
+	PageHinkley ph;
+	for (int i = 0; i < 10; i++)
+		EXPECT_FALSE(ph.add(NAN));
+	for (int i = 0; i < 10; i++)
+		EXPECT_FALSE(ph.add(0));
+}
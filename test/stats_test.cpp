@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "events-db.hpp"
+#include "stats.hpp"
+#include "workload-stats.hpp"
+
+
+namespace acc = boost::accumulators;
+
+
+// Feeds the values as the successive intervals of an event
+static Stats feed(const std::vector<double> &values, const StatsConfig &config = StatsConfig())
+{
+	Stats::configure(config);
+	Stats stats({"misses"});
+	double total = 0;
+	for (const auto &v : values)
+	{
+		total += v;
+		counters_t c;
+		c.insert({0, "misses", total, "", false, 1});
+		stats.accum(c);
+	}
+	Stats::configure(StatsConfig());
+	return stats;
+}
+
+
+TEST(Stats, Estimators)
+{
+	const Stats stats = feed({1, 2, 3, 100, 4, 5, 6, 7});
+	EXPECT_DOUBLE_EQ(stats.estimate("misses", Estimator::Last), 7);
+	EXPECT_DOUBLE_EQ(stats.estimate("misses", Estimator::RollingMean), (2 + 3 + 100 + 4 + 5 + 6 + 7) / 7.0);
+
+	// The burst barely moves the median
+	EXPECT_DOUBLE_EQ(stats.estimate("misses", Estimator::RollingMedian), 5);
+	EXPECT_DOUBLE_EQ(stats.estimate("misses", Estimator::P50), 4);
+	EXPECT_DOUBLE_EQ(stats.estimate("misses", Estimator::P99), 100);
+
+	EXPECT_EQ(str_to_estimator("p95"), Estimator::P95);
+	EXPECT_THROW(str_to_estimator("p42"), std::runtime_error);
+}
+
+
+TEST(Stats, EstimatorParams)
+{
+	auto config = StatsConfig();
+	config.events["misses"].window = 2;
+	config.events["misses"].half_life = 1;
+	const Stats stats = feed({8, 4, 2}, config);
+	EXPECT_DOUBLE_EQ(stats.estimate("misses", Estimator::RollingMean), 3);
+	EXPECT_DOUBLE_EQ(stats.estimate("misses", Estimator::Ewma), ((8 + 4) / 2.0 + 2) / 2);
+}
+
+
+TEST(Stats, Sketch)
+{
+	// Far more intervals than the sketch keeps
+	auto values = std::vector<double>();
+	for (int i = 0; i < 100000; i++)
+		values.push_back((i * 7919) % 100000);
+	const Stats stats = feed(values);
+	EXPECT_NEAR(stats.estimate("misses", Estimator::P50), 50000, 2000);
+	EXPECT_NEAR(stats.estimate("misses", Estimator::P95), 95000, 2000);
+}
+
+
+TEST(Stats, Normalize)
+{
+	auto config = StatsConfig();
+	config.normalize = "wall_time";
+	Stats::configure(config);
+	Stats stats({"instructions", "wall_time", "occupancy"});
+	Stats::configure(StatsConfig());
+
+	// Intervals of 0.5 and 2 seconds
+	const std::vector<double> inst = {1000, 2000, 6000}, time = {0.5, 1, 3};
+	for (size_t i = 0; i < inst.size(); i++)
+	{
+		counters_t c;
+		c.insert({0, "instructions", inst[i], "", false, 1});
+		c.insert({1, "wall_time", time[i], "s", false, 1});
+		c.insert({2, "occupancy", 100, "bytes", true, 1});
+		stats.accum(c);
+	}
+
+	// The estimators see rates, the totals the raw values
+	EXPECT_DOUBLE_EQ(stats.estimate("instructions", Estimator::Last), 2000);
+	EXPECT_DOUBLE_EQ(stats.estimate("instructions", Estimator::Mean), 2000);
+	EXPECT_DOUBLE_EQ(stats.estimate("wall_time", Estimator::Last), 2);
+	EXPECT_DOUBLE_EQ(stats.estimate("occupancy", Estimator::Last), 100);
+	EXPECT_DOUBLE_EQ(stats.sum("instructions"), 6000);
+	EXPECT_DOUBLE_EQ(stats.get_rate("instructions"), 2000);
+	EXPECT_EQ(stats.data_to_string_total(","), "6000,3,100,1");
+}
+
+
+TEST(Stats, Slowdown)
+{
+	// The model is opt-in, the policies rank by the stalls by default
+	EXPECT_EQ(Stats({"instructions", "cycles", "mem_stalls"}).events.count("slowdown"), 0U);
+
+	auto config = StatsConfig();
+	config.slowdown = true;
+	Stats::configure(config);
+
+	Stats stats({"instructions", "cycles", "mem_stalls"});
+
+	// The second interval stalls one cycle more per instruction than the first, the least contended one
+	const std::vector<double> inst = {1000, 2000}, cycles = {2000, 5000}, stalls = {500, 2000};
+	for (size_t i = 0; i < inst.size(); i++)
+	{
+		counters_t c;
+		c.insert({0, "instructions", inst[i], "", false, 1});
+		c.insert({1, "cycles", cycles[i], "", false, 1});
+		c.insert({2, "mem_stalls", stalls[i], "", false, 1});
+		stats.accum(c);
+	}
+
+	EXPECT_EQ(stats.header_to_string(","), "instructions,cycles,mem_stalls,ipc,alone-ipc,slowdown,confidence");
+	EXPECT_DOUBLE_EQ(stats.estimate("slowdown", Estimator::Last), 1.5);
+	EXPECT_DOUBLE_EQ(stats.estimate("alone-ipc", Estimator::Last), 0.5);
+	EXPECT_DOUBLE_EQ(stats.get_total("slowdown"), 1.25);
+	EXPECT_DOUBLE_EQ(stats.history().slice("slowdown")[0], 1);
+
+	// Without stalls there is no estimation
+	Stats plain({"instructions", "cycles"});
+	EXPECT_EQ(plain.events.count("slowdown"), 0U);
+
+	Stats::configure(StatsConfig());
+}
+
+
+TEST(Stats, SlowdownContendedFromStart)
+{
+	SlowdownModel model;
+
+	// Contended from the first interval, there is nothing to compare with yet
+	for (int i = 0; i < 100; i++)
+		model.add(1000, 4000, 2000);
+	EXPECT_DOUBLE_EQ(model.slowdown(), 1);
+
+	// A less contended interval sets the baseline...
+	model.add(1000, 3000, 1000);
+	EXPECT_DOUBLE_EQ(model.slowdown(), 1);
+
+	// ...which is kept however long the contention lasts
+	for (int i = 0; i < 100; i++)
+	{
+		model.add(1000, 4000, 2000);
+		EXPECT_DOUBLE_EQ(model.slowdown(), 4.0 / 3);
+	}
+	EXPECT_DOUBLE_EQ(model.alone_ipc(), 1000.0 / 3000);
+}
+
+
+TEST(Stats, DerivedMetrics)
+{
+	auto config = StatsConfig();
+	config.metrics = {{"mpki", Expr("1000 * misses / instructions")}, {"ipc", Expr("2 * instructions / cycles")}};
+	Stats::configure(config);
+
+	Stats stats({"instructions", "cycles", "misses"});
+	counters_t c;
+	c.insert({0, "instructions", 2000, "", false, 1});
+	c.insert({1, "cycles", 1000, "", false, 1});
+	c.insert({2, "misses", 10, "", false, 1});
+	stats.accum(c);
+	c = counters_t();
+	c.insert({0, "instructions", 6000, "", false, 1});
+	c.insert({1, "cycles", 2000, "", false, 1});
+	c.insert({2, "misses", 20, "", false, 1});
+	stats.accum(c);
+
+	// The config ones go first and replace the built-in ones
+	EXPECT_EQ(stats.header_to_string(","), "instructions,cycles,misses,mpki,ipc,confidence");
+	EXPECT_DOUBLE_EQ(stats.sum("mpki"), 5 + 2.5);
+	EXPECT_EQ(stats.history().slice("mpki"), std::vector<double>({5, 2.5}));
+	EXPECT_EQ(stats.data_to_string_int(","), "4000,1000,10,2.5,8,1");
+	EXPECT_EQ(stats.data_to_string_total(","), "6000,2000,20,3.33333,6,1");
+}
+
+
+static Stats topdown_stats(const std::vector<std::pair<std::string, double>> &counters)
+{
+	auto names = std::vector<std::string>();
+	counters_t c;
+	for (const auto &kv : counters)
+	{
+		c.insert({(int) names.size(), kv.first, kv.second, "", false, 1});
+		names.push_back(kv.first);
+	}
+	Stats stats(names);
+	stats.accum(c);
+	return stats;
+}
+
+
+TEST(Stats, TopDown)
+{
+	// Without the slots counted, 4 per cycle. The level 1 adds up to 1, and each level 2 to its level 1.
+	const auto stats = topdown_stats(
+	{
+		{"topdown_cycles", 1000}, {"uops_not_delivered", 800}, {"fe_latency_cycles", 100}, {"uops_issued", 2200},
+		{"uops_retired_slots", 2000}, {"recovery_cycles", 25}, {"stalls_total", 400}, {"mem_stalls", 300},
+	});
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-frontend", Estimator::Last), 0.2);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-bad-spec", Estimator::Last), 0.075);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-retiring", Estimator::Last), 0.5);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-backend", Estimator::Last), 0.225);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-fe-latency", Estimator::Last), 0.1);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-fe-bandwidth", Estimator::Last), 0.1);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-be-memory", Estimator::Last), 0.225 * 0.75);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-be-core", Estimator::Last), 0.225 * 0.25);
+}
+
+
+TEST(Stats, TopDownSlots)
+{
+	// With the slots counted, 5 per cycle, e.g. in Ice Lake
+	const auto stats = topdown_stats(
+	{
+		{"topdown_slots", 5000}, {"uops_not_delivered", 1000}, {"fe_latency_cycles", 100}, {"uops_issued", 2600},
+		{"uops_retired_slots", 2500}, {"recovery_cycles", 20}, {"stalls_total", 400}, {"mem_stalls", 300},
+	});
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-frontend", Estimator::Last), 0.2);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-bad-spec", Estimator::Last), 0.04);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-retiring", Estimator::Last), 0.5);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-backend", Estimator::Last), 0.26);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-fe-latency", Estimator::Last), 0.1);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-fe-bandwidth", Estimator::Last), 0.1);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-be-memory", Estimator::Last), 0.26 * 0.75);
+	EXPECT_DOUBLE_EQ(stats.estimate("tma-be-core", Estimator::Last), 0.26 * 0.25);
+
+	// The plain cycles do not fall back to 4 slots per cycle, they may be from a 5-wide core
+	const auto cycles = topdown_stats(
+	{
+		{"cycles", 1000}, {"uops_not_delivered", 1000}, {"fe_latency_cycles", 100}, {"uops_issued", 2600},
+		{"uops_retired_slots", 2500}, {"recovery_cycles", 20}, {"stalls_total", 400}, {"mem_stalls", 300},
+	});
+	EXPECT_EQ(cycles.events.count("tma-frontend"), 0U);
+	EXPECT_EQ(cycles.events.count("tma-fe-latency"), 0U);
+
+	// The topdown_cycles are not available in Ice Lake, where only the slots are counted
+	EXPECT_THROW(event_db_resolve("topdown_cycles", Microarch::icelake), std::runtime_error);
+	const auto icelake = event_db_topdown(Microarch::icelake);
+	EXPECT_NE(std::find(icelake.begin(), icelake.end(), "topdown_slots"), icelake.end());
+	EXPECT_EQ(std::find(icelake.begin(), icelake.end(), "topdown_cycles"), icelake.end());
+}
+
+
+TEST(Workload, Metrics)
+{
+	const auto m = workload_metrics(std::vector<double>{0.5, 1, 0.8});
+	EXPECT_EQ(m.tasks, 3U);
+	EXPECT_DOUBLE_EQ(m.stp, 2.3);
+	EXPECT_DOUBLE_EQ(m.antt, (2 + 1 + 1.25) / 3);
+	EXPECT_DOUBLE_EQ(m.fairness, 0.5);
+
+	EXPECT_EQ(workload_metrics(std::vector<double>()).tasks, 0U);
+
+	// The tasks without progress are skipped, instead of making the ANTT infinite
+	const auto stopped = workload_metrics(std::vector<double>{0.5, 0, 1, -1, NAN, 0.8});
+	EXPECT_EQ(stopped.tasks, 3U);
+	EXPECT_DOUBLE_EQ(stopped.stp, 2.3);
+	EXPECT_DOUBLE_EQ(stopped.antt, (2 + 1 + 1.25) / 3);
+	EXPECT_DOUBLE_EQ(stopped.fairness, 0.5);
+
+	const auto none = workload_metrics(std::vector<double>{0, 0});
+	EXPECT_EQ(none.tasks, 0U);
+	EXPECT_DOUBLE_EQ(none.antt, 0);
+	EXPECT_DOUBLE_EQ(none.fairness, 0);
+}
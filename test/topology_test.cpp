@@ -0,0 +1,143 @@
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "common.hpp"
+#include "topology.hpp"
+
+
+namespace fs = boost::filesystem;
+
+
+TEST(CPUList, Parse)
+{
+	EXPECT_EQ(parse_cpu_list("0"), std::vector<uint32_t>({0}));
+	EXPECT_EQ(parse_cpu_list("0-3\n"), std::vector<uint32_t>({0, 1, 2, 3}));
+	EXPECT_EQ(parse_cpu_list("0,2,4-5"), std::vector<uint32_t>({0, 2, 4, 5}));
+	EXPECT_EQ(parse_cpu_list(""), std::vector<uint32_t>());
+	EXPECT_THROW(parse_cpu_list("a-b"), std::runtime_error);
+}
+
+
+// Builds a fake sysfs with 2 sockets, 2 cores per socket and 2 threads per core, and a resctrl info dir
+class TopologyTest : public testing::Test
+{
+	protected:
+
+	fs::path root;
+
+	void write(const fs::path &path, const std::string &value)
+	{
+		fs::create_directories(path.parent_path());
+		std::ofstream(path.string()) << value << std::endl;
+	}
+
+	void cache(const fs::path &cpu_dir, int index, int level, const std::string &type, int ways, const std::string &size, const std::string &cpus, int id)
+	{
+		const auto dir = cpu_dir / "cache" / ("index" + std::to_string(index));
+		write(dir / "level", std::to_string(level));
+		write(dir / "type", type);
+		write(dir / "ways_of_associativity", std::to_string(ways));
+		write(dir / "size", size);
+		write(dir / "coherency_line_size", "64");
+		write(dir / "shared_cpu_list", cpus);
+		write(dir / "id", std::to_string(id));
+	}
+
+	virtual void SetUp() override
+	{
+		root = fs::temp_directory_path() / fs::unique_path();
+		const auto cpu_root = root / "sys" / "devices" / "system" / "cpu";
+		write(cpu_root / "online", "0-7");
+		for (int cpu = 0; cpu < 8; cpu++)
+		{
+			const int socket = cpu / 4;
+			const int core = (cpu % 4) / 2;
+			const int first = cpu - cpu % 2;
+			const auto dir = cpu_root / ("cpu" + std::to_string(cpu));
+			const std::string siblings = std::to_string(first) + "-" + std::to_string(first + 1);
+			const std::string llc = socket ? "4-7" : "0-3";
+			write(dir / "topology" / "physical_package_id", std::to_string(socket));
+			write(dir / "topology" / "core_id", std::to_string(core));
+			write(dir / "topology" / "thread_siblings_list", siblings);
+			cache(dir, 0, 1, "Data", 8, "32K", siblings, first / 2);
+			cache(dir, 1, 1, "Instruction", 8, "32K", siblings, first / 2);
+			cache(dir, 2, 2, "Unified", 16, "1024K", siblings, first / 2);
+			cache(dir, 3, 3, "Unified", 11, "14080K", llc, socket);
+		}
+		write(root / "sys" / "devices" / "system" / "node" / "node0" / "cpulist", "0-3");
+		write(root / "sys" / "devices" / "system" / "node" / "node1" / "cpulist", "4-7");
+
+		const auto info = root / "resctrl" / "info";
+		write(info / "L3" / "cbm_mask", "7ff");
+		write(info / "L3" / "min_cbm_bits", "1");
+		write(info / "L3" / "num_closids", "16");
+		write(info / "L3_MON" / "num_rmids", "176");
+	}
+
+	virtual void TearDown() override
+	{
+		fs::remove_all(root);
+	}
+};
+
+
+TEST_F(TopologyTest, CPUs)
+{
+	const auto topo = topology_read((root / "sys").string(), (root / "resctrl").string());
+	ASSERT_EQ(topo.cpus.size(), 8U);
+	EXPECT_EQ(topo.sockets.size(), 2U);
+	EXPECT_EQ(topo.sockets.at(1), std::vector<uint32_t>({4, 5, 6, 7}));
+	EXPECT_EQ(topo.cpu(5).socket, 1U);
+	EXPECT_EQ(topo.cpu(5).core, 0U);
+	EXPECT_EQ(topo.cpu(5).siblings, std::vector<uint32_t>({4, 5}));
+	EXPECT_THROW(topo.cpu(8), std::runtime_error);
+	EXPECT_FALSE(topo.has_cpu(8));
+}
+
+
+TEST_F(TopologyTest, NUMA)
+{
+	const auto topo = topology_read((root / "sys").string(), (root / "resctrl").string());
+	ASSERT_EQ(topo.nodes.size(), 2U);
+	EXPECT_EQ(topo.cpu(3).node, 0U);
+	EXPECT_EQ(topo.cpu(4).node, 1U);
+}
+
+
+TEST_F(TopologyTest, Caches)
+{
+	const auto topo = topology_read((root / "sys").string(), (root / "resctrl").string());
+	EXPECT_EQ(topo.caches_of_level(1).size(), 4U); // Instruction caches are ignored
+	EXPECT_EQ(topo.caches_of_level(2).size(), 4U);
+	ASSERT_EQ(topo.caches_of_level(3).size(), 2U);
+	EXPECT_EQ(topo.cache(6, 3).id, 1U);
+	EXPECT_EQ(topo.cache(6, 3).size, 14080ULL << 10);
+	EXPECT_EQ(topo.cache(6, 3).cpus, std::vector<uint32_t>({4, 5, 6, 7}));
+	EXPECT_THROW(topo.cache(0, 4), std::runtime_error);
+}
+
+
+TEST_F(TopologyTest, CAT)
+{
+	const auto topo = topology_read((root / "sys").string(), (root / "resctrl").string());
+	EXPECT_EQ(topo.cat.size(), 1U); // L3_MON has no CBM and is not a CAT resource
+	EXPECT_EQ(topo.cache_ways(3), 11U);
+	EXPECT_EQ(topo.cbm_mask(3), 0x7ffULL);
+	EXPECT_EQ(topo.num_closids(3), 16U);
+	EXPECT_THROW(topo.num_closids(2), std::runtime_error);
+}
+
+
+TEST_F(TopologyTest, NoResctrl)
+{
+	fs::remove_all(root / "resctrl");
+	const auto topo = topology_read((root / "sys").string(), (root / "resctrl").string());
+	EXPECT_TRUE(topo.cat.empty());
+	EXPECT_EQ(topo.cache_ways(3), 11U);
+	EXPECT_EQ(topo.cbm_mask(3), 0x7ffULL);
+	EXPECT_EQ(topo.cache_ways(2), 16U);
+}
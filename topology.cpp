@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "throw-with-trace.hpp"
+#include "topology.hpp"
+
+
+namespace fs = boost::filesystem;
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+static string read_line(const fs::path &path);
+static uint64_t read_size(const fs::path &path);
+static void read_cpu(const fs::path &cpu_dir, CPUInfo &cpu, vector<CacheInfo> &caches);
+
+
+static
+string read_line(const fs::path &path)
+{
+	string line;
+	try
+	{
+		std::ifstream f = open_ifstream(path);
+		std::getline(f, line);
+	}
+	catch (const std::system_error &e)
+	{
+		throw_with_trace(std::runtime_error("Cannot read '{}': {}"_format(path.string(), strerror(errno))));
+	}
+	return line;
+}
+
+
+// Sizes in sysfs have the format "32K", "1024K", "20M"...
+static
+uint64_t read_size(const fs::path &path)
+{
+	const string str = read_line(path);
+	size_t pos;
+	uint64_t size = std::stoull(str, &pos);
+	switch (pos < str.size() ? str[pos] : ' ')
+	{
+		case 'K': return size << 10;
+		case 'M': return size << 20;
+		case 'G': return size << 30;
+		default:  return size;
+	}
+}
+
+
+static
+void read_cpu(const fs::path &cpu_dir, CPUInfo &cpu, vector<CacheInfo> &caches)
+{
+	cpu.socket = std::stoul(read_line(cpu_dir / "topology" / "physical_package_id"));
+	cpu.core = std::stoul(read_line(cpu_dir / "topology" / "core_id"));
+	cpu.siblings = parse_cpu_list(read_line(cpu_dir / "topology" / "thread_siblings_list"));
+
+	if (!fs::exists(cpu_dir / "cache"))
+		return;
+
+	for (const auto &p : fs::directory_iterator(cpu_dir / "cache"))
+	{
+		if (!fs::is_directory(p) || p.path().filename().string().find("index") != 0)
+			continue;
+
+		CacheInfo cache;
+		cache.type = read_line(p / "type");
+		if (cache.type == "Instruction")
+			continue;
+		cache.level = std::stoul(read_line(p / "level"));
+		cache.ways = std::stoul(read_line(p / "ways_of_associativity"));
+		cache.size = read_size(p / "size");
+		cache.line_size = std::stoul(read_line(p / "coherency_line_size"));
+		cache.cpus = parse_cpu_list(read_line(p / "shared_cpu_list"));
+
+		// Old kernels do not export the cache id, so we identify caches by the CPUs sharing them
+		auto it = std::find_if(caches.begin(), caches.end(), [&cache](const CacheInfo &c)
+				{ return c.level == cache.level && c.cpus == cache.cpus; });
+		if (it != caches.end())
+			continue;
+
+		if (fs::exists(p / "id"))
+			cache.id = std::stoul(read_line(p / "id"));
+		else
+			cache.id = std::count_if(caches.begin(), caches.end(), [&cache](const CacheInfo &c)
+					{ return c.level == cache.level; });
+		caches.push_back(cache);
+	}
+}
+
+
+Topology topology_read(const string &sysfs, const string &resctrl)
+{
+	Topology topo;
+	const fs::path cpu_root = fs::path(sysfs) / "devices" / "system" / "cpu";
+	const fs::path node_root = fs::path(sysfs) / "devices" / "system" / "node";
+
+	for (uint32_t id : parse_cpu_list(read_line(cpu_root / "online")))
+	{
+		CPUInfo cpu;
+		cpu.id = id;
+		try
+		{
+			read_cpu(cpu_root / "cpu{}"_format(id), cpu, topo.caches);
+		}
+		catch (const std::logic_error &e)
+		{
+			throw_with_trace(std::runtime_error("Cannot parse the topology of CPU {}: {}"_format(id, e.what())));
+		}
+		topo.sockets[cpu.socket].push_back(id);
+		topo.cpus.push_back(cpu);
+	}
+
+	// NUMA nodes are optional, kernels without NUMA support put everything in node 0
+	if (fs::exists(node_root))
+	{
+		for (const auto &p : fs::directory_iterator(node_root))
+		{
+			const string name = p.path().filename().string();
+			if (name.find("node") != 0 || name.size() == 4 || !std::isdigit(name[4]))
+				continue;
+			const uint32_t node = std::stoul(name.substr(4));
+			for (uint32_t id : parse_cpu_list(read_line(p / "cpulist")))
+			{
+				if (!topo.has_cpu(id))
+					continue;
+				topo.nodes[node].push_back(id);
+				auto it = std::find_if(topo.cpus.begin(), topo.cpus.end(), [id](const CPUInfo &c) { return c.id == id; });
+				it->node = node;
+			}
+		}
+	}
+	if (topo.nodes.empty())
+		for (const auto &cpu : topo.cpus)
+			topo.nodes[0].push_back(cpu.id);
+
+	for (auto &node : topo.nodes)
+		std::sort(node.second.begin(), node.second.end());
+
+	// Resctrl is optional too, CAT may be managed through MSRs
+	if (fs::exists(fs::path(resctrl) / "info"))
+		topo.cat = cat_read_info((fs::path(resctrl) / "info").string());
+
+	return topo;
+}
+
+
+const Topology& topology()
+{
+	static const Topology topo = topology_read();
+	return topo;
+}
+
+
+bool Topology::has_cpu(uint32_t cpu) const
+{
+	return std::any_of(cpus.begin(), cpus.end(), [cpu](const CPUInfo &c) { return c.id == cpu; });
+}
+
+
+const CPUInfo& Topology::cpu(uint32_t cpu) const
+{
+	auto it = std::find_if(cpus.begin(), cpus.end(), [cpu](const CPUInfo &c) { return c.id == cpu; });
+	if (it == cpus.end())
+		throw_with_trace(std::runtime_error("CPU {} does not exist or is offline"_format(cpu)));
+	return *it;
+}
+
+
+const CacheInfo& Topology::cache(uint32_t cpu, uint32_t level) const
+{
+	for (const auto &cache : caches)
+		if (cache.level == level && std::count(cache.cpus.begin(), cache.cpus.end(), cpu))
+			return cache;
+	throw_with_trace(std::runtime_error("CPU {} has no L{} cache"_format(cpu, level)));
+}
+
+
+vector<CacheInfo> Topology::caches_of_level(uint32_t level) const
+{
+	auto result = vector<CacheInfo>();
+	std::copy_if(caches.begin(), caches.end(), std::back_inserter(result), [level](const CacheInfo &c) { return c.level == level; });
+	return result;
+}
+
+
+const CATInfo& Topology::cat_info(uint32_t level) const
+{
+	const auto it = cat.find("L{}"_format(level));
+	if (it == cat.end())
+		throw_with_trace(std::runtime_error("CAT is not available for the L{}, is resctrl mounted?"_format(level)));
+	return it->second;
+}
+
+
+uint32_t Topology::cache_ways(uint32_t level) const
+{
+	if (cat.count("L{}"_format(level)))
+		return __builtin_popcountll(cat_info(level).cbm_mask);
+
+	const auto level_caches = caches_of_level(level);
+	if (level_caches.empty())
+		throw_with_trace(std::runtime_error("There is no L{} cache"_format(level)));
+	return level_caches.front().ways;
+}
+
+
+uint64_t Topology::cbm_mask(uint32_t level) const
+{
+	if (cat.count("L{}"_format(level)))
+		return cat_info(level).cbm_mask;
+	return ~(-1ULL << cache_ways(level));
+}
+
+
+uint32_t Topology::min_cbm_bits(uint32_t level) const
+{
+	return cat.count("L{}"_format(level)) ? cat_info(level).min_cbm_bits : 1;
+}
+
+
+uint32_t Topology::num_closids(uint32_t level) const
+{
+	return cat_info(level).num_closids;
+}
+
+
+std::string Topology::to_string() const
+{
+	std::stringstream ss;
+	ss << "{} CPUs, {} sockets, {} NUMA nodes"_format(cpus.size(), sockets.size(), nodes.size());
+	for (uint32_t level = 1; level <= 3; level++)
+	{
+		const auto level_caches = caches_of_level(level);
+		if (level_caches.empty())
+			continue;
+		const auto &c = level_caches.front();
+		ss << ", {} L{} of {} KB and {} ways"_format(level_caches.size(), level, c.size >> 10, c.ways);
+	}
+	for (const auto &kv : cat)
+		ss << ", CAT {}: mask {:#x}, {} CLOSes"_format(kv.first, kv.second.cbm_mask, kv.second.num_closids);
+	return ss.str();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cat-linux.hpp"
+
+
+struct CacheInfo
+{
+	uint32_t id = 0;             // Unique among the caches of the same level
+	uint32_t level = 0;
+	std::string type;            // Data, Instruction or Unified
+	uint32_t ways = 0;           // Associativity
+	uint64_t size = 0;           // Bytes
+	uint32_t line_size = 0;      // Bytes
+	std::vector<uint32_t> cpus;  // CPUs sharing this cache
+};
+
+
+struct CPUInfo
+{
+	uint32_t id = 0;
+	uint32_t socket = 0;
+	uint32_t core = 0;
+	uint32_t node = 0;               // NUMA node
+	std::vector<uint32_t> siblings;  // SMT siblings, the CPU itself included
+};
+
+
+// Hardware topology of the machine, as reported by sysfs and resctrl
+class Topology
+{
+	public:
+
+	std::vector<CPUInfo> cpus;                          // Online CPUs
+	std::vector<CacheInfo> caches;                      // Data and unified caches, one entry per cache domain
+	std::map<uint32_t, std::vector<uint32_t>> sockets;  // Socket id -> CPUs
+	std::map<uint32_t, std::vector<uint32_t>> nodes;    // NUMA node -> CPUs
+	std::map<std::string, CATInfo> cat;                 // Resctrl info, empty if resctrl is not mounted
+
+	Topology() = default;
+
+	bool has_cpu(uint32_t cpu) const;
+	const CPUInfo& cpu(uint32_t cpu) const;
+	const CacheInfo& cache(uint32_t cpu, uint32_t level) const;
+	std::vector<CacheInfo> caches_of_level(uint32_t level) const;
+
+	// Ways that can be allocated with CAT, or the associativity of the cache if CAT is not available
+	uint32_t cache_ways(uint32_t level) const;
+	uint64_t cbm_mask(uint32_t level) const;
+	uint32_t min_cbm_bits(uint32_t level) const;
+	uint32_t num_closids(uint32_t level) const;
+	const CATInfo& cat_info(uint32_t level) const;
+
+	std::string to_string() const;
+};
+
+
+// Reads the topology from the given sysfs and resctrl mount points
+Topology topology_read(const std::string &sysfs = "/sys", const std::string &resctrl = "/sys/fs/resctrl");
+
+// The topology of this machine, read only the first time it is requested
+const Topology& topology();
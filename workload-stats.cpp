@@ -0,0 +1,61 @@
+#include <algorithm>
+#include <iterator>
+
+#include "workload-stats.hpp"
+
+
+WorkloadMetrics workload_metrics(const std::vector<double> &progress)
+{
+	WorkloadMetrics m;
+
+	// The tasks without progress, e.g. stopped, would make the ANTT infinite and the fairness 0, they are skipped
+	auto valid = std::vector<double>();
+	std::copy_if(progress.begin(), progress.end(), std::back_inserter(valid), [](double p) { return p > 0; });
+	if (valid.empty())
+		return m;
+
+	double slowdowns = 0;
+	for (const auto &p : valid)
+	{
+		m.stp += p;
+		slowdowns += 1 / p;
+	}
+	m.antt = slowdowns / valid.size();
+
+	const auto minmax = std::minmax_element(valid.begin(), valid.end());
+	m.fairness = *minmax.first / *minmax.second;
+	m.tasks = valid.size();
+	return m;
+}
+
+
+WorkloadMetrics workload_metrics(const std::vector<Task> &tasklist, bool total)
+{
+	auto progress = std::vector<double>();
+	for (const auto &task : tasklist)
+	{
+		if (task.ref_ipc <= 0)
+			continue;
+		const double ipc = total ? task.stats.get_total("ipc") : task.stats.estimate("ipc", Estimator::Last);
+		progress.push_back(ipc / task.ref_ipc);
+	}
+	return workload_metrics(progress);
+}
+
+
+bool workload_has_references(const std::vector<Task> &tasklist)
+{
+	return std::any_of(tasklist.begin(), tasklist.end(), [](const Task &task) { return task.ref_ipc > 0; });
+}
+
+
+void workload_print_headers(std::ostream &out, const std::string &sep)
+{
+	out << "interval" << sep << "tasks" << sep << "stp" << sep << "antt" << sep << "fairness" << std::endl;
+}
+
+
+void workload_print(uint64_t interval, const WorkloadMetrics &m, std::ostream &out, const std::string &sep)
+{
+	out << interval << sep << m.tasks << sep << m.stp << sep << m.antt << sep << m.fairness << std::endl;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "task.hpp"
+
+
+// Throughput and fairness of the workload, from the progress of each task: its IPC relative to the IPC it achieves
+// running alone (ref_ipc in the config). Only the tasks with a reference IPC and some progress are taken into account.
+//   stp       System throughput (weighted speedup), the sum of the progress of the tasks
+//   antt      Average normalized turnaround time, the mean of the slowdowns (the inverse of the progress)
+//   fairness  Minimum progress over maximum progress, 1 when all the tasks are slowed down alike
+struct WorkloadMetrics
+{
+	double stp = 0;
+	double antt = 0;
+	double fairness = 0;
+	size_t tasks = 0;
+};
+
+WorkloadMetrics workload_metrics(const std::vector<double> &progress);
+
+// For the last interval, or for the whole execution if 'total' is true. The tasks need the 'ipc' derived metric.
+WorkloadMetrics workload_metrics(const std::vector<Task> &tasklist, bool total = false);
+
+// True if some task has a reference IPC
+bool workload_has_references(const std::vector<Task> &tasklist);
+
+void workload_print_headers(std::ostream &out, const std::string &sep = ",");
+void workload_print(uint64_t interval, const WorkloadMetrics &m, std::ostream &out, const std::string &sep = ",");